@@ -36,6 +36,7 @@
 #include "stmlib/system/uid.h"
 
 #include "braids/drivers/adc.h"
+#include "braids/drivers/cycle_counter.h"
 #include "braids/drivers/dac.h"
 #include "braids/drivers/debug_pin.h"
 #include "braids/drivers/gate_input.h"
@@ -76,6 +77,14 @@ volatile bool trigger_flag;
 uint16_t trigger_delay;
 static int32_t sh_pitch;
 
+#ifdef PROFILE_RENDER_BLOCK
+// Read with a debugger. A block lasts kBlockSize samples at 96kHz, that is
+// 18000 cycles at 72MHz, shared with the interrupts and the UI.
+CycleCounter cycle_counter;
+volatile uint32_t render_block_cycles;
+volatile uint32_t render_block_max_cycles;
+#endif  // PROFILE_RENDER_BLOCK
+
 // Templated function to do parameter clipping
 template <typename ParamType> 
 inline static ParamType ParamClip(ParamType param, ParamType min_param, ParamType max_param) {
@@ -173,6 +182,9 @@ void Init() {
   envelope.Init();
   envelope2.Init();
   jitter_source.Init(GetUniqueId(1));
+#ifdef PROFILE_RENDER_BLOCK
+  cycle_counter.Init();
+#endif  // PROFILE_RENDER_BLOCK
   sys.StartTimers();
 }
 
@@ -345,15 +357,19 @@ void RenderBlock() {
   static int32_t turing_pitch_delta = 0;
   
   // debug_pin.High();
+#ifdef PROFILE_RENDER_BLOCK
+  uint32_t start_cycle = cycle_counter.Read();
+#endif  // PROFILE_RENDER_BLOCK
 
-  uint8_t meta_mod = settings.GetValue(SETTING_META_MODULATION); // FMCV setting, in fact
-  uint8_t modulator1_mode = settings.GetValue(SETTING_MOD1_MODE);
-  uint8_t modulator2_mode = settings.GetValue(SETTING_MOD2_MODE);
+  const RenderSettings& s = settings.render_settings();
+  uint8_t meta_mod = s.meta_modulation; // FMCV setting, in fact
+  uint8_t modulator1_mode = s.mod1_mode;
+  uint8_t modulator2_mode = s.mod2_mode;
 
   // use FM CV data for env params if envelopes or LFO modes are enabled
   // Note, we invert the parameter if in LFO mode, so higher voltages produce 
   // higher LFO frequencies
-  uint32_t env_a_param = uint32_t (settings.GetValue(SETTING_MOD1_RATE));
+  uint32_t env_a_param = uint32_t (s.mod1_rate);
   uint32_t env_d_param = env_a_param;
   uint32_t env_a = 0;
   uint32_t env_d = 0;
@@ -371,15 +387,15 @@ void RenderBlock() {
   env_d_param = ParamClip(env_d_param, 0ul, 127ul);
 
   // Invert if in LFO mode, so higher CVs create higher LFO frequency.
-  if (modulator1_mode == 1 && settings.rate_inversion()) {
+  if (modulator1_mode == 1 && s.rate_inversion) {
 	 env_a_param = 127 - env_a_param ;
 	 env_d_param = 127 - env_d_param ;
   }  
 
   // attack and decay parameters, default to FM voltage reading.
   // These are ratios of attack to decay, from A/D = 0 to 127
-  env_a = ((1 + (settings.GetValue(SETTING_MOD1_AD_RATIO))) * env_a_param) >> 6;  
-  env_d = ((128 - (settings.GetValue(SETTING_MOD1_AD_RATIO))) * env_d_param) >> 6;   
+  env_a = ((1 + (s.mod1_ad_ratio)) * env_a_param) >> 6;  
+  env_d = ((128 - (s.mod1_ad_ratio)) * env_d_param) >> 6;   
 
   // Clip at zero and 127
   env_a = ParamClip(env_a, 0ul, 127ul);
@@ -397,14 +413,14 @@ void RenderBlock() {
   }	  
   // now set the attack and decay parameters 
   // using the modified attack and decay values
-  envelope.Update(env_a, env_d, 0, 0, LFO_mode, settings.GetValue(SETTING_MOD1_ATTACK_SHAPE), settings.GetValue(SETTING_MOD1_DECAY_SHAPE));  
+  envelope.Update(env_a, env_d, 0, 0, LFO_mode, s.mod1_attack_shape, s.mod1_decay_shape);  
   // Render the envelope
   uint16_t ad_value = envelope.Render() ;
 
 
   // TO-DO: instead of repeating code, use an array for env params and a loop!
   // Note: tried in branch envelope-tidy-up, but resulted in bigger compiled size
-  uint32_t env2_a_param = uint32_t (settings.GetValue(SETTING_MOD2_RATE));
+  uint32_t env2_a_param = uint32_t (s.mod2_rate);
   uint32_t env2_d_param = env2_a_param;
   uint32_t env2_a = 0;
   uint32_t env2_d = 0;
@@ -417,7 +433,7 @@ void RenderBlock() {
 	 env2_d_param += settings.adc_to_fm(adc.channel(3)) >> 5;
   }
   // Add cross-modulation
-  int8_t mod1_mod2_depth = settings.GetValue(SETTING_MOD1_MOD2_DEPTH);
+  int8_t mod1_mod2_depth = s.mod1_mod2_depth;
   if (mod1_mod2_depth) {
 	env2_a_param +=  (ad_value * mod1_mod2_depth) >> 18;
 	env2_a_param +=  (ad_value * mod1_mod2_depth) >> 18;
@@ -426,14 +442,14 @@ void RenderBlock() {
   env2_a_param = ParamClip(env2_a_param, 0ul, 127ul);
   env2_d_param = ParamClip(env2_d_param, 0ul, 127ul);
   
-  if (modulator2_mode == 1 && settings.rate_inversion()) { 
+  if (modulator2_mode == 1 && s.rate_inversion) { 
 	 env2_a_param = 127 - env2_a_param ;
 	 env2_d_param = 127 - env2_d_param ;
   }  
 
   // These are ratios of attack to decay, from A/D = 0 to 127
-  env2_a = ((1 + settings.GetValue(SETTING_MOD2_AD_RATIO)) * env2_a_param) >> 6; 
-  env2_d = ((128 - settings.GetValue(SETTING_MOD2_AD_RATIO)) * env2_d_param) >> 6; 
+  env2_a = ((1 + s.mod2_ad_ratio) * env2_a_param) >> 6; 
+  env2_d = ((128 - s.mod2_ad_ratio) * env2_d_param) >> 6; 
 
   // Clip at zero and 127
   env2_a = ParamClip(env2_a, 0ul, 127ul);
@@ -450,17 +466,17 @@ void RenderBlock() {
   }	  
   // now set the attack and decay parameters 
   // using the modified attack and decay values
-  envelope2.Update(env2_a, env2_d, 0, 0, LFO_mode, settings.GetValue(SETTING_MOD2_ATTACK_SHAPE), settings.GetValue(SETTING_MOD2_DECAY_SHAPE));  
+  envelope2.Update(env2_a, env2_d, 0, 0, LFO_mode, s.mod2_attack_shape, s.mod2_decay_shape);  
   // Render the envelope
   uint16_t ad2_value = envelope2.Render() ;
 
   // meta-sequencer
-  uint8_t metaseq_length = settings.GetValue(SETTING_METASEQ);
+  uint8_t metaseq_length = s.metaseq;
   if (trigger_flag && metaseq_length) {
      ++metaseq_div_counter;
-     if (metaseq_div_counter >= settings.GetValue(SETTING_METASEQ_CLOCK_DIV)) {
+     if (metaseq_div_counter >= s.metaseq_clock_div) {
         metaseq_div_counter = 0;
-	    uint8_t metaseq_direction = settings.GetValue(SETTING_METASEQ_DIRECTION);
+	    uint8_t metaseq_direction = s.metaseq_direction;
         if (metaseq_direction != prev_metaseq_direction) {
            prev_metaseq_direction = metaseq_direction;
            metaseq_steps_index = 0;
@@ -468,7 +484,7 @@ void RenderBlock() {
            current_mseq_dir = true;
         }
 	    ++metaseq_steps_index;
-	    if (metaseq_steps_index >= (settings.metaseq_step_length(metaseq_index))) { 
+	    if (metaseq_steps_index >= (s.metaseq_step_length[metaseq_index])) { 
 	       metaseq_steps_index = 0;
 		   if (metaseq_direction == 0) {
 		      // looping
@@ -497,16 +513,17 @@ void RenderBlock() {
 		     metaseq_index = (uint8_t(Random::GetWord() >> 29) * (metaseq_length + 1)) >> 3;
 		   }
         }
-	    MacroOscillatorShape metaseq_current_shape = settings.metaseq_shape(metaseq_index);
+	    MacroOscillatorShape metaseq_current_shape = \
+            static_cast<MacroOscillatorShape>(s.metaseq_shape[metaseq_index]);
 	    osc.set_shape(metaseq_current_shape);
 	    ui.set_meta_shape(metaseq_current_shape);
-	    metaseq_pitch_delta = settings.metaseq_note(metaseq_index) << 7;
-        metaseq_parameter = settings.metaseq_parameter(metaseq_index) ;
+	    metaseq_pitch_delta = s.metaseq_note[metaseq_index] << 7;
+        metaseq_parameter = s.metaseq_parameter[metaseq_index] ;
      }
   } // end meta-sequencer
   
   // Turing machine
-  int16_t turing_length = static_cast<int16_t>(settings.GetValue(SETTING_TURING_LENGTH));
+  int16_t turing_length = static_cast<int16_t>(s.turing_length);
   // Add to the Turing shift register length if FMCV=TRNG
   if (meta_mod == 10) {
      // add the FM CV amount
@@ -516,16 +533,16 @@ void RenderBlock() {
   }
   if (trigger_flag && turing_length) {
      ++turing_div_counter;
-     if (turing_div_counter >= settings.GetValue(SETTING_TURING_CLOCK_DIV)) {
+     if (turing_div_counter >= s.turing_clock_div) {
         turing_div_counter = 0;
         // initialise the shift register if required
         if (!turing_shift_register) {
            turing_shift_register = Random::GetWord();
         }
         // re-initialise the shift register with random data if required
-        if (settings.GetValue(SETTING_TURING_INIT)) {
+        if (s.turing_init) {
            ++turing_init_counter;
-           if (turing_init_counter >= settings.GetValue(SETTING_TURING_INIT)) {
+           if (turing_init_counter >= s.turing_init) {
               turing_init_counter = 0;
               turing_shift_register = Random::GetWord();
            }
@@ -554,7 +571,7 @@ void RenderBlock() {
            }
         }
         // decide whether to flip the LSB
-        int16_t turing_prob = settings.GetValue(SETTING_TURING_PROB);
+        int16_t turing_prob = s.turing_prob;
         if (meta_mod == 11) {
            // add the FM CV amount
 	       turing_prob += settings.adc_to_fm(adc.channel(3)) >> 5;
@@ -568,7 +585,7 @@ void RenderBlock() {
            turing_shift_register = turing_shift_register ^ static_cast<uint32_t>(1) ;
         }
         // read the window and calculate pitch increment
-        int16_t turing_window = settings.GetValue(SETTING_TURING_WINDOW);
+        int16_t turing_window = s.turing_window;
         if (meta_mod == 12) {
            // add the FM CV amount, offset by 2
 	       turing_window += (settings.adc_to_fm(adc.channel(3)) >> 7) + 2;
@@ -579,13 +596,13 @@ void RenderBlock() {
         uint32_t turing_byte = turing_shift_register & static_cast<uint32_t>(0xFF);
         uint8_t turing_value = (turing_byte * static_cast<uint8_t>(turing_window)) >> 8;
         // convert into a pitch increment
-        if (settings.GetValue(SETTING_MUSICAL_SCALE) == 0) {
+        if (s.musical_scale == 0) {
            turing_pitch_delta = turing_value << 7 ;
-        } else if (settings.GetValue(SETTING_MUSICAL_SCALE) < 25) {
-           uint8_t turing_whole_octaves = turing_value / turing_divisors[(settings.GetValue(SETTING_MUSICAL_SCALE) - 1)] ;
-           uint8_t turing_remainder_semitones = turing_value - (turing_whole_octaves * turing_divisors[(settings.GetValue(SETTING_MUSICAL_SCALE) - 1)]);          
-           turing_pitch_delta = ((turing_whole_octaves * 12) + turing_scales[((settings.GetValue(SETTING_MUSICAL_SCALE) - 1) << 3) + turing_remainder_semitones]) << 7 ;
-        } else if (settings.GetValue(SETTING_MUSICAL_SCALE) == 25) {
+        } else if (s.musical_scale < 25) {
+           uint8_t turing_whole_octaves = turing_value / turing_divisors[(s.musical_scale - 1)] ;
+           uint8_t turing_remainder_semitones = turing_value - (turing_whole_octaves * turing_divisors[(s.musical_scale - 1)]);          
+           turing_pitch_delta = ((turing_whole_octaves * 12) + turing_scales[((s.musical_scale - 1) << 3) + turing_remainder_semitones]) << 7 ;
+        } else if (s.musical_scale == 25) {
            // Harmonic series
            turing_pitch_delta = (1536 * log2_table[turing_value]) >> 11;
         }
@@ -595,17 +612,17 @@ void RenderBlock() {
   // modulate timbre
   int32_t parameter_1 = adc.channel(0) << 3; 
   if (modulator1_mode == 2) {
-	 parameter_1 -= (ad_value * settings.mod1_timbre_depth()) >> 9;
+	 parameter_1 -= (ad_value * s.mod1_timbre_depth) >> 9;
   } else {
-	 parameter_1 += (ad_value * settings.mod1_timbre_depth()) >> 9;
+	 parameter_1 += (ad_value * s.mod1_timbre_depth) >> 9;
   }  
   if (modulator2_mode == 2) {  
-     parameter_1 -= (ad2_value * settings.mod2_timbre_depth()) >> 9;
+     parameter_1 -= (ad2_value * s.mod2_timbre_depth) >> 9;
   } else {
-     parameter_1 += (ad2_value * settings.mod2_timbre_depth()) >> 9;
+     parameter_1 += (ad2_value * s.mod2_timbre_depth) >> 9;
   }
   // scale the gain by the meta-sequencer parameter if applicable
-  if (metaseq_length && (settings.GetValue(SETTING_METASEQ_PARAMETER_DEST) & 1)) {
+  if (metaseq_length && (s.metaseq_parameter_dest & 1)) {
      parameter_1 = (parameter_1 * metaseq_parameter) >> 7;
   }
   // clip
@@ -614,17 +631,17 @@ void RenderBlock() {
   // modulate colour
   int32_t parameter_2 = adc.channel(1) << 3; 
   if (modulator1_mode == 2) {
-	 parameter_2 -= (ad_value * settings.mod1_color_depth()) >> 9;
+	 parameter_2 -= (ad_value * s.mod1_color_depth) >> 9;
   } else {
-	 parameter_2 += (ad_value * settings.mod1_color_depth()) >> 9;
+	 parameter_2 += (ad_value * s.mod1_color_depth) >> 9;
   }
   if (modulator2_mode == 2) {  
-	 parameter_2 -= (ad2_value * settings.mod2_color_depth()) >> 9;
+	 parameter_2 -= (ad2_value * s.mod2_color_depth) >> 9;
   } else {
-	 parameter_2 += (ad2_value * settings.mod2_color_depth()) >> 9;
+	 parameter_2 += (ad2_value * s.mod2_color_depth) >> 9;
   }
   // scale the gain by the meta-sequencer parameter if applicable
-  if (metaseq_length && (settings.GetValue(SETTING_METASEQ_PARAMETER_DEST) & 2)) {
+  if (metaseq_length && (s.metaseq_parameter_dest & 2)) {
      parameter_2 = (parameter_2 * metaseq_parameter) >> 7;
   }
   // clip
@@ -638,14 +655,14 @@ void RenderBlock() {
   if (!metaseq_length) {
 	  if (meta_mod == 1) {
 		int32_t shape = adc.channel(3);
-		shape -= settings.data().fm_cv_offset;
+		shape -= s.fm_cv_offset;
 		if (shape > previous_shape + 2 || shape < previous_shape - 2) {
 		  previous_shape = shape;
 		} else {
 		  shape = previous_shape;
 		}
 		shape = MACRO_OSC_SHAPE_LAST * shape >> 11;
-		shape += settings.shape();
+		shape += s.shape;
 		if (shape >= MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META) {
 			shape = MACRO_OSC_SHAPE_LAST_ACCESSIBLE_FROM_META;
 		} else if (shape <= 0) {
@@ -655,14 +672,14 @@ void RenderBlock() {
 		osc.set_shape(osc_shape);
 		ui.set_meta_shape(osc_shape);
 	  } else {
-		osc.set_shape(settings.shape());
+		osc.set_shape(static_cast<MacroOscillatorShape>(s.shape));
 	  }
   } 
   
   // Apply hysteresis to ADC reading to prevent a single bit error to move
   // the quantized pitch up and down the quantization boundary.
   uint16_t pitch_adc_code = adc.channel(2);
-  if (settings.pitch_quantization()) {
+  if (s.pitch_quantization) {
     if ((pitch_adc_code > previous_pitch_adc_code + 4) ||
         (pitch_adc_code < previous_pitch_adc_code - 4)) {
       previous_pitch_adc_code = pitch_adc_code;
@@ -674,7 +691,7 @@ void RenderBlock() {
   int32_t pitch = settings.adc_to_pitch(pitch_adc_code);
 
   // Sample and hold pitch if enabled
-  if (settings.pitch_sample_hold()) {
+  if (s.pitch_sample_hold) {
      if (trigger_flag) {
         sh_pitch = pitch;
      }
@@ -682,10 +699,10 @@ void RenderBlock() {
   }
   
   // add vibrato from modulators 1 and 2 before or after quantisation
-  uint8_t mod1_vibrato_depth = settings.GetValue(SETTING_MOD1_VIBRATO_DEPTH); // 0 to 127
-  uint8_t mod2_vibrato_depth = settings.GetValue(SETTING_MOD2_VIBRATO_DEPTH); // 0 to 127
-  bool mod1_mod2_vibrato_depth = settings.mod1_mod2_vibrato_depth();
-  bool quantize_vibrato = settings.quantize_vibrato();
+  uint8_t mod1_vibrato_depth = s.mod1_vibrato_depth; // 0 to 127
+  uint8_t mod2_vibrato_depth = s.mod2_vibrato_depth; // 0 to 127
+  bool mod1_mod2_vibrato_depth = s.mod1_mod2_vibrato_depth;
+  bool quantize_vibrato = s.quantize_vibrato;
   int32_t pitch_delta1 = 0 ;
   int32_t pitch_delta2 = 0 ;
 
@@ -716,16 +733,16 @@ void RenderBlock() {
 	  }        
   }
   
-  if (settings.pitch_quantization() == PITCH_QUANTIZATION_QUARTER_TONE) {
+  if (s.pitch_quantization == PITCH_QUANTIZATION_QUARTER_TONE) {
      pitch = (pitch + 32) & 0xffffffc0;
-  } else if (settings.pitch_quantization() == PITCH_QUANTIZATION_SEMITONE) {
+  } else if (s.pitch_quantization == PITCH_QUANTIZATION_SEMITONE) {
      pitch = (pitch + 64) & 0xffffff80;
-  } else if (settings.pitch_quantization() > PITCH_QUANTIZATION_SEMITONE) {
+  } else if (s.pitch_quantization > PITCH_QUANTIZATION_SEMITONE) {
      pitch = (pitch + 64) & 0xffffff80;
      uint8_t pitch_semitones = pitch >> 7;
      uint8_t pitch_whole_octaves = pitch_semitones / 12 ;
      uint8_t pitch_remainder_semitones = pitch_semitones - (pitch_whole_octaves * 12);
-     pitch = ((pitch_whole_octaves * 12) + quant_scales[((settings.pitch_quantization() - 3) * 12) + pitch_remainder_semitones]) << 7;
+     pitch = ((pitch_whole_octaves * 12) + quant_scales[((s.pitch_quantization - 3) * 12) + pitch_remainder_semitones]) << 7;
   }
 
   // add FM
@@ -757,7 +774,7 @@ void RenderBlock() {
   
   // Check if the pitch has changed to cause an auto-retrigger
   int32_t pitch_delta = pitch - previous_pitch;
-  if (settings.data().auto_trig &&
+  if (s.auto_trig &&
       (pitch_delta >= 0x40 || -pitch_delta >= 0x40)) {
     trigger_detected_flag = true;
   }
@@ -780,7 +797,7 @@ void RenderBlock() {
 
   // jitter depth now settable and voltage controllable.
   // TO-DO jitter still causes pitch to sharpen slightly - why?
-  int32_t vco_drift = settings.vco_drift();
+  int32_t vco_drift = s.vco_drift;
   if (meta_mod == 13 || meta_mod == 17) {
      vco_drift += settings.adc_to_fm(adc.channel(3)) >> 6;
   } 
@@ -799,7 +816,7 @@ void RenderBlock() {
   }
 
   // add software fine tune
-  pitch += settings.fine_tune();
+  pitch += s.fine_tune;
   
   // clip the pitch to prevent bad things from happening.
   if (pitch > 32767) {
@@ -808,25 +825,25 @@ void RenderBlock() {
     pitch = 0;
   }
   
-  osc.set_pitch(pitch + settings.pitch_transposition());
+  osc.set_pitch(pitch + s.pitch_transposition);
 
   if (trigger_flag) {
-    if (!(!settings.osc_sync() && settings.shape() == MACRO_OSC_SHAPE_WAVE_PARAPHONIC)) {
+    if (!(!s.osc_sync && s.shape == MACRO_OSC_SHAPE_WAVE_PARAPHONIC)) {
        osc.Strike();
     }
     // reset internal modulator phase if mod1_sync or mod2_sync > 0
     // and if a trigger counter for each = the setting of mod1_sync
     // or mod2_sync (defaults to 1 thus every trigger).
-    if (settings.GetValue(SETTING_MOD1_SYNC)) {
+    if (s.mod1_sync) {
        ++mod1_sync_index;
-       if (mod1_sync_index >= settings.GetValue(SETTING_MOD1_SYNC)) {
+       if (mod1_sync_index >= s.mod1_sync) {
           envelope.Trigger(ENV_SEGMENT_ATTACK);
           mod1_sync_index = 0 ;
        }
     }
-    if (settings.GetValue(SETTING_MOD2_SYNC)) {
+    if (s.mod2_sync) {
        ++mod2_sync_index;
-       if (mod2_sync_index >= settings.GetValue(SETTING_MOD2_SYNC)) {
+       if (mod2_sync_index >= s.mod2_sync) {
           envelope2.Trigger(ENV_SEGMENT_ATTACK);
           mod2_sync_index = 0 ;
        }
@@ -837,7 +854,7 @@ void RenderBlock() {
 
   uint8_t* sync_buffer = sync_samples[render_block];
   int16_t* render_buffer = audio_samples[render_block];
-  if (!settings.osc_sync()) {
+  if (!s.osc_sync) {
     // Disable hardsync when oscillator sync disabled.
     memset(sync_buffer, 0, kBlockSize);
    }
@@ -845,9 +862,9 @@ void RenderBlock() {
   osc.Render(sync_buffer, render_buffer, kBlockSize);
 
   // gain is a weighted sum of the envelope/LFO levels  
-  uint32_t mod1_level_depth = uint32_t(settings.mod1_level_depth());
-  uint32_t mod2_level_depth = uint32_t(settings.mod2_level_depth());
-  int32_t gain = settings.initial_gain(); 
+  uint32_t mod1_level_depth = uint32_t(s.mod1_level_depth);
+  uint32_t mod2_level_depth = uint32_t(s.mod2_level_depth);
+  int32_t gain = s.initial_gain; 
   // add external CV if FMCV used for level
   if (meta_mod == 8) {
      gain += settings.adc_to_fm(adc.channel(3)) << 4; // was 3 
@@ -867,21 +884,21 @@ void RenderBlock() {
      gain += (ad2_value * mod2_level_depth) >> 8;
   }
   // scale the gain by the meta-sequencer parameter if applicable
-  if (metaseq_length && (settings.GetValue(SETTING_METASEQ_PARAMETER_DEST) & 4)) {
+  if (metaseq_length && (s.metaseq_parameter_dest & 4)) {
      gain = (gain * metaseq_parameter) >> 7;
   }
   // clip the gain  
   gain = ParamClip(gain, static_cast<int32_t>(0), static_cast<int32_t>(65535));
 
   // Voltage control of bit crushing
-  uint8_t bits_value = settings.resolution();
+  uint8_t bits_value = s.resolution;
   if (meta_mod == 14 || meta_mod == 16 || meta_mod == 17) {
      bits_value -= settings.adc_to_fm(adc.channel(3)) >> 9;
      bits_value = ParamClip(bits_value, static_cast<uint8_t>(0), static_cast<uint8_t>(6));
   }
 
   // Voltage control of sample rate decimation
-  uint8_t sample_rate_value = settings.data().sample_rate;
+  uint8_t sample_rate_value = s.sample_rate;
   if (meta_mod == 15 || meta_mod == 16 || meta_mod == 17) {
      sample_rate_value -= settings.adc_to_fm(adc.channel(3)) >> 9;
      sample_rate_value = ParamClip(sample_rate_value, static_cast<uint8_t>(0), static_cast<uint8_t>(6));
@@ -898,6 +915,12 @@ void RenderBlock() {
     render_buffer[i] = static_cast<int32_t>(sample) * gain >> 16;
   }
   render_block = (render_block + 1) % kNumBlocks;
+#ifdef PROFILE_RENDER_BLOCK
+  render_block_cycles = cycle_counter.Read() - start_cycle;
+  if (render_block_cycles > render_block_max_cycles) {
+    render_block_max_cycles = render_block_cycles;
+  }
+#endif  // PROFILE_RENDER_BLOCK
   // debug_pin.Low();
 }
 
@@ -0,0 +1,324 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bytecode interpreter for bytebeat formulas, evaluated a block at a time,
+// for the formulas loaded at run time in the bytebeat models of braids and in
+// the peaks bytebeats processor. Both only compile it with BRAIDS_BYTEBEAT_VM
+// or PEAKS_BYTEBEAT_VM: the firmwares have no way to load a program yet. The
+// built-in formulas are compiled: the VM is 5 to 10 times slower than native
+// code.
+//
+// A program is a formula in postfix order, of at most kMaxBytebeatProgramSize
+// bytes, terminated by BYTEBEAT_OP_END or by its size. Operands push the time
+// t, one of the parameters p0, p1, p2 (16-bit), or an 8-bit or 16-bit (little
+// endian) constant following the opcode. Operators pop their operands and push
+// their result. All values are 32-bit unsigned. As on the Cortex-M3, dividing
+// by zero gives 0 (so t % 0 == t), and shifting by 32 or more gives 0. The
+// sample is the low byte of the result.
+//
+// For example, (t * p0 & t >> 8) with p0 = P0 >> 12 is:
+//   T P0 CONST8 12 SHR MUL T CONST8 8 SHR AND
+//
+// Each stack entry is either a constant or a block of values. The parameters
+// are constant during a block, so the terms that do not depend on t (here,
+// P0 >> 12) are computed once per block, and only the others for every
+// sample. Each opcode is decoded once per block rather than once per sample.
+
+#ifndef BRAIDS_BYTEBEAT_VM_H_
+#define BRAIDS_BYTEBEAT_VM_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace braids {
+
+enum BytebeatOpcode {
+  BYTEBEAT_OP_END,
+  BYTEBEAT_OP_T,
+  BYTEBEAT_OP_P0,
+  BYTEBEAT_OP_P1,
+  BYTEBEAT_OP_P2,
+  BYTEBEAT_OP_CONST8,
+  BYTEBEAT_OP_CONST16,
+  BYTEBEAT_OP_NOT,
+  BYTEBEAT_OP_ADD,
+  BYTEBEAT_OP_SUB,
+  BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_DIV,
+  BYTEBEAT_OP_MOD,
+  BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_XOR,
+  BYTEBEAT_OP_SHL,
+  BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_LAST
+};
+
+const size_t kMaxBytebeatProgramSize = 64;
+const size_t kMaxBytebeatStackDepth = 8;
+// Longer blocks are evaluated in several passes. The stack of a pass holds
+// kMaxBytebeatStackDepth blocks of values: 256 bytes for 8 values, against
+// 768 bytes for a whole 24-sample block, for a VM about 30% slower.
+const size_t kMaxBytebeatBlockSize = 8;
+// Bounds the time taken by a program, so that any program accepted by Load()
+// fits in the render time of a braids block. The cost is the number of
+// operations evaluated for every sample, that is to say on values which
+// depend on t. A division or a modulo is slower on the Cortex-M3.
+const size_t kMaxBytebeatSampleCost = 40;
+const size_t kBytebeatDivisionCost = 3;
+
+class BytebeatVm {
+ public:
+  BytebeatVm() : program_(NULL), size_(0) { }
+  ~BytebeatVm() { }
+
+  // Checks and selects a program. It is not copied, so that the built-in
+  // programs can stay in flash: a program received at run time must stay in
+  // memory while it is used. Returns false, and keeps the current program,
+  // if it is too long, contains an unknown opcode or a truncated constant,
+  // uses more than kMaxBytebeatStackDepth entries, pops an empty stack, does
+  // not leave exactly one value on the stack, or costs more than
+  // kMaxBytebeatSampleCost per sample.
+  bool Load(const uint8_t* program, size_t size) {
+    bool depends_on_t[kMaxBytebeatStackDepth];
+    size_t depth = 0;
+    size_t cost = 0;
+    size_t i = 0;
+    while (i < size && program[i] != BYTEBEAT_OP_END) {
+      uint8_t opcode = program[i++];
+      if (opcode >= BYTEBEAT_OP_LAST) {
+        return false;
+      } else if (opcode <= BYTEBEAT_OP_CONST16) {
+        if (opcode == BYTEBEAT_OP_CONST8) {
+          i += 1;
+        } else if (opcode == BYTEBEAT_OP_CONST16) {
+          i += 2;
+        }
+        if (i > size || depth >= kMaxBytebeatStackDepth) {
+          return false;
+        }
+        depends_on_t[depth++] = opcode == BYTEBEAT_OP_T;
+      } else if (opcode == BYTEBEAT_OP_NOT) {
+        if (depth < 1) {
+          return false;
+        }
+        cost += depends_on_t[depth - 1] ? 1 : 0;
+      } else {
+        if (depth < 2) {
+          return false;
+        }
+        --depth;
+        if (depends_on_t[depth - 1] || depends_on_t[depth]) {
+          bool division = opcode == BYTEBEAT_OP_DIV ||
+              opcode == BYTEBEAT_OP_MOD;
+          cost += division ? kBytebeatDivisionCost : 1;
+          depends_on_t[depth - 1] = true;
+        }
+      }
+    }
+    if (depth != 1 || i > kMaxBytebeatProgramSize ||
+        cost > kMaxBytebeatSampleCost) {
+      return false;
+    }
+    program_ = program;
+    size_ = i;
+    return true;
+  }
+
+  inline void Unload() {
+    program_ = NULL;
+    size_ = 0;
+  }
+
+  inline bool loaded() const { return program_ != NULL; }
+  inline const uint8_t* program() const { return program_; }
+  inline size_t size() const { return size_; }
+
+  // Writes to out the result of the formula for each of the size values of t.
+  void Evaluate(
+      const uint32_t* t,
+      uint32_t p0,
+      uint32_t p1,
+      uint32_t p2,
+      uint32_t* out,
+      size_t size) const {
+    if (!size_) {
+      std::fill(&out[0], &out[size], 0);
+      return;
+    }
+    while (size) {
+      size_t block_size = std::min(size, kMaxBytebeatBlockSize);
+      EvaluateBlock(t, p0, p1, p2, out, block_size);
+      t += block_size;
+      out += block_size;
+      size -= block_size;
+    }
+  }
+
+ private:
+  struct Constant {
+    Constant(uint32_t value) : value_(value) { }
+    inline uint32_t operator[](size_t i) const { return value_; }
+    uint32_t value_;
+  };
+
+  struct Block {
+    Block(const uint32_t* values) : values_(values) { }
+    inline uint32_t operator[](size_t i) const { return values_[i]; }
+    const uint32_t* values_;
+  };
+
+  static inline uint32_t Apply(uint8_t opcode, uint32_t x, uint32_t y) {
+    uint32_t z = 0;
+    ApplyBlock(opcode, &x, Constant(y), &z, 1);
+    return z;
+  }
+
+  template<typename Operand>
+  static inline void ApplyBlock(
+      uint8_t opcode,
+      const uint32_t* x,
+      Operand y,
+      uint32_t* out,
+      size_t size) {
+    switch (opcode) {
+      case BYTEBEAT_OP_ADD:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] + y[i];
+        break;
+      case BYTEBEAT_OP_SUB:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] - y[i];
+        break;
+      case BYTEBEAT_OP_MUL:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] * y[i];
+        break;
+      case BYTEBEAT_OP_DIV:
+        for (size_t i = 0; i < size; ++i) out[i] = y[i] ? x[i] / y[i] : 0;
+        break;
+      case BYTEBEAT_OP_MOD:
+        for (size_t i = 0; i < size; ++i) out[i] = y[i] ? x[i] % y[i] : x[i];
+        break;
+      case BYTEBEAT_OP_AND:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] & y[i];
+        break;
+      case BYTEBEAT_OP_OR:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] | y[i];
+        break;
+      case BYTEBEAT_OP_XOR:
+        for (size_t i = 0; i < size; ++i) out[i] = x[i] ^ y[i];
+        break;
+      case BYTEBEAT_OP_SHL:
+        for (size_t i = 0; i < size; ++i) {
+          out[i] = y[i] < 32 ? x[i] << y[i] : 0;
+        }
+        break;
+      case BYTEBEAT_OP_SHR:
+        for (size_t i = 0; i < size; ++i) {
+          out[i] = y[i] < 32 ? x[i] >> y[i] : 0;
+        }
+        break;
+    }
+  }
+
+  void EvaluateBlock(
+      const uint32_t* t,
+      uint32_t p0,
+      uint32_t p1,
+      uint32_t p2,
+      uint32_t* out,
+      size_t size) const {
+    uint32_t storage[kMaxBytebeatStackDepth][kMaxBytebeatBlockSize];
+    // A NULL block is a constant.
+    const uint32_t* block[kMaxBytebeatStackDepth];
+    uint32_t constant[kMaxBytebeatStackDepth];
+    size_t top = 0;
+
+    const uint8_t* pc = program_;
+    const uint8_t* end = program_ + size_;
+    while (pc < end) {
+      uint8_t opcode = *pc++;
+      if (opcode == BYTEBEAT_OP_T) {
+        block[top++] = t;
+      } else if (opcode <= BYTEBEAT_OP_CONST16) {
+        uint32_t value = 0;
+        switch (opcode) {
+          case BYTEBEAT_OP_P0: value = p0; break;
+          case BYTEBEAT_OP_P1: value = p1; break;
+          case BYTEBEAT_OP_P2: value = p2; break;
+          case BYTEBEAT_OP_CONST8: value = *pc++; break;
+          case BYTEBEAT_OP_CONST16:
+            value = pc[0] | (pc[1] << 8);
+            pc += 2;
+            break;
+        }
+        block[top] = NULL;
+        constant[top++] = value;
+      } else if (opcode == BYTEBEAT_OP_NOT) {
+        size_t x = top - 1;
+        if (block[x]) {
+          uint32_t* result = storage[x];
+          for (size_t i = 0; i < size; ++i) result[i] = ~block[x][i];
+          block[x] = result;
+        } else {
+          constant[x] = ~constant[x];
+        }
+      } else {
+        size_t y = --top;
+        size_t x = y - 1;
+        if (!block[x] && !block[y]) {
+          constant[x] = Apply(opcode, constant[x], constant[y]);
+          continue;
+        }
+        uint32_t* result = storage[x];
+        if (!block[x]) {
+          std::fill(&result[0], &result[size], constant[x]);
+          block[x] = result;
+        }
+        if (block[y]) {
+          ApplyBlock(opcode, block[x], Block(block[y]), result, size);
+        } else {
+          ApplyBlock(opcode, block[x], Constant(constant[y]), result, size);
+        }
+        block[x] = result;
+      }
+    }
+    if (block[0]) {
+      std::copy(&block[0][0], &block[0][size], &out[0]);
+    } else {
+      std::fill(&out[0], &out[size], constant[0]);
+    }
+  }
+
+  const uint8_t* program_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(BytebeatVm);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_BYTEBEAT_VM_H_
@@ -0,0 +1,172 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Decimation by 2 or 4 of an oversampled signal, with polyphase halfband FIR
+// filters.
+//
+// Every other coefficient of a halfband filter is zero, so one of the two
+// polyphase branches is a pure delay (the center tap), and the other one is
+// symmetric: each output sample costs one multiply per pair of non-zero outer
+// taps, plus one for the center tap. Decimation by 4 is done with two stages,
+// the first one (at 4x, with a wide transition band) using a short filter.
+
+#ifndef BRAIDS_DECIMATOR_H_
+#define BRAIDS_DECIMATOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+namespace braids {
+
+enum OversamplingRatio {
+  OVERSAMPLING_1X,
+  OVERSAMPLING_2X,
+  OVERSAMPLING_4X
+};
+
+enum OversamplingFilter {
+  // 11 taps, 4 multiplies per output sample. -24dB from 0.6 x Nyquist.
+  OVERSAMPLING_FILTER_FAST,
+  // 31 taps, 9 multiplies per output sample. -52dB from 0.6 x Nyquist.
+  OVERSAMPLING_FILTER_HIGH_QUALITY,
+
+  OVERSAMPLING_FILTER_LAST
+};
+
+// Q15, center tap first, then the odd outer taps going away from the center.
+// Kaiser-windowed sinc, rounded so that the DC gain is exactly 1.
+static const int16_t kHalfbandFirstStage[] = {
+  16536, 9641, -1525
+};
+
+static const int16_t kHalfbandFast[] = {
+  15630, 10245, -2943, 1267
+};
+
+static const int16_t kHalfbandHighQuality[] = {
+  16396, 10339, -3210, 1665, -947, 532, -278, 125, -40
+};
+
+// A halfband decimator keeping the last history_size (a power of 2) samples
+// of the oversampled signal. The filter length is a template parameter of
+// Process(), which lets the compiler unroll the inner loop, so that filters
+// of different lengths can share the same history.
+template<size_t history_size>
+class HalfbandDecimator {
+ public:
+  HalfbandDecimator() { }
+  ~HalfbandDecimator() { }
+
+  void Init() {
+    head_ = 0;
+    std::fill(&history_[0], &history_[history_size], 0);
+  }
+
+  // Filters with num_taps non-zero outer taps on each side, which requires
+  // 4 * num_taps <= history_size. Reads 2 * size samples from in, writes size
+  // samples to out. out can be the same buffer as in.
+  template<size_t num_taps>
+  inline void Process(
+      const int16_t* coefficients,
+      const int16_t* in,
+      int16_t* out,
+      size_t size) {
+    const size_t kMask = history_size - 1;
+    // The center tap is 2 * num_taps - 1 samples behind the newest one.
+    const size_t kCenterDelay = 2 * num_taps - 1;
+    size_t head = head_;
+    while (size--) {
+      history_[head = (head + 1) & kMask] = *in++;
+      history_[head = (head + 1) & kMask] = *in++;
+      size_t center = head - kCenterDelay;
+      int32_t sum = coefficients[0] * history_[center & kMask];
+      for (size_t i = 0; i < num_taps; ++i) {
+        int32_t pair = history_[(center + 2 * i + 1) & kMask] +
+            history_[(center - 2 * i - 1) & kMask];
+        sum += coefficients[i + 1] * pair;
+      }
+      sum >>= 15;
+      CLIP(sum)
+      *out++ = sum;
+    }
+    head_ = head;
+  }
+
+ private:
+  size_t head_;
+  int16_t history_[history_size];
+
+  DISALLOW_COPY_AND_ASSIGN(HalfbandDecimator);
+};
+
+class Decimator {
+ public:
+  Decimator() : filter_(OVERSAMPLING_FILTER_FAST) { }
+  ~Decimator() { }
+
+  // Clears the history. The filter is left unchanged.
+  void Init() {
+    first_stage_.Init();
+    last_stage_.Init();
+  }
+
+  inline void set_filter(OversamplingFilter filter) {
+    filter_ = filter;
+  }
+
+  inline OversamplingFilter filter() const { return filter_; }
+
+  // Reads size << ratio samples from in, writes size samples to out. The
+  // input buffer is used as scratch space.
+  inline void Process(
+      OversamplingRatio ratio,
+      int16_t* in,
+      int16_t* out,
+      size_t size) {
+    if (ratio == OVERSAMPLING_4X) {
+      first_stage_.Process<2>(kHalfbandFirstStage, in, in, size << 1);
+    }
+    // The fast and high quality filters are never used at the same time,
+    // and share the history of the last stage.
+    if (filter_ == OVERSAMPLING_FILTER_HIGH_QUALITY) {
+      last_stage_.Process<8>(kHalfbandHighQuality, in, out, size);
+    } else {
+      last_stage_.Process<3>(kHalfbandFast, in, out, size);
+    }
+  }
+
+ private:
+  HalfbandDecimator<8> first_stage_;
+  HalfbandDecimator<32> last_stage_;
+  OversamplingFilter filter_;
+
+  DISALLOW_COPY_AND_ASSIGN(Decimator);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_DECIMATOR_H_
@@ -117,6 +117,21 @@ void DigitalOscillator::Render(
     previous_shape_ = shape_;
     init_ = true;
   }
+
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  if (!UpdateDelayLines()) {
+    std::fill(&buffer[0], &buffer[size], 0);
+    return;
+  }
+#endif  // BRAIDS_SHARED_DELAY_LINES
+  
+#ifdef BRAIDS_OVERSAMPLING
+  OversamplingRatio ratio = oversampling();
+  if (ratio != OVERSAMPLING_1X) {
+    RenderOversampled(fn, ratio, sync, buffer, size);
+    return;
+  }
+#endif  // BRAIDS_OVERSAMPLING
   
   phase_increment_ = ComputePhaseIncrement(pitch_);
   delay_ = ComputeDelay(pitch_);
@@ -130,6 +145,93 @@ void DigitalOscillator::Render(
   (this->*fn)(sync, buffer, size);
 }
 
+#ifdef BRAIDS_SHARED_DELAY_LINES
+
+bool DigitalOscillator::uses_delay_lines() const {
+  // Compare the render functions rather than the shapes, as fn_table_ is not
+  // in the order of DigitalOscillatorShape.
+  RenderFn fn = fn_table_[shape_];
+  return fn == &DigitalOscillator::RenderComb ||
+      fn == &DigitalOscillator::RenderPlucked ||
+      fn == &DigitalOscillator::RenderBowed ||
+      fn == &DigitalOscillator::RenderBlown ||
+      fn == &DigitalOscillator::RenderFluted;
+}
+
+// Returns false when the shape needs delay lines and none are available.
+bool DigitalOscillator::UpdateDelayLines() {
+  if (!uses_delay_lines()) {
+    ReleaseDelayLines();
+    return true;
+  }
+  if (!delay_lines_ && delay_line_pool_) {
+    delay_lines_ = delay_line_pool_->Allocate();
+    if (delay_lines_) {
+      // Do not play what another voice left in there.
+      memset(delay_lines_, 0, sizeof(DelayLines));
+      init_ = true;
+      strike_ = true;
+    }
+  }
+  return delay_lines_ != NULL;
+}
+
+#endif  // BRAIDS_SHARED_DELAY_LINES
+
+#ifdef BRAIDS_OVERSAMPLING
+
+void DigitalOscillator::RenderOversampled(
+    RenderFn fn,
+    OversamplingRatio ratio,
+    const uint8_t* sync,
+    int16_t* buffer,
+    uint8_t size) {
+  // The shape is rendered as if it were one or two octaves lower, which
+  // gives the right pitch at 2x or 4x the sample rate, for the phase
+  // increments as well as for the filters tracking pitch_. The pitch is
+  // clamped first, as in the 1x path.
+  int16_t pitch = pitch_;
+  if (pitch > kHighestNote) {
+    pitch = kHighestNote;
+  } else if (pitch < 0) {
+    pitch = 0;
+  }
+  pitch_ = pitch - kOctave * ratio;
+  phase_increment_ = ComputePhaseIncrement(pitch_);
+  delay_ = ComputeDelay(pitch_);
+  if (pitch_ < 0) {
+    pitch_ = 0;
+  }
+  
+  // On the stack rather than in the object: only the oscillators which are
+  // oversampled need them, and only during this call.
+  int16_t oversampling_buffer[kOversamplingBlockSize];
+  uint8_t oversampling_sync[kOversamplingBlockSize];
+  uint8_t chunk_size = kOversamplingBlockSize >> ratio;
+  while (size) {
+    if (chunk_size > size) {
+      chunk_size = size;
+    }
+    uint8_t oversampled_size = chunk_size << ratio;
+    // Sync pulses fall on the first oversampled sample.
+    std::fill(
+        &oversampling_sync[0],
+        &oversampling_sync[oversampled_size],
+        0);
+    for (uint8_t i = 0; i < chunk_size; ++i) {
+      oversampling_sync[i << ratio] = sync[i];
+    }
+    (this->*fn)(oversampling_sync, oversampling_buffer, oversampled_size);
+    decimator_.Process(ratio, oversampling_buffer, buffer, chunk_size);
+    sync += chunk_size;
+    buffer += chunk_size;
+    size -= chunk_size;
+  }
+  pitch_ = pitch;
+}
+
+#endif  // BRAIDS_OVERSAMPLING
+
 void DigitalOscillator::RenderTripleRingMod(
     const uint8_t* sync,
     int16_t* buffer,
@@ -255,7 +357,7 @@ void DigitalOscillator::RenderComb(
   filtered_pitch = (15 * filtered_pitch + pitch) >> 4;
   state_.ffm.previous_sample = filtered_pitch;
   
-  int16_t* dl = delay_lines_.comb;
+  int16_t* dl = delay_lines_->comb;
   uint32_t delay = ComputeDelay(filtered_pitch);
   if (delay > (kCombDelayLength << 16)) {
     delay = kCombDelayLength << 16;
@@ -1072,7 +1174,7 @@ void DigitalOscillator::RenderPlucked(
     int32_t sample = 0;
     for (uint8_t i = 0; i < kNumPluckVoices; ++i) {
       PluckState* p = &state_.plk[i];
-      int16_t* dl = delay_lines_.ks + i * 1025;
+      int16_t* dl = delay_lines_->ks + i * 1025;
       // Initialization: Just use a white noise sample and fill the delay
       // line.
       if (p->initialization_ptr) {
@@ -1128,12 +1230,12 @@ void DigitalOscillator::RenderBowed(
     const uint8_t* sync,
     int16_t* buffer,
     uint8_t size) {
-  int8_t* dl_b = delay_lines_.bowed.bridge;
-  int8_t* dl_n = delay_lines_.bowed.neck;
+  int8_t* dl_b = delay_lines_->bowed.bridge;
+  int8_t* dl_n = delay_lines_->bowed.neck;
   
   if (strike_) {
-    memset(dl_b, 0, sizeof(delay_lines_.bowed.bridge));
-    memset(dl_n, 0, sizeof(delay_lines_.bowed.neck));
+    memset(dl_b, 0, sizeof(delay_lines_->bowed.bridge));
+    memset(dl_n, 0, sizeof(delay_lines_->bowed.neck));
     memset(&state_, 0, sizeof(state_));
     strike_ = false;
   }
@@ -1238,9 +1340,9 @@ void DigitalOscillator::RenderBlown(
   uint16_t delay_ptr = state_.phy.delay_ptr;
   int32_t lp_state = state_.phy.lp_state;
   
-  int16_t* dl = delay_lines_.bore;
+  int16_t* dl = delay_lines_->bore;
   if (strike_) {
-    memset(dl, 0, sizeof(delay_lines_.bore));
+    memset(dl, 0, sizeof(delay_lines_->bore));
     strike_ = false;
   }
 
@@ -1306,13 +1408,13 @@ void DigitalOscillator::RenderFluted(
   int32_t dc_blocking_x0 = state_.phy.filter_state[0];
   int32_t dc_blocking_y0 = state_.phy.filter_state[1];
 
-  int8_t* dl_b = delay_lines_.fluted.bore;
-  int8_t* dl_j = delay_lines_.fluted.jet;
+  int8_t* dl_b = delay_lines_->fluted.bore;
+  int8_t* dl_j = delay_lines_->fluted.jet;
   
   if (strike_) {
     excitation_ptr = 0;
-    memset(dl_b, 0, sizeof(delay_lines_.fluted.bore));
-    memset(dl_j, 0, sizeof(delay_lines_.fluted.jet));
+    memset(dl_b, 0, sizeof(delay_lines_->fluted.bore));
+    memset(dl_j, 0, sizeof(delay_lines_->fluted.jet));
     lp_state = 0;
     strike_ = false;
   }
@@ -2274,35 +2376,29 @@ void DigitalOscillator::RenderCymbal(
   svf_[0].set_frequency(parameter_[0] >> 1);
   svf_[1].set_frequency(parameter_[0] >> 1);
   
-  while (size--) {
-    phase_ += increments[6];
-    if (phase_ < increments[6]) {
-      hat->rng_state = hat->rng_state * 1664525L + 1013904223L;
+  uint8_t metallic_noise[kMetallicNoiseBlockSize];
+  while (size) {
+    uint8_t n = std::min(static_cast<size_t>(size), kMetallicNoiseBlockSize);
+    hat->metallic_noise.Render(increments, metallic_noise, n);
+    for (uint8_t i = 0; i < n; ++i) {
+      phase_ += increments[6];
+      if (phase_ < increments[6]) {
+        hat->rng_state = hat->rng_state * 1664525L + 1013904223L;
+      }
+
+      int32_t hat_noise = metallic_noise[i];
+      hat_noise -= 3;
+      hat_noise *= 5461;
+      hat_noise = svf_[0].Process(hat_noise);
+      CLIP(hat_noise)
+
+      int32_t noise = (hat->rng_state >> 16) - 32768;
+      noise = svf_[1].Process(noise >> 1);
+      CLIP(noise)
+
+      *buffer++ = hat_noise + ((noise - hat_noise) * xfade >> 15);
     }
-    hat->phase[0] += increments[0];
-    hat->phase[1] += increments[1];
-    hat->phase[2] += increments[2];
-    hat->phase[3] += increments[3];
-    hat->phase[4] += increments[4];
-    hat->phase[5] += increments[5];
-    
-    int32_t hat_noise = 0;
-    hat_noise += hat->phase[0] >> 31;
-    hat_noise += hat->phase[1] >> 31;
-    hat_noise += hat->phase[2] >> 31;
-    hat_noise += hat->phase[3] >> 31;
-    hat_noise += hat->phase[4] >> 31;
-    hat_noise += hat->phase[5] >> 31;
-    hat_noise -= 3;
-    hat_noise *= 5461;
-    hat_noise = svf_[0].Process(hat_noise);
-    CLIP(hat_noise)
-    
-    int32_t noise = (hat->rng_state >> 16) - 32768;
-    noise = svf_[1].Process(noise >> 1);
-    CLIP(noise)
-    
-    *buffer++ = hat_noise + ((noise - hat_noise) * xfade >> 15);
+    size -= n;
   }
 }
 
@@ -2315,16 +2411,48 @@ void DigitalOscillator::RenderSilence(
   }
 }
 
+#ifdef BRAIDS_BYTEBEAT_VM
+// Formulas loaded at run time, see set_bytebeat_program(). The built-in ones
+// below are faster as native code than in the VM.
+void DigitalOscillator::RenderBytebeatProgram(
+    const BytebeatVm& program,
+    int16_t* buffer,
+    uint8_t size) {
+  uint32_t t[kMaxBytebeatBlockSize];
+  uint32_t value[kMaxBytebeatBlockSize];
+  uint16_t bytepitch = (16384 - pitch_) >> 11 ; // was 12
+  while (size) {
+    uint8_t n = std::min(static_cast<size_t>(size), kMaxBytebeatBlockSize);
+    for (uint8_t i = 0; i < n; ++i) {
+      ++phase_;
+      if (bytepitch && phase_ % bytepitch == 0) ++t_;
+      t[i] = t_;
+    }
+    program.Evaluate(t, parameter_[0], parameter_[1], 0, value, n);
+    for (uint8_t i = 0; i < n; ++i) {
+      *buffer++ = (value[i] & 0xff) << 8;
+    }
+    size -= n;
+  }
+}
+#endif  // BRAIDS_BYTEBEAT_VM
+
 void DigitalOscillator::RenderBytebeat0(
     const uint8_t* sync,
     int16_t* buffer,
     uint8_t size) {
+#ifdef BRAIDS_BYTEBEAT_VM
+  if (bytebeat_[0].loaded()) {
+    RenderBytebeatProgram(bytebeat_[0], buffer, size);
+    return;
+  }
+#endif  // BRAIDS_BYTEBEAT_VM
     uint32_t p0 = parameter_[0] >> 9;
     uint32_t p1 = parameter_[1] >> 11;
     uint16_t bytepitch = (16384 - pitch_) >> 11 ; // was 12
   while (size--) {
     ++phase_;
-    if (phase_ % bytepitch == 0) ++t_; 
+    if (bytepitch && phase_ % bytepitch == 0) ++t_; 
     // from http://royal-paw.com/2012/01/bytebeats-in-c-and-python-generative-symphonies-from-extremely-small-programs/
     // (atmospheric, hopeful)
     int32_t sample = ( ( ((t_*3) & (t_>>10)) | ((t_*p0) & (t_>>10)) | ((t_*10) & ((t_>>8)*p1) & 128) ) & 0xFF) << 8;
@@ -2337,12 +2465,18 @@ void DigitalOscillator::RenderBytebeat1(
     const uint8_t* sync,
     int16_t* buffer,
     uint8_t size) {
+#ifdef BRAIDS_BYTEBEAT_VM
+  if (bytebeat_[1].loaded()) {
+    RenderBytebeatProgram(bytebeat_[1], buffer, size);
+    return;
+  }
+#endif  // BRAIDS_BYTEBEAT_VM
     uint32_t p0 = parameter_[0] >> 11;
     uint32_t p1 = parameter_[1] >> 11;
     uint16_t bytepitch = (16384 - pitch_) >> 11 ; // was 12
   while (size--) {
     ++phase_;
-    if (phase_ % bytepitch == 0) ++t_; 
+    if (bytepitch && phase_ % bytepitch == 0) ++t_; 
     // equation by stephth via https://www.youtube.com/watch?v=tCRPUv8V22o at 3:38
     int32_t sample = ((((t_*p0) & (t_>>4)) | ((t_*5) &
                       (t_>>7)) | ((t_*p1) & (t_>>10)))
@@ -2355,12 +2489,18 @@ void DigitalOscillator::RenderBytebeat2(
     const uint8_t* sync,
     int16_t* buffer,
     uint8_t size) {
+#ifdef BRAIDS_BYTEBEAT_VM
+  if (bytebeat_[2].loaded()) {
+    RenderBytebeatProgram(bytebeat_[2], buffer, size);
+    return;
+  }
+#endif  // BRAIDS_BYTEBEAT_VM
     uint32_t p0 = parameter_[0] >> 11;
     uint32_t p1 = parameter_[1] >> 11;
     uint16_t bytepitch = (16384 - pitch_) >> 11 ; // was 12
   while (size--) {
     ++phase_;
-    if (phase_ %  bytepitch == 0) ++t_; 
+    if (bytepitch && phase_ % bytepitch == 0) ++t_; 
     // This one is from http://www.reddit.com/r/bytebeat/comments/20km9l/cool_equations/ (t>>13&t)*(t>>8)
     int32_t sample = ( (((t_ >> p0) & t_) * (t_ >> p1)) & 0xFF) << 8 ;
     *buffer++ = sample;
@@ -2371,14 +2511,20 @@ void DigitalOscillator::RenderBytebeat3(
     const uint8_t* sync,
     int16_t* buffer,
     uint8_t size) {
+#ifdef BRAIDS_BYTEBEAT_VM
+  if (bytebeat_[3].loaded()) {
+    RenderBytebeatProgram(bytebeat_[3], buffer, size);
+    return;
+  }
+#endif  // BRAIDS_BYTEBEAT_VM
     uint32_t p0 = parameter_[0] >> 11;
     uint32_t p1 = parameter_[1] >> 8;
     uint16_t bytepitch = (16384 - pitch_) >> 11 ; // was 12
   while (size--) {
     ++phase_;
-    if (phase_ %  bytepitch == 0) ++t_; 
+    if (bytepitch && phase_ % bytepitch == 0) ++t_; 
     // This one is the second one listed at from http://xifeng.weebly.com/bytebeats.html
-    int32_t sample = ((( (((((t_ >> p0) | t_) | (t_ >> p0)) * 10) & ((5 * t_) | (t_ >> 10)) ) | (t_ ^ (t_ % p1)) ) & 0xFF)) << 8 ;
+    int32_t sample = ((( (((((t_ >> p0) | t_) | (t_ >> p0)) * 10) & ((5 * t_) | (t_ >> 10)) ) | (t_ ^ (p1 ? t_ % p1 : t_)) ) & 0xFF)) << 8 ;
     *buffer++ = sample;
   }
 }
@@ -2424,4 +2570,70 @@ DigitalOscillator::RenderFn DigitalOscillator::fn_table_[] = {
   &DigitalOscillator::RenderSilence,
 };
 
+#ifdef BRAIDS_OVERSAMPLING
+
+// Highest oversampling ratio for each shape, in the order of fn_table_. Only
+// the shapes whose timing entirely derives from pitch_ can be oversampled:
+// envelopes, delay lines and formants tuned in samples or from the
+// parameters would otherwise run 2 or 4 times slower or lower, and the
+// amount of feedback of FEEDBACK_FM depends on the pitch. The bytebeats are
+// left alone: their output is stepped at sample boundaries, and their
+// aliasing is part of the formula.
+//
+// Inharmonic energy (aliasing) measured by braids/test/oversampling_benchmark
+// at C8, both parameters at 50% (saw swarm: C7, no detune), for
+// 1x / 2x fast / 2x high quality / 4x fast / 4x high quality:
+//
+//   triple_ring_mod      -74 / -77 / -77 / -78 / -78 dB
+//   saw_swarm             -7 / -15 / -14 / -20 / -22 dB
+//   fm                     0 / -51 / -59 / -51 / -53 dB
+//   chaotic_feedback_fm   -3 / -53 / -53 / -57 / -56 dB
+//   wavetables           -21 / -38 / -41 / -42 / -53 dB
+//   wave_map             -27 / -36 / -38 / -35 / -38 dB
+//   wave_line             -9 / -18 / -20 / -18 / -20 dB
+//
+// On the host, 2x costs 2.5 to 3 times the CPU of 1x, and 4x 5 to 6 times
+// (the noise shapes more, as their per-call setup is repeated). The fast
+// filter at 2x is the only setting cheap enough for the F1 block budget, and
+// only for the cheaper of these shapes (FM, wavetables).
+/* static */
+const OversamplingRatio DigitalOscillator::oversampling_table_[] = {
+  OVERSAMPLING_4X,  // TRIPLE_RING_MOD
+  OVERSAMPLING_4X,  // SAW_SWARM
+  OVERSAMPLING_1X,  // COMB_FILTER
+  OVERSAMPLING_1X,  // TOY (already 4x internally)
+  OVERSAMPLING_1X,  // DIGITAL_FILTER_LP
+  OVERSAMPLING_1X,  // DIGITAL_FILTER_PK
+  OVERSAMPLING_1X,  // DIGITAL_FILTER_BP
+  OVERSAMPLING_1X,  // DIGITAL_FILTER_HP
+  OVERSAMPLING_1X,  // VOSIM
+  OVERSAMPLING_1X,  // VOWEL
+  OVERSAMPLING_1X,  // VOWEL_FOF
+  OVERSAMPLING_4X,  // FM
+  OVERSAMPLING_1X,  // FEEDBACK_FM (feedback amount depends on pitch_)
+  OVERSAMPLING_4X,  // CHAOTIC_FEEDBACK_FM
+  OVERSAMPLING_1X,  // PLUCKED
+  OVERSAMPLING_1X,  // BOWED
+  OVERSAMPLING_1X,  // BLOWN
+  OVERSAMPLING_1X,  // FLUTED
+  OVERSAMPLING_1X,  // STRUCK_BELL
+  OVERSAMPLING_1X,  // STRUCK_DRUM
+  OVERSAMPLING_1X,  // KICK
+  OVERSAMPLING_1X,  // CYMBAL
+  OVERSAMPLING_1X,  // SNARE
+  OVERSAMPLING_4X,  // WAVETABLES
+  OVERSAMPLING_4X,  // WAVE_MAP
+  OVERSAMPLING_4X,  // WAVE_LINE
+  OVERSAMPLING_1X,  // WAVE_PARAPHONIC
+  OVERSAMPLING_4X,  // CLOCKED_NOISE
+  OVERSAMPLING_1X,  // GRANULAR_CLOUD
+  OVERSAMPLING_1X,  // BYTEBEAT0
+  OVERSAMPLING_1X,  // BYTEBEAT1
+  OVERSAMPLING_1X,  // BYTEBEAT2
+  OVERSAMPLING_1X,  // BYTEBEAT3
+  OVERSAMPLING_1X,  // SILENCE
+};
+
+#endif  // BRAIDS_OVERSAMPLING
+
 }  // namespace braids
@@ -35,7 +35,14 @@
 
 #include "stmlib/stmlib.h"
 
+#ifdef BRAIDS_BYTEBEAT_VM
+#include "braids/bytebeat_vm.h"
+#endif  // BRAIDS_BYTEBEAT_VM
+#ifdef BRAIDS_OVERSAMPLING
+#include "braids/decimator.h"
+#endif  // BRAIDS_OVERSAMPLING
 #include "braids/excitation.h"
+#include "braids/metallic_noise.h"
 #include "braids/svf.h"
 
 #include <cstring>
@@ -54,6 +61,15 @@ static const size_t kNumPluckVoices = 3;
 static const size_t kNumOverlappingFof = 3;
 static const size_t kNumBellPartials = 11;
 static const size_t kNumDrumPartials = 6;
+#ifdef BRAIDS_BYTEBEAT_VM
+static const size_t kNumBytebeatPrograms = 4;
+#endif  // BRAIDS_BYTEBEAT_VM
+
+#ifdef BRAIDS_OVERSAMPLING
+// Number of oversampled samples rendered in one call of a shape's render
+// function.
+static const size_t kOversamplingBlockSize = 24;
+#endif  // BRAIDS_OVERSAMPLING
 
 enum DigitalOscillatorShape {
   OSC_SHAPE_TRIPLE_RING_MOD,
@@ -212,7 +228,7 @@ struct ClockedNoiseState {
 };
 
 struct HatState {
-  uint32_t phase[6];
+  MetallicNoise metallic_noise;
   uint32_t rng_state;
 };
 
@@ -235,11 +251,83 @@ union DigitalOscillatorState {
   uint32_t modulator_phase;
 };
 
+// Delay lines of the comb filter and of the physical models. This is by far
+// the largest part of a DigitalOscillator (16kB).
+union DelayLines {
+  int16_t comb[kCombDelayLength];
+  int16_t ks[1025 * 4];
+  struct {
+    int8_t bridge[kWGBridgeLength];
+    int8_t neck[kWGNeckLength];
+  } bowed;
+  int16_t bore[kWGBoreLength];
+  struct {
+    int8_t jet[kWGJetLength];
+    int8_t bore[kWGFBoreLength];
+  } fluted;
+  DelayLines* next_free;  // Link in the free list of a DelayLinePool.
+};
+
+// Set of delay lines shared by several oscillators. When
+// BRAIDS_SHARED_DELAY_LINES is defined (host builds with many voices), an
+// oscillator does not embed its delay lines: it takes them from a pool when
+// it switches to a shape that needs them, and gives them back when it
+// switches to another one.
+class DelayLinePool {
+ public:
+  DelayLinePool() { }
+  ~DelayLinePool() { }
+
+  void Init(DelayLines* delay_lines, size_t size) {
+    size_ = size;
+    num_free_ = size;
+    free_ = NULL;
+    for (size_t i = size; i--; ) {
+      delay_lines[i].next_free = free_;
+      free_ = &delay_lines[i];
+    }
+  }
+
+  // Returns NULL when all the delay lines are in use.
+  inline DelayLines* Allocate() {
+    DelayLines* d = free_;
+    if (d) {
+      free_ = d->next_free;
+      --num_free_;
+    }
+    return d;
+  }
+
+  inline void Release(DelayLines* d) {
+    d->next_free = free_;
+    free_ = d;
+    ++num_free_;
+  }
+
+  inline size_t size() const { return size_; }
+  inline size_t num_free() const { return num_free_; }
+
+ private:
+  DelayLines* free_;
+  size_t size_;
+  size_t num_free_;
+
+  DISALLOW_COPY_AND_ASSIGN(DelayLinePool);
+};
+
 class DigitalOscillator {
  public:
   typedef void (DigitalOscillator::*RenderFn)(const uint8_t*, int16_t*, uint8_t);
 
-  DigitalOscillator() { }
+  DigitalOscillator() {
+#ifdef BRAIDS_OVERSAMPLING
+    oversampling_ = OVERSAMPLING_1X;
+#endif  // BRAIDS_OVERSAMPLING
+#ifdef BRAIDS_SHARED_DELAY_LINES
+    delay_lines_ = NULL;
+    delay_line_pool_ = NULL;
+#endif  // BRAIDS_SHARED_DELAY_LINES
+  }
   ~DigitalOscillator() { }
   
   inline void Init() {
@@ -251,6 +339,9 @@ class DigitalOscillator {
     svf_[0].Init();
     svf_[1].Init();
     svf_[2].Init();
+#ifdef BRAIDS_OVERSAMPLING
+    decimator_.Init();
+#endif  // BRAIDS_OVERSAMPLING
     phase_ = 0;
     // t_ = 0; // Don't reset the bytebeat counter to allow continuity when switch models
     strike_ = true;
@@ -276,6 +367,22 @@ class DigitalOscillator {
     parameter_[0] = parameter_1;
     parameter_[1] = parameter_2;
   }
+
+#ifdef BRAIDS_BYTEBEAT_VM
+  // Replaces the built-in formula of one of the bytebeat shapes with a
+  // program for the VM, or restores it if program is NULL. p0 and p1 are the
+  // two parameters (0 to 32767), p2 is 0.
+  inline bool set_bytebeat_program(
+      uint8_t index,
+      const uint8_t* program,
+      size_t size) {
+    if (!program) {
+      bytebeat_[index].Unload();
+      return true;
+    }
+    return bytebeat_[index].Load(program, size);
+  }
+#endif  // BRAIDS_BYTEBEAT_VM
   
   inline uint32_t phase_increment() const {
     return phase_increment_;
@@ -285,6 +392,51 @@ class DigitalOscillator {
     strike_ = true;
   }
 
+#ifdef BRAIDS_OVERSAMPLING
+  // The shape is rendered at 2x or 4x the sample rate, and decimated with
+  // the given filter. The ratio is limited, per shape, to what the shape
+  // supports (see oversampling_table_). Host builds only: the F1 has neither
+  // the CPU nor the RAM for it.
+  inline void set_oversampling(
+      OversamplingRatio ratio,
+      OversamplingFilter filter) {
+    oversampling_ = ratio;
+    decimator_.set_filter(filter);
+  }
+#endif  // BRAIDS_OVERSAMPLING
+
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  // The shapes using delay lines render silence when the pool is empty.
+  inline void set_delay_line_pool(DelayLinePool* pool) {
+    ReleaseDelayLines();
+    delay_line_pool_ = pool;
+  }
+
+  // Gives the delay lines back to the pool, for example when the note has
+  // died out. They are taken again, cleared, on the next Render().
+  inline void ReleaseDelayLines() {
+    if (delay_lines_) {
+      delay_line_pool_->Release(delay_lines_);
+      delay_lines_ = NULL;
+    }
+  }
+
+  inline bool has_delay_lines() const { return delay_lines_ != NULL; }
+#endif  // BRAIDS_SHARED_DELAY_LINES
+
+#ifdef BRAIDS_OVERSAMPLING
+  static inline OversamplingRatio max_oversampling(
+      DigitalOscillatorShape shape) {
+    return oversampling_table_[shape];
+  }
+
+  inline OversamplingRatio oversampling() const {
+    return oversampling_table_[shape_] < oversampling_
+        ? oversampling_table_[shape_]
+        : oversampling_;
+  }
+#endif  // BRAIDS_OVERSAMPLING
+
   void Render(const uint8_t* sync, int16_t* buffer, uint8_t size);
   
  private:
@@ -330,7 +482,24 @@ class DigitalOscillator {
   void RenderBytebeat2(const uint8_t*, int16_t*, uint8_t);
   void RenderBytebeat3(const uint8_t*, int16_t*, uint8_t);
   void RenderSilence(const uint8_t*, int16_t*, uint8_t);
+#ifdef BRAIDS_BYTEBEAT_VM
+  void RenderBytebeatProgram(const BytebeatVm&, int16_t*, uint8_t);
+#endif  // BRAIDS_BYTEBEAT_VM
   
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  bool uses_delay_lines() const;
+  bool UpdateDelayLines();
+#endif  // BRAIDS_SHARED_DELAY_LINES
+
+#ifdef BRAIDS_OVERSAMPLING
+  void RenderOversampled(
+      RenderFn fn,
+      OversamplingRatio ratio,
+      const uint8_t* sync,
+      int16_t* buffer,
+      uint8_t size);
+#endif  // BRAIDS_OVERSAMPLING
+
   uint32_t ComputePhaseIncrement(int16_t midi_pitch);
   uint32_t ComputeDelay(int16_t midi_pitch);
   int16_t InterpolateFormantParameter(
@@ -343,6 +512,9 @@ class DigitalOscillator {
   uint32_t phase_increment_;
   uint32_t delay_;
   uint32_t t_; // for bytebeat
+#ifdef BRAIDS_BYTEBEAT_VM
+  BytebeatVm bytebeat_[kNumBytebeatPrograms];
+#endif  // BRAIDS_BYTEBEAT_VM
 
   int16_t parameter_[2];
   int16_t previous_parameter_[2];
@@ -360,22 +532,23 @@ class DigitalOscillator {
   
   Excitation pulse_[4];
   Svf svf_[3];
+
+#ifdef BRAIDS_OVERSAMPLING
+  OversamplingRatio oversampling_;
+  Decimator decimator_;
+#endif  // BRAIDS_OVERSAMPLING
   
-  union {
-    int16_t comb[kCombDelayLength];
-    int16_t ks[1025 * 4];
-    struct {
-      int8_t bridge[kWGBridgeLength];
-      int8_t neck[kWGNeckLength];
-    } bowed;
-    int16_t bore[kWGBoreLength];
-    struct {
-      int8_t jet[kWGJetLength];
-      int8_t bore[kWGFBoreLength];
-    } fluted;
-  } delay_lines_;
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  DelayLines* delay_lines_;
+  DelayLinePool* delay_line_pool_;
+#else
+  DelayLines delay_lines_[1];
+#endif  // BRAIDS_SHARED_DELAY_LINES
   
   static RenderFn fn_table_[];
+#ifdef BRAIDS_OVERSAMPLING
+  static const OversamplingRatio oversampling_table_[];
+#endif  // BRAIDS_OVERSAMPLING
   
   DISALLOW_COPY_AND_ASSIGN(DigitalOscillator);
 };
@@ -0,0 +1,68 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Driver for the core cycle counter (DWT_CYCCNT), used to profile the render
+// loop. The DWT registers are addressed directly, as the CMSIS headers shipped
+// with the STM32F10x library do not describe them.
+
+#ifndef BRAIDS_DRIVERS_CYCLE_COUNTER_H_
+#define BRAIDS_DRIVERS_CYCLE_COUNTER_H_
+
+#include <stm32f10x_conf.h>
+#include "stmlib/stmlib.h"
+
+namespace braids {
+
+class CycleCounter {
+ public:
+  CycleCounter() { }
+  ~CycleCounter() { }
+  
+  void Init() {
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    register_at(kCycleCountAddress) = 0;
+    register_at(kControlAddress) |= kCycleCountEnable;
+  }
+  
+  inline uint32_t Read() const {
+    return register_at(kCycleCountAddress);
+  }
+  
+ private:
+  static const uint32_t kControlAddress = 0xe0001000;
+  static const uint32_t kCycleCountAddress = 0xe0001004;
+  static const uint32_t kCycleCountEnable = 1;
+  
+  static inline volatile uint32_t& register_at(uint32_t address) {
+    return *reinterpret_cast<volatile uint32_t*>(address);
+  }
+  
+  DISALLOW_COPY_AND_ASSIGN(CycleCounter);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_DRIVERS_CYCLE_COUNTER_H_
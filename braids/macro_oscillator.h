@@ -80,6 +80,24 @@ class MacroOscillator {
   inline void Strike() {
     digital_oscillator_.Strike();
   }
+
+#ifdef BRAIDS_OVERSAMPLING
+  inline void set_oversampling(
+      OversamplingRatio ratio,
+      OversamplingFilter filter) {
+    digital_oscillator_.set_oversampling(ratio, filter);
+  }
+#endif  // BRAIDS_OVERSAMPLING
+
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  inline void set_delay_line_pool(DelayLinePool* pool) {
+    digital_oscillator_.set_delay_line_pool(pool);
+  }
+
+  inline void ReleaseDelayLines() {
+    digital_oscillator_.ReleaseDelayLines();
+  }
+#endif  // BRAIDS_SHARED_DELAY_LINES
   
   void Render(const uint8_t* sync_buffer, int16_t* buffer, uint8_t size);
   
@@ -0,0 +1,167 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bank of six square oscillators at inharmonic frequencies, whose sum is the
+// metallic noise of the 808-style cymbals and hi-hats. Used by the braids
+// cymbal and by the peaks high hat.
+//
+// Rather than advancing the six phases at every sample, the bank keeps track
+// of the number of samples before the output of each oscillator toggles, and
+// writes the output of an oscillator for up to 32 samples as the bits of a
+// word. The six words are then added with a carry-save adder, which counts the
+// high outputs of 32 samples at once, in three bit planes. The counts are
+// unpacked 4 samples at a time.
+//
+// The increments only need to be divided when they change. The output is the
+// same as with:
+//   phase[i] += increment[i];
+//   out += phase[i] >> 31;
+// for each oscillator and each sample.
+
+#ifndef BRAIDS_METALLIC_NOISE_H_
+#define BRAIDS_METALLIC_NOISE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+
+namespace braids {
+
+const size_t kNumMetallicNoiseOscillators = 6;
+const size_t kMetallicNoiseBlockSize = 32;
+
+// No constructor, so that it can be part of a union of states. A zeroed
+// state is valid.
+class MetallicNoise {
+ public:
+  void Init() {
+    std::fill(&phase_[0], &phase_[kNumMetallicNoiseOscillators], 0);
+    std::fill(&increment_[0], &increment_[kNumMetallicNoiseOscillators], 0);
+  }
+
+  // Writes, for each of the size samples, the number of oscillators whose
+  // output is high (0 to 6). The increments must be lower than 2^31 (the
+  // Nyquist frequency).
+  inline void Render(const uint32_t* increment, uint8_t* out, size_t size) {
+    while (size) {
+      size_t n = std::min(size, kMetallicNoiseBlockSize);
+      uint32_t a = RenderBits(0, increment[0], n);
+      uint32_t b = RenderBits(1, increment[1], n);
+      uint32_t c = RenderBits(2, increment[2], n);
+      uint32_t d = RenderBits(3, increment[3], n);
+      uint32_t e = RenderBits(4, increment[4], n);
+      uint32_t f = RenderBits(5, increment[5], n);
+
+      // Two full adders for the six inputs, a half adder for their sums, and
+      // a full adder for the three carries.
+      uint32_t sum_abc = a ^ b ^ c;
+      uint32_t carry_abc = (a & b) | (c & (a ^ b));
+      uint32_t sum_def = d ^ e ^ f;
+      uint32_t carry_def = (d & e) | (f & (d ^ e));
+      uint32_t ones = sum_abc ^ sum_def;
+      uint32_t carry = sum_abc & sum_def;
+      uint32_t twos = carry_abc ^ carry_def ^ carry;
+      uint32_t fours = (carry_abc & carry_def) |
+          (carry & (carry_abc ^ carry_def));
+
+      size_t i = 0;
+      for (; i + 4 <= n; i += 4) {
+        uint32_t counts = Spread(ones) | (Spread(twos) << 1) |
+            (Spread(fours) << 2);
+        *out++ = counts;
+        *out++ = counts >> 8;
+        *out++ = counts >> 16;
+        *out++ = counts >> 24;
+        ones >>= 4;
+        twos >>= 4;
+        fours >>= 4;
+      }
+      for (; i < n; ++i) {
+        *out++ = (ones & 1) | ((twos & 1) << 1) | ((fours & 1) << 2);
+        ones >>= 1;
+        twos >>= 1;
+        fours >>= 1;
+      }
+      size -= n;
+    }
+  }
+
+ private:
+  // Moves the 4 LSBs of x to the LSBs of the 4 bytes of the result.
+  static inline uint32_t Spread(uint32_t x) {
+    return ((x & 0xf) * 0x00204081) & 0x01010101;
+  }
+
+  static inline uint32_t Mask(size_t size) {
+    return size >= 32 ? 0xffffffff : (1U << size) - 1;
+  }
+
+  // Output of oscillator i for the next size samples (at most 32), the first
+  // one in the LSB.
+  inline uint32_t RenderBits(size_t i, uint32_t increment, size_t size) {
+    uint32_t phase = phase_[i];
+    uint32_t bits = phase & 0x80000000 ? 0xffffffff : 0;
+    if (!increment) {
+      return bits & Mask(size);
+    }
+    if (increment != increment_[i]) {
+      // Between two toggles, the phase goes through 2^31 = q * increment + r.
+      // Right after a toggle, it is e < increment past a multiple of 2^31,
+      // and toggles again after q + 1 samples if e < r, q samples otherwise.
+      increment_[i] = increment;
+      quotient_[i] = 0x80000000 / increment;
+      remainder_[i] = 0x80000000 % increment;
+      countdown_[i] = (0x7fffffff - (phase & 0x7fffffff)) / increment + 1;
+    }
+
+    // The number of iterations only depends on the frequency, and the loop
+    // has no other branch, so that it is well predicted.
+    uint32_t num_toggles = (increment >> 26) + 1;
+    uint32_t toggle = countdown_[i] - 1;
+    for (uint32_t k = 0; k < num_toggles; ++k) {
+      bool in_block = toggle < size;
+      bits ^= in_block ? 0xffffffff << toggle : 0;
+      uint32_t e = (phase + (toggle + 1) * increment) & 0x7fffffff;
+      uint32_t next = toggle + quotient_[i] + (e < remainder_[i] ? 1 : 0);
+      toggle = in_block ? next : toggle;
+    }
+    countdown_[i] = toggle - size + 1;
+    phase_[i] = phase + size * increment;
+    return bits & Mask(size);
+  }
+
+  uint32_t phase_[kNumMetallicNoiseOscillators];
+  uint32_t increment_[kNumMetallicNoiseOscillators];
+  uint32_t quotient_[kNumMetallicNoiseOscillators];
+  uint32_t remainder_[kNumMetallicNoiseOscillators];
+  // Number of samples before the output toggles, counting the sample at
+  // which it does.
+  uint32_t countdown_[kNumMetallicNoiseOscillators];
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_METALLIC_NOISE_H_
@@ -151,6 +151,8 @@ void Settings::Init() {
   if (!settings_within_range) {
     Reset(false);
   }  
+  dirty_ = true;
+  Publish();
 }
 
 void Settings::Reset(bool except_cal_data) {
@@ -166,6 +168,76 @@ void Settings::Reset(bool except_cal_data) {
      memcpy(&data_, &kInitSettings, sizeof(SettingsData));
   }
   data_.magic_byte = 'B';
+  dirty_ = true;
+}
+
+void Settings::Publish() {
+  if (!dirty_) {
+    return;
+  }
+  dirty_ = false;
+  
+  uint8_t spare = current_render_settings_ ^ 1;
+  RenderSettings* s = &render_settings_[spare];
+  s->fine_tune = fine_tune();
+  s->initial_gain = initial_gain();
+  s->pitch_transposition = pitch_transposition();
+  s->fm_cv_offset = data_.fm_cv_offset;
+  
+  s->shape = data_.shape;
+  s->resolution = data_.resolution;
+  s->sample_rate = data_.sample_rate;
+  s->rate_inversion = data_.rate_inversion;
+  s->auto_trig = data_.auto_trig;
+  s->meta_modulation = data_.meta_modulation;
+  s->pitch_quantization = data_.pitch_quantization;
+  s->pitch_sample_hold = data_.pitch_sample_hold;
+  s->vco_drift = data_.vco_drift;
+  s->osc_sync = data_.osc_sync;
+  s->quantize_vibrato = data_.quantize_vibrato;
+  
+  s->mod1_mode = data_.mod1_mode;
+  s->mod1_rate = data_.mod1_rate;
+  s->mod1_ad_ratio = data_.mod1_ad_ratio;
+  s->mod1_attack_shape = data_.mod1_attack_shape;
+  s->mod1_decay_shape = data_.mod1_decay_shape;
+  s->mod1_timbre_depth = mod1_timbre_depth();
+  s->mod1_color_depth = mod1_color_depth();
+  s->mod1_level_depth = mod1_level_depth();
+  s->mod1_vibrato_depth = data_.mod1_vibrato_depth;
+  s->mod1_sync = data_.mod1_sync;
+  s->mod2_mode = data_.mod2_mode;
+  s->mod2_rate = data_.mod2_rate;
+  s->mod2_ad_ratio = data_.mod2_ad_ratio;
+  s->mod2_attack_shape = data_.mod2_attack_shape;
+  s->mod2_decay_shape = data_.mod2_decay_shape;
+  s->mod2_timbre_depth = mod2_timbre_depth();
+  s->mod2_color_depth = mod2_color_depth();
+  s->mod2_level_depth = mod2_level_depth();
+  s->mod2_vibrato_depth = data_.mod2_vibrato_depth;
+  s->mod2_sync = data_.mod2_sync;
+  s->mod1_mod2_depth = data_.mod1_mod2_depth;
+  s->mod1_mod2_vibrato_depth = data_.mod1_mod2_vibrato_depth;
+  
+  s->metaseq = data_.metaseq;
+  s->metaseq_clock_div = data_.metaseq_clock_div;
+  s->metaseq_direction = data_.metaseq_direction;
+  s->metaseq_parameter_dest = data_.metaseq_parameter_dest;
+  for (uint8_t i = 0; i < 8; ++i) {
+    s->metaseq_shape[i] = metaseq_shape(i);
+    s->metaseq_step_length[i] = metaseq_step_length(i);
+    s->metaseq_parameter[i] = metaseq_parameter(i);
+    s->metaseq_note[i] = metaseq_note(i);
+  }
+  
+  s->turing_length = data_.turing_length;
+  s->turing_clock_div = data_.turing_clock_div;
+  s->turing_init = data_.turing_init;
+  s->turing_prob = data_.turing_prob;
+  s->turing_window = data_.turing_window;
+  s->musical_scale = data_.musical_scale;
+  
+  current_render_settings_ = spare;
 }
 
 void Settings::Save() {
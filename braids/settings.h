@@ -343,6 +343,67 @@ struct SettingsData {
   char magic_byte;
 };
 
+// The settings read by RenderBlock, decoded and packed together so that a
+// block reads each of them with a single load at a fixed offset from one base
+// pointer, instead of going through the accessors of Settings.
+struct RenderSettings {
+  int32_t fine_tune;
+  int32_t initial_gain;
+  int32_t pitch_transposition;
+  int32_t fm_cv_offset;
+
+  uint8_t shape;
+  uint8_t resolution;
+  uint8_t sample_rate;
+  uint8_t rate_inversion;
+  uint8_t auto_trig;
+  uint8_t meta_modulation;
+  uint8_t pitch_quantization;
+  uint8_t pitch_sample_hold;
+  uint8_t vco_drift;
+  uint8_t osc_sync;
+  uint8_t quantize_vibrato;
+
+  uint8_t mod1_mode;
+  uint8_t mod1_rate;
+  uint8_t mod1_ad_ratio;
+  uint8_t mod1_attack_shape;
+  uint8_t mod1_decay_shape;
+  uint8_t mod1_timbre_depth;
+  uint8_t mod1_color_depth;
+  uint8_t mod1_level_depth;
+  uint8_t mod1_vibrato_depth;
+  uint8_t mod1_sync;
+  uint8_t mod2_mode;
+  uint8_t mod2_rate;
+  uint8_t mod2_ad_ratio;
+  uint8_t mod2_attack_shape;
+  uint8_t mod2_decay_shape;
+  uint8_t mod2_timbre_depth;
+  uint8_t mod2_color_depth;
+  uint8_t mod2_level_depth;
+  uint8_t mod2_vibrato_depth;
+  uint8_t mod2_sync;
+  uint8_t mod1_mod2_depth;
+  uint8_t mod1_mod2_vibrato_depth;
+
+  uint8_t metaseq;
+  uint8_t metaseq_clock_div;
+  uint8_t metaseq_direction;
+  uint8_t metaseq_parameter_dest;
+  uint8_t metaseq_shape[8];
+  uint8_t metaseq_step_length[8];
+  uint8_t metaseq_parameter[8];
+  int8_t metaseq_note[8];
+
+  uint8_t turing_length;
+  uint8_t turing_clock_div;
+  uint8_t turing_init;
+  uint8_t turing_prob;
+  uint8_t turing_window;
+  uint8_t musical_scale;
+} __attribute__((aligned(4)));
+
 struct SettingMetadata {
   uint8_t min_value;
   uint8_t max_value;
@@ -378,9 +439,15 @@ class Settings {
   void Save();
   void Reset(bool except_cal_data);
   
+  // Rebuilds the render settings if the settings have been edited since the
+  // last call. The new copy is written to the spare buffer, and made current
+  // with a single byte store, so RenderBlock never sees a half-updated copy.
+  void Publish();
+  
   void SetValue(Setting setting, uint8_t value) {
     uint8_t* data = static_cast<uint8_t*>(static_cast<void*>(&data_));
     data[setting] = value;
+    dirty_ = true;
   }
   
   uint8_t GetValue(Setting setting) const {
@@ -486,7 +553,14 @@ class Settings {
   }
   
   inline const SettingsData& data() const { return data_; }
-  inline SettingsData* mutable_data() { return &data_; }
+  inline SettingsData* mutable_data() {
+    dirty_ = true;
+    return &data_;
+  }
+  
+  inline const RenderSettings& render_settings() const {
+    return render_settings_[current_render_settings_];
+  }
   
   void Calibrate(
       int32_t adc_code_c2,
@@ -498,6 +572,7 @@ class Settings {
       data_.pitch_cv_offset = (60 << 7) - 
           (scale * ((adc_code_c2 + adc_code_c4) >> 1) >> 12);
       data_.fm_cv_offset = adc_code_fm;
+      dirty_ = true;
     }
     Save();
   }
@@ -549,6 +624,10 @@ class Settings {
   
   uint16_t version_token_;
   
+  RenderSettings render_settings_[2];
+  volatile uint8_t current_render_settings_;
+  bool dirty_;
+  
   static const SettingMetadata metadata_[SETTING_LAST];
   static const Setting settings_order_[SETTING_LAST];
 
@@ -0,0 +1,351 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks that the bytecode VM renders the same samples as the built-in
+// bytebeat formulas, when given the same formulas as programs, and compares
+// their speed on the host.
+//
+// Usage:
+//   bytebeat_benchmark
+//
+// Built with BRAIDS_BYTEBEAT_VM, see the makefile.
+//
+// Then estimates the number of Cortex-M3 cycles needed to render a 24-sample
+// block with these programs, and with one of the most expensive programs
+// accepted by BytebeatVm::Load (a chain of divisions), and compares them with
+// the time available for a block: 24 samples at 96kHz, 18000 cycles at 72MHz.
+// The model counts, for each opcode, the decoding in each pass of
+// kMaxBytebeatBlockSize samples and, for the operations which depend on t, a
+// load, an operation and a store per sample; a division takes up to 12
+// cycles. Build the firmware with PROFILE_RENDER_BLOCK to
+// measure the actual cost of RenderBlock on the module.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "braids/digital_oscillator.h"
+
+#ifndef BRAIDS_BYTEBEAT_VM
+#error "bytebeat_benchmark needs DEFINES=-DBRAIDS_BYTEBEAT_VM"
+#endif  // BRAIDS_BYTEBEAT_VM
+
+using namespace braids;
+
+const size_t kBlockSize = 24;
+const size_t kNumBlocks = 2000;
+const size_t kNumTimingBlocks = 20000;
+const size_t kNumRuns = 5;
+const uint32_t kCyclesPerBlock = 72000000 / 96000 * kBlockSize;
+
+// The built-in formulas, as postfix programs for the VM.
+
+// from http://royal-paw.com/2012/01/bytebeats-in-c-and-python-generative-symphonies-from-extremely-small-programs/
+// (atmospheric, hopeful)
+// ((t*3) & (t>>10)) | ((t*p0) & (t>>10)) | ((t*10) & ((t>>8)*p1) & 128)
+// with p0 = P0 >> 9, p1 = P1 >> 11
+static const uint8_t bytebeat_program_0[] = {
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 3, BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P0, BYTEBEAT_OP_CONST8, 9, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_AND, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 8, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_P1, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MUL, BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_CONST8, 128, BYTEBEAT_OP_AND, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_END
+};
+
+// equation by stephth via https://www.youtube.com/watch?v=tCRPUv8V22o at 3:38
+// ((t*p0) & (t>>4)) | ((t*5) & (t>>7)) | ((t*p1) & (t>>10))
+// with p0 = P0 >> 11, p1 = P1 >> 11
+static const uint8_t bytebeat_program_1[] = {
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P0, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 4, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 5, BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 7, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_AND, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P1, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_AND, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_END
+};
+
+// This one is from http://www.reddit.com/r/bytebeat/comments/20km9l/cool_equations/ (t>>13&t)*(t>>8)
+// ((t>>p0) & t) * (t>>p1)
+// with p0 = P0 >> 11, p1 = P1 >> 11
+static const uint8_t bytebeat_program_2[] = {
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P0, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P1, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_END
+};
+
+// This one is the second one listed at from http://xifeng.weebly.com/bytebeats.html
+// ((((t>>p0) | t) | (t>>p0)) * 10 & ((5*t) | (t>>10))) | (t ^ (t % p1))
+// with p0 = P0 >> 11, p1 = P1 >> 8
+static const uint8_t bytebeat_program_3[] = {
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P0, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P0, BYTEBEAT_OP_CONST8, 11, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_OR, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 5, BYTEBEAT_OP_MUL,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_CONST8, 10, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_OR, BYTEBEAT_OP_AND,
+  BYTEBEAT_OP_T,
+  BYTEBEAT_OP_T, BYTEBEAT_OP_P1, BYTEBEAT_OP_CONST8, 8, BYTEBEAT_OP_SHR,
+  BYTEBEAT_OP_MOD,
+  BYTEBEAT_OP_XOR, BYTEBEAT_OP_OR,
+  BYTEBEAT_OP_END
+};
+
+const uint8_t* const builtin_programs[kNumBytebeatPrograms] = {
+  bytebeat_program_0,
+  bytebeat_program_1,
+  bytebeat_program_2,
+  bytebeat_program_3
+};
+
+const size_t builtin_program_sizes[kNumBytebeatPrograms] = {
+  sizeof(bytebeat_program_0),
+  sizeof(bytebeat_program_1),
+  sizeof(bytebeat_program_2),
+  sizeof(bytebeat_program_3)
+};
+
+// The bytebeat shapes of the oscillator, with the built-in formulas, or with
+// a program replacing the formula of the current shape.
+class Bytebeat {
+ public:
+  Bytebeat() : program_(NULL), size_(0) { }
+  ~Bytebeat() { }
+
+  void Init() {
+    osc_.Init();
+  }
+
+  void set_equation(uint8_t equation) {
+    for (uint8_t i = 0; i < kNumBytebeatPrograms; ++i) {
+      osc_.set_bytebeat_program(i, NULL, 0);
+    }
+    if (program_) {
+      osc_.set_bytebeat_program(equation, program_, size_);
+    }
+    osc_.set_shape(static_cast<DigitalOscillatorShape>(
+        OSC_SHAPE_BYTEBEAT0 + equation));
+  }
+  void set_pitch(int16_t pitch) { osc_.set_pitch(pitch); }
+  void set_parameters(int16_t parameter_1, int16_t parameter_2) {
+    osc_.set_parameters(parameter_1, parameter_2);
+  }
+  void Render(const uint8_t* sync, int16_t* buffer, uint8_t size) {
+    osc_.Render(sync, buffer, size);
+  }
+  void set_program(const uint8_t* program, size_t size) {
+    program_ = program;
+    size_ = size;
+  }
+
+ private:
+  DigitalOscillator osc_;
+  const uint8_t* program_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(Bytebeat);
+};
+
+// Global, so that t starts from 0.
+Bytebeat native;
+Bytebeat vm;
+uint8_t sync[kBlockSize];
+
+// Pitch and parameters change every 97 blocks, so that the sweep covers many
+// combinations in each run.
+void Configure(Bytebeat* bytebeat, uint8_t equation, size_t block) {
+  size_t step = block / 97;
+  bytebeat->set_pitch(((step * 7) % 128) << 7);
+  bytebeat->set_parameters((step * 4099) % 32768, (step * 9241 + 5) % 32768);
+  if (block == 0) {
+    bytebeat->set_equation(equation);
+  }
+}
+
+bool Check(uint8_t equation) {
+  int16_t expected[kBlockSize];
+  int16_t actual[kBlockSize];
+  native.Init();
+  vm.set_program(builtin_programs[equation], builtin_program_sizes[equation]);
+  vm.Init();
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    Configure(&native, equation, i);
+    Configure(&vm, equation, i);
+    native.Render(sync, expected, kBlockSize);
+    vm.Render(sync, actual, kBlockSize);
+    for (size_t j = 0; j < kBlockSize; ++j) {
+      if (actual[j] != expected[j]) {
+        printf("Equation %d, block %u, sample %u: %d instead of %d\n",
+            equation, static_cast<uint32_t>(i), static_cast<uint32_t>(j),
+            actual[j], expected[j]);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Best of several runs, in ns per sample.
+double Time(Bytebeat* bytebeat, uint8_t equation) {
+  int16_t block[kBlockSize];
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    bytebeat->Init();
+    clock_t start = clock();
+    for (size_t i = 0; i < kNumTimingBlocks; ++i) {
+      Configure(bytebeat, equation, i);
+      bytebeat->Render(sync, block, kBlockSize);
+      checksum += block[i % kBlockSize];
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best * 1e9 / (kNumTimingBlocks * kBlockSize);
+}
+
+// Cortex-M3 cycles per block, see the model above.
+uint32_t EstimateCycles(const uint8_t* program, size_t size) {
+  const uint32_t kNumPasses =
+      (kBlockSize + kMaxBytebeatBlockSize - 1) / kMaxBytebeatBlockSize;
+  const uint32_t kDecodeCycles = 20 * kNumPasses;
+  const uint32_t kLoadStoreCycles = 5;
+  bool depends_on_t[kMaxBytebeatStackDepth];
+  size_t top = 0;
+  uint32_t cycles = kBlockSize * kLoadStoreCycles;  // Output copy.
+  for (size_t i = 0; i < size && program[i] != BYTEBEAT_OP_END; ++i) {
+    uint8_t opcode = program[i];
+    cycles += kDecodeCycles;
+    if (opcode <= BYTEBEAT_OP_CONST16) {
+      depends_on_t[top++] = opcode == BYTEBEAT_OP_T;
+      i += opcode == BYTEBEAT_OP_CONST8 ? 1 : 0;
+      i += opcode == BYTEBEAT_OP_CONST16 ? 2 : 0;
+    } else if (opcode == BYTEBEAT_OP_NOT) {
+      if (depends_on_t[top - 1]) {
+        cycles += kBlockSize * (kLoadStoreCycles + 1);
+      }
+    } else {
+      --top;
+      if (depends_on_t[top - 1] || depends_on_t[top]) {
+        bool division = opcode == BYTEBEAT_OP_DIV || opcode == BYTEBEAT_OP_MOD;
+        cycles += kBlockSize * (kLoadStoreCycles + (division ? 12 : 1));
+      }
+      depends_on_t[top - 1] = depends_on_t[top - 1] || depends_on_t[top];
+    }
+  }
+  return cycles;
+}
+
+// One of the most expensive programs accepted by Load(): as many divisions
+// which depend on t as kMaxBytebeatSampleCost allows, T T DIV T DIV ...,
+// completed with additions.
+uint8_t worst_case_program[kMaxBytebeatProgramSize];
+
+size_t MakeWorstCaseProgram() {
+  size_t size = 0;
+  size_t cost = 0;
+  worst_case_program[size++] = BYTEBEAT_OP_T;
+  while (cost + kBytebeatDivisionCost <= kMaxBytebeatSampleCost) {
+    worst_case_program[size++] = BYTEBEAT_OP_T;
+    worst_case_program[size++] = BYTEBEAT_OP_DIV;
+    cost += kBytebeatDivisionCost;
+  }
+  while (cost < kMaxBytebeatSampleCost) {
+    worst_case_program[size++] = BYTEBEAT_OP_T;
+    worst_case_program[size++] = BYTEBEAT_OP_ADD;
+    ++cost;
+  }
+  return size;
+}
+
+void PrintEstimate(const char* name, const uint8_t* program, size_t size) {
+  uint32_t cycles = EstimateCycles(program, size);
+  printf("%-12s %16u %15.1f%%\n", name, cycles,
+      100.0 * cycles / kCyclesPerBlock);
+}
+
+int main(void) {
+  std::fill(&sync[0], &sync[kBlockSize], 0);
+  printf("%-12s %16s %16s %8s\n",
+      "equation", "native ns/smp", "vm ns/smp", "ratio");
+  for (uint8_t equation = 0; equation < kNumBytebeatPrograms; ++equation) {
+    if (!Check(equation)) {
+      return 1;
+    }
+    double t_native = Time(&native, equation);
+    double t_vm = Time(&vm, equation);
+    printf("bytebeat %-3d %16.2f %16.2f %7.2fx\n",
+        equation, t_native, t_vm,
+        t_native > 0.0 ? t_vm / t_native : 0.0);
+  }
+
+  size_t size = MakeWorstCaseProgram();
+  BytebeatVm worst_case;
+  if (!worst_case.Load(worst_case_program, size)) {
+    printf("Worst case program rejected\n");
+    return 1;
+  }
+  vm.set_program(worst_case_program, size);
+  vm.Init();
+  printf("%-12s %16s %16.2f\n", "worst case", "-", Time(&vm, 0));
+
+  printf("\nEstimated Cortex-M3 cycles per %u-sample block (budget: %u).\n",
+      static_cast<uint32_t>(kBlockSize), kCyclesPerBlock);
+  printf("%-12s %16s %16s\n", "program", "cycles", "budget");
+  PrintEstimate("worst case", worst_case_program, size);
+  const char* names[kNumBytebeatPrograms] = {
+    "bytebeat 0", "bytebeat 1", "bytebeat 2", "bytebeat 3"
+  };
+  for (uint8_t i = 0; i < kNumBytebeatPrograms; ++i) {
+    PrintEstimate(names[i], builtin_programs[i], builtin_program_sizes[i]);
+  }
+  return 0;
+}
@@ -0,0 +1,80 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// In-place radix-2 FFT and analysis window, for the host analysis tools.
+
+#ifndef BRAIDS_TEST_FFT_H_
+#define BRAIDS_TEST_FFT_H_
+
+#include <cmath>
+#include <cstddef>
+
+namespace braids {
+
+// n must be a power of 2.
+inline void Fft(double* re, double* im, size_t n) {
+  for (size_t i = 1, j = 0; i < n; ++i) {
+    size_t bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (size_t length = 2; length <= n; length <<= 1) {
+    double angle = -2.0 * M_PI / length;
+    for (size_t i = 0; i < n; i += length) {
+      for (size_t k = 0; k < length / 2; ++k) {
+        double c = cos(angle * k);
+        double s = sin(angle * k);
+        double* a_re = &re[i + k];
+        double* a_im = &im[i + k];
+        double* b_re = &re[i + k + length / 2];
+        double* b_im = &im[i + k + length / 2];
+        double t_re = *b_re * c - *b_im * s;
+        double t_im = *b_re * s + *b_im * c;
+        *b_re = *a_re - t_re;
+        *b_im = *a_im - t_im;
+        *a_re += t_re;
+        *a_im += t_im;
+      }
+    }
+  }
+}
+
+// 4-term Blackman-Harris window.
+inline double BlackmanHarris(size_t i, size_t n) {
+  double x = 2.0 * M_PI * i / n;
+  return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) -
+      0.01168 * cos(3 * x);
+}
+
+}  // namespace braids
+
+#endif  // BRAIDS_TEST_FFT_H_
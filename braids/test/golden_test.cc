@@ -0,0 +1,379 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Golden-output regression test of the macro oscillator.
+//
+// Usage:
+//   golden_test [-g goldens.txt] [-w] [-j jobs] [-t dB]
+//
+// Every MacroOscillatorShape renders the default timeline stimulus (pitch
+// sweep, parameter ramps, strikes) from the same random seed. The output is
+// summarized by a fingerprint: a hash of the samples, the RMS and peak
+// levels, and the average power in 16 logarithmically spaced bands.
+//
+// The fingerprints are compared with the goldens checked in
+// braids/test/golden/fingerprints.txt (-w rewrites them). Any change of
+// hash is an error, unless all levels are within the -t tolerance, in which
+// case it is only reported. The shapes are rendered in parallel, one process
+// per shape: the oscillators share the global random generator, so threads
+// would make the noise-based shapes depend on the scheduling.
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "stmlib/utils/random.h"
+
+#include "braids/test/fft.h"
+#include "braids/test/timeline.h"
+
+using namespace braids;
+using namespace stmlib;
+
+const uint32_t kDuration = kTimelineSampleRate * 4;
+const uint32_t kRandomSeed = 0x5eed;
+const size_t kFrameSize = 4096;
+const size_t kNumBands = 16;
+const double kLowestBandFrequency = 50.0;
+
+const char* const kDefaultGoldenFile = "braids/test/golden/fingerprints.txt";
+
+struct Fingerprint {
+  char name[32];
+  uint64_t hash;
+  double rms;
+  double peak;
+  double band[kNumBands];
+};
+
+Fingerprint fingerprints[MACRO_OSC_SHAPE_LAST];
+Fingerprint goldens[MACRO_OSC_SHAPE_LAST];
+size_t num_goldens;
+
+inline double Decibels(double power) {
+  return 10.0 * log10(power + 1e-12);
+}
+
+// Accumulates the hash, levels and band powers of a rendered signal.
+class FingerprintBuilder {
+ public:
+  FingerprintBuilder() { }
+  ~FingerprintBuilder() { }
+
+  void Init() {
+    hash_ = 14695981039346656037ULL;  // FNV-1a 64.
+    sum_squares_ = 0.0;
+    peak_ = 0;
+    num_samples_ = 0;
+    num_frames_ = 0;
+    frame_ptr_ = 0;
+    memset(band_power_, 0, sizeof(band_power_));
+  }
+
+  void Process(const int16_t* samples, size_t size) {
+    while (size--) {
+      int16_t s = *samples++;
+      uint16_t u = static_cast<uint16_t>(s);
+      hash_ = (hash_ ^ (u & 0xff)) * 1099511628211ULL;
+      hash_ = (hash_ ^ (u >> 8)) * 1099511628211ULL;
+      sum_squares_ += static_cast<double>(s) * s;
+      int32_t magnitude = s < 0 ? -static_cast<int32_t>(s) : s;
+      if (magnitude > peak_) {
+        peak_ = magnitude;
+      }
+      ++num_samples_;
+      frame_[frame_ptr_++] = s;
+      if (frame_ptr_ == kFrameSize) {
+        AnalyzeFrame();
+        frame_ptr_ = 0;
+      }
+    }
+  }
+
+  void Finish(const char* name, Fingerprint* f) const {
+    strncpy(f->name, name, sizeof(f->name) - 1);
+    f->name[sizeof(f->name) - 1] = '\0';
+    f->hash = hash_;
+    f->rms = Decibels(sum_squares_ / (num_samples_ * 32768.0 * 32768.0));
+    f->peak = Decibels(
+        static_cast<double>(peak_) * peak_ / (32768.0 * 32768.0));
+    for (size_t i = 0; i < kNumBands; ++i) {
+      f->band[i] = Decibels(num_frames_ ? band_power_[i] / num_frames_ : 0.0);
+    }
+  }
+
+ private:
+  void AnalyzeFrame() {
+    double window_power = 0.0;
+    for (size_t i = 0; i < kFrameSize; ++i) {
+      double w = BlackmanHarris(i, kFrameSize);
+      re_[i] = frame_[i] / 32768.0 * w;
+      im_[i] = 0.0;
+      window_power += w * w;
+    }
+    Fft(re_, im_, kFrameSize);
+    double nyquist = kTimelineSampleRate / 2.0;
+    double ratio = nyquist / kLowestBandFrequency;
+    for (size_t i = 1; i < kFrameSize / 2; ++i) {
+      double f = static_cast<double>(i) * kTimelineSampleRate / kFrameSize;
+      if (f < kLowestBandFrequency) {
+        continue;
+      }
+      size_t band = static_cast<size_t>(
+          kNumBands * log(f / kLowestBandFrequency) / log(ratio));
+      if (band >= kNumBands) {
+        band = kNumBands - 1;
+      }
+      band_power_[band] += 2.0 * (re_[i] * re_[i] + im_[i] * im_[i]) /
+          (window_power * kFrameSize);
+    }
+    ++num_frames_;
+  }
+
+  uint64_t hash_;
+  double sum_squares_;
+  int32_t peak_;
+  size_t num_samples_;
+  size_t num_frames_;
+
+  int16_t frame_[kFrameSize];
+  size_t frame_ptr_;
+  double re_[kFrameSize];
+  double im_[kFrameSize];
+  double band_power_[kNumBands];
+
+  DISALLOW_COPY_AND_ASSIGN(FingerprintBuilder);
+};
+
+Timeline timeline;
+MacroOscillator osc;
+TimelinePlayer player;
+FingerprintBuilder builder;
+
+void Render(MacroOscillatorShape shape, Fingerprint* f) {
+  Random::Seed(kRandomSeed);
+  osc.Init();
+  player.Init(&timeline, &osc, shape);
+  builder.Init();
+  int16_t buffer[kTimelineBlockSize];
+  size_t n;
+  while ((n = player.Render(buffer)) != 0) {
+    builder.Process(buffer, n);
+  }
+  builder.Finish(macro_shape_names[shape], f);
+}
+
+// Renders all shapes, with up to num_jobs child processes at a time, each
+// sending its fingerprint back through a pipe.
+bool RenderAll(size_t num_jobs) {
+  int pipes[MACRO_OSC_SHAPE_LAST];
+  size_t num_running = 0;
+  for (size_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+    if (num_running == num_jobs) {
+      wait(NULL);
+      --num_running;
+    }
+    int fd[2];
+    if (pipe(fd) != 0) {
+      perror("pipe");
+      return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      perror("fork");
+      return false;
+    } else if (pid == 0) {
+      close(fd[0]);
+      Fingerprint f;
+      Render(static_cast<MacroOscillatorShape>(i), &f);
+      // Smaller than PIPE_BUF, written at once without blocking.
+      ssize_t written = write(fd[1], &f, sizeof(f));
+      _exit(written == sizeof(f) ? 0 : 1);
+    }
+    close(fd[1]);
+    pipes[i] = fd[0];
+    ++num_running;
+  }
+  while (num_running--) {
+    wait(NULL);
+  }
+  bool success = true;
+  for (size_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+    if (read(pipes[i], &fingerprints[i], sizeof(Fingerprint)) !=
+        sizeof(Fingerprint)) {
+      fprintf(stderr, "No result for %s\n", macro_shape_names[i]);
+      success = false;
+    }
+    close(pipes[i]);
+  }
+  return success;
+}
+
+void WriteFingerprint(FILE* fp, const Fingerprint& f) {
+  fprintf(fp, "%-22s %016llx %7.2f %7.2f", f.name,
+      static_cast<unsigned long long>(f.hash), f.rms, f.peak);
+  for (size_t i = 0; i < kNumBands; ++i) {
+    fprintf(fp, " %7.2f", f.band[i]);
+  }
+  fprintf(fp, "\n");
+}
+
+bool SaveGoldens(const char* file_name) {
+  FILE* fp = fopen(file_name, "w");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", file_name);
+    return false;
+  }
+  fprintf(fp, "# shape hash rms_db peak_db band_power_db[%zu]\n", kNumBands);
+  for (size_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+    WriteFingerprint(fp, fingerprints[i]);
+  }
+  fclose(fp);
+  return true;
+}
+
+bool LoadGoldens(const char* file_name) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s, run with -w to create it\n", file_name);
+    return false;
+  }
+  char line[512];
+  num_goldens = 0;
+  while (fgets(line, sizeof(line), fp) &&
+         num_goldens < MACRO_OSC_SHAPE_LAST) {
+    if (line[0] == '#') {
+      continue;
+    }
+    Fingerprint* f = &goldens[num_goldens];
+    unsigned long long hash;
+    int offset;
+    if (sscanf(line, "%31s %llx %lf %lf%n",
+               f->name, &hash, &f->rms, &f->peak, &offset) != 4) {
+      continue;
+    }
+    f->hash = hash;
+    const char* p = line + offset;
+    size_t i = 0;
+    for (; i < kNumBands; ++i) {
+      int n;
+      if (sscanf(p, "%lf%n", &f->band[i], &n) != 1) {
+        break;
+      }
+      p += n;
+    }
+    if (i == kNumBands) {
+      ++num_goldens;
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+const Fingerprint* FindGolden(const char* name) {
+  for (size_t i = 0; i < num_goldens; ++i) {
+    if (!strcmp(goldens[i].name, name)) {
+      return &goldens[i];
+    }
+  }
+  return NULL;
+}
+
+// Largest level difference between two fingerprints, in dB.
+double Distance(const Fingerprint& a, const Fingerprint& b) {
+  double d = fmax(fabs(a.rms - b.rms), fabs(a.peak - b.peak));
+  for (size_t i = 0; i < kNumBands; ++i) {
+    d = fmax(d, fabs(a.band[i] - b.band[i]));
+  }
+  return d;
+}
+
+int main(int argc, char** argv) {
+  const char* golden_file = kDefaultGoldenFile;
+  bool write_goldens = false;
+  long num_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  double tolerance = 0.0;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-g")) {
+      golden_file = argv[++i];
+    } else if (!strcmp(argv[i], "-w")) {
+      write_goldens = true;
+    } else if (i + 1 < argc && !strcmp(argv[i], "-j")) {
+      num_jobs = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-t")) {
+      tolerance = atof(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [-g goldens.txt] [-w] [-j jobs] [-t dB]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (num_jobs < 1) {
+    num_jobs = 1;
+  }
+
+  timeline.InitDefault(kDuration);
+  if (!RenderAll(num_jobs)) {
+    return 1;
+  }
+  if (write_goldens) {
+    if (!SaveGoldens(golden_file)) {
+      return 1;
+    }
+    printf("Wrote %d fingerprints to %s\n", MACRO_OSC_SHAPE_LAST, golden_file);
+    return 0;
+  }
+
+  if (!LoadGoldens(golden_file)) {
+    return 1;
+  }
+  size_t num_failures = 0;
+  for (size_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+    const Fingerprint& f = fingerprints[i];
+    const Fingerprint* golden = FindGolden(f.name);
+    if (!golden) {
+      printf("%-22s NEW\n", f.name);
+      ++num_failures;
+    } else if (golden->hash != f.hash) {
+      double distance = Distance(f, *golden);
+      bool close = distance <= tolerance;
+      printf("%-22s %s, levels within %.2f dB\n", f.name,
+          close ? "changed" : "CHANGED", distance);
+      num_failures += close ? 0 : 1;
+    }
+  }
+  if (num_failures) {
+    printf("%zu of %d shapes differ from %s\n", num_failures,
+        MACRO_OSC_SHAPE_LAST, golden_file);
+    return 1;
+  }
+  printf("All %d shapes match %s\n", MACRO_OSC_SHAPE_LAST, golden_file);
+  return 0;
+}
@@ -0,0 +1,224 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks that the metallic noise bank renders the same sums of square waves
+// as the original per-sample loop, and compares their speed.
+//
+// Usage:
+//   metallic_noise_benchmark
+//
+// The check uses random phases, increments (up to the Nyquist frequency) and
+// block sizes. The timings use the increments of the peaks high hat, and of
+// the braids cymbal at a low, a middle and the highest pitch. In the last
+// setting, the pitch of the cymbal changes at every block, so that the bank
+// has to divide all the increments again.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "braids/metallic_noise.h"
+
+using namespace braids;
+
+const size_t kBlockSize = 24;
+const size_t kNumBlocks = 200000;
+const size_t kNumRuns = 5;
+const size_t kNumCheckBlocks = 100000;
+
+// The original loop.
+void RenderReference(
+    uint32_t* phase,
+    const uint32_t* increment,
+    uint8_t* out,
+    size_t size) {
+  while (size--) {
+    phase[0] += increment[0];
+    phase[1] += increment[1];
+    phase[2] += increment[2];
+    phase[3] += increment[3];
+    phase[4] += increment[4];
+    phase[5] += increment[5];
+
+    int16_t noise = 0;
+    noise += phase[0] >> 31;
+    noise += phase[1] >> 31;
+    noise += phase[2] >> 31;
+    noise += phase[3] >> 31;
+    noise += phase[4] >> 31;
+    noise += phase[5] >> 31;
+    *out++ = noise;
+  }
+}
+
+uint32_t rng_state = 0x21;
+
+inline uint32_t Random32() {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return rng_state;
+}
+
+// Random increments, sometimes kept from one block to the next.
+bool Check() {
+  uint32_t phase[kNumMetallicNoiseOscillators] = { 0, 0, 0, 0, 0, 0 };
+  uint32_t increment[kNumMetallicNoiseOscillators];
+  uint8_t expected[100];
+  uint8_t actual[100];
+  MetallicNoise metallic_noise;
+  metallic_noise.Init();
+  for (size_t i = 0; i < kNumCheckBlocks; ++i) {
+    for (size_t j = 0; j < kNumMetallicNoiseOscillators; ++j) {
+      // Mostly low frequencies, as in the modules, some up to Nyquist, and
+      // a few static oscillators.
+      uint32_t r = Random32();
+      if (i == 0 || (r & 3) == 0) {
+        increment[j] = (r & 28) == 0 ? 0 : (Random32() >> 1) >> (r >> 27);
+      }
+    }
+    size_t size = 1 + Random32() % 100;
+    for (size_t k = 0; k < 3; ++k) {
+      RenderReference(phase, increment, expected, size);
+      metallic_noise.Render(increment, actual, size);
+      for (size_t j = 0; j < size; ++j) {
+        if (actual[j] != expected[j]) {
+          printf("Block %u, sample %u: %d instead of %d\n",
+              static_cast<uint32_t>(i), static_cast<uint32_t>(j),
+              actual[j], expected[j]);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+class Reference {
+ public:
+  Reference() { }
+  ~Reference() { }
+
+  void Init() {
+    std::fill(&phase_[0], &phase_[kNumMetallicNoiseOscillators], 0);
+  }
+
+  void Render(const uint32_t* increment, uint8_t* out, size_t size) {
+    RenderReference(phase_, increment, out, size);
+  }
+
+ private:
+  uint32_t phase_[kNumMetallicNoiseOscillators];
+
+  DISALLOW_COPY_AND_ASSIGN(Reference);
+};
+
+const uint32_t kHighHatIncrements[kNumMetallicNoiseOscillators] = {
+  48318382, 71582788, 37044092, 54313440, 66214079, 93952409
+};
+
+// Increments of the braids cymbal for a root increment.
+void CymbalIncrements(uint32_t root_increment, uint32_t* increment) {
+  uint32_t root = root_increment >> 10;
+  increment[0] = root_increment;
+  increment[1] = root * 24273 >> 4;
+  increment[2] = root * 12561 >> 4;
+  increment[3] = root * 18417 >> 4;
+  increment[4] = root * 22452 >> 4;
+  increment[5] = root * 31858 >> 4;
+}
+
+struct Setting {
+  const char* name;
+  // 0 for the high hat.
+  uint32_t root_increment;
+  bool sweep;
+};
+
+// Root frequencies of 110Hz, 660Hz and 3.3kHz at 96kHz.
+const Setting settings[] = {
+  { "peaks hh", 0, false },
+  { "cymbal low", 4921316, false },
+  { "cymbal mid", 29527900, false },
+  { "cymbal high", 147639500, false },
+  { "cymbal sweep", 29527900, true },
+};
+
+const size_t kNumSettings = sizeof(settings) / sizeof(Setting);
+
+// Best of several runs, in ns per sample.
+template<typename Bank>
+double Time(Bank* bank, const Setting& setting) {
+  uint32_t increment[kNumMetallicNoiseOscillators];
+  uint8_t block[kBlockSize];
+  if (setting.root_increment) {
+    CymbalIncrements(setting.root_increment, increment);
+  } else {
+    std::copy(
+        &kHighHatIncrements[0],
+        &kHighHatIncrements[kNumMetallicNoiseOscillators],
+        &increment[0]);
+  }
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    bank->Init();
+    clock_t start = clock();
+    for (size_t i = 0; i < kNumBlocks; ++i) {
+      if (setting.sweep) {
+        CymbalIncrements(setting.root_increment + (i & 63) * 4096, increment);
+      }
+      bank->Render(increment, block, kBlockSize);
+      checksum += block[i % kBlockSize];
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best * 1e9 / (kNumBlocks * kBlockSize);
+}
+
+Reference reference;
+MetallicNoise metallic_noise;
+
+int main(void) {
+  if (!Check()) {
+    return 1;
+  }
+
+  printf("%-12s %16s %16s %8s\n",
+      "increments", "reference ns/smp", "bank ns/smp", "speedup");
+  for (size_t i = 0; i < kNumSettings; ++i) {
+    double t_reference = Time(&reference, settings[i]);
+    double t_bank = Time(&metallic_noise, settings[i]);
+    printf("%-12s %16.2f %16.2f %7.2fx\n",
+        settings[i].name, t_reference, t_bank,
+        t_bank > 0.0 ? t_reference / t_bank : 0.0);
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Offline renderer: drives the macro oscillator from a parameter timeline and
+// streams the result to a .wav file.
+//
+// Usage:
+//   offline_renderer [-t timeline.txt] [-s shape|all] [-d seconds] [-o out]
+//
+// Without a timeline, a default stimulus of the given duration is used. With
+// "-s all", the timeline is rendered once for every shape, to
+// <out>_<shape>.wav ; shape events in the timeline are then ignored. The files
+// are padded with silence to a whole number of seconds.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "stmlib/test/wav_writer.h"
+
+#include "braids/macro_oscillator.h"
+#include "braids/test/timeline.h"
+
+using namespace braids;
+using namespace stmlib;
+using namespace std;
+
+// Rendered blocks are accumulated and written to disk in large chunks.
+const size_t kWriteBufferSize = kTimelineBlockSize * 2048;
+
+int16_t write_buffer[kWriteBufferSize];
+
+bool Render(
+    const Timeline& timeline,
+    MacroOscillatorShape shape,
+    const char* file_name) {
+  static MacroOscillator osc;
+  static TimelinePlayer player;
+
+  uint32_t duration = (timeline.duration() + kTimelineSampleRate - 1) / \
+      kTimelineSampleRate;
+  WavWriter wav_writer(1, kTimelineSampleRate, duration);
+  wav_writer.Open(file_name);
+
+  player.Init(&timeline, &osc, shape);
+  uint32_t num_samples = 0;
+  size_t fill = 0;
+  while (true) {
+    size_t rendered = player.Render(&write_buffer[fill]);
+    fill += rendered;
+    num_samples += rendered;
+    if (fill + kTimelineBlockSize > kWriteBufferSize ||
+        rendered < kTimelineBlockSize) {
+      wav_writer.WriteFrames(write_buffer, fill);
+      fill = 0;
+    }
+    if (rendered < kTimelineBlockSize) {
+      break;
+    }
+  }
+
+  // The timeline might have been shorter than announced.
+  fill_n(&write_buffer[0], kWriteBufferSize, 0);
+  uint32_t num_frames = duration * kTimelineSampleRate;
+  while (num_samples < num_frames) {
+    size_t silence = min(
+        static_cast<size_t>(num_frames - num_samples), kWriteBufferSize);
+    wav_writer.WriteFrames(write_buffer, silence);
+    num_samples += silence;
+  }
+  return true;
+}
+
+void Usage(const char* name) {
+  fprintf(stderr,
+      "Usage: %s [-t timeline.txt] [-s shape|all] [-d seconds] [-o out]\n",
+      name);
+}
+
+int main(int argc, char** argv) {
+  const char* timeline_file = NULL;
+  const char* shape_name = NULL;
+  const char* output = "sound";
+  double duration = 5.0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-t")) {
+      timeline_file = argv[++i];
+    } else if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+      shape_name = argv[++i];
+    } else if (i + 1 < argc && !strcmp(argv[i], "-d")) {
+      duration = atof(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-o")) {
+      output = argv[++i];
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+
+  static Timeline timeline;
+  if (timeline_file) {
+    if (!timeline.Load(timeline_file)) {
+      return 1;
+    }
+  } else {
+    timeline.InitDefault(
+        static_cast<uint32_t>(duration * kTimelineSampleRate));
+  }
+
+  bool all_shapes = shape_name && !strcmp(shape_name, "all");
+  MacroOscillatorShape shape = MACRO_OSC_SHAPE_LAST;
+  if (shape_name && !all_shapes) {
+    shape = ParseShapeName(shape_name);
+    if (shape == MACRO_OSC_SHAPE_LAST) {
+      fprintf(stderr, "Unknown shape: %s\n", shape_name);
+      return 1;
+    }
+  } else if (!shape_name && !timeline.has_shape_events()) {
+    shape = MACRO_OSC_SHAPE_CSAW;
+  }
+
+  char file_name[256];
+  clock_t start = clock();
+  uint32_t num_renders = 0;
+  if (all_shapes) {
+    for (int32_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+      snprintf(file_name, sizeof(file_name), "%s_%02d_%s.wav",
+          output, i, macro_shape_names[i]);
+      if (!Render(timeline, static_cast<MacroOscillatorShape>(i),
+                  file_name)) {
+        return 1;
+      }
+      ++num_renders;
+    }
+  } else {
+    snprintf(file_name, sizeof(file_name), "%s.wav", output);
+    if (!Render(timeline, shape, file_name)) {
+      return 1;
+    }
+    ++num_renders;
+  }
+  double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  double audio = static_cast<double>(timeline.duration()) * num_renders /
+      kTimelineSampleRate;
+  fprintf(stderr, "Rendered %.1fs of audio in %.2fs (%.0fx realtime)\n",
+      audio, elapsed, elapsed > 0.0 ? audio / elapsed : 0.0);
+  return 0;
+}
@@ -0,0 +1,348 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Per-shape benchmark of the analog and digital oscillators.
+//
+// Every AnalogOscillatorShape and DigitalOscillatorShape is rendered in
+// 24-sample blocks over a sweep of pitches and parameters. For each shape,
+// the average time per sample and the worst block time are reported, the
+// latter also as a fraction of the 250us block deadline at 96kHz (a host
+// figure, to be read relative to the other shapes).
+//
+// Usage:
+//   oscillator_benchmark [-b baseline.txt] [-w baseline.txt] [-t percent]
+//
+// -w stores the results as a baseline ; -b compares against a stored
+// baseline and exits with an error when a shape got slower by more than the
+// threshold (10% by default).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "braids/analog_oscillator.h"
+#include "braids/digital_oscillator.h"
+
+using namespace braids;
+using namespace stmlib;
+
+const size_t kBlockSize = 24;
+const uint32_t kSampleRate = 96000;
+const size_t kNumBlocksPerSetting = 256;
+const size_t kNumRuns = 3;
+
+const int16_t pitches[] = { 24 << 7, 48 << 7, 72 << 7, 96 << 7, 120 << 7 };
+const int16_t parameters[] = { 0, 16384, 32767 };
+
+const char* const analog_shape_names[] = {
+  "saw",
+  "csaw",
+  "square",
+  "triangle",
+  "sine",
+  "triangle_fold",
+  "sine_fold",
+  "buzz"
+};
+
+const size_t kNumAnalogShapes = OSC_SHAPE_BUZZ + 1;
+
+// In the order of DigitalOscillator::fn_table_, which follows the macro
+// oscillator shapes rather than the DigitalOscillatorShape enum.
+const char* const digital_shape_names[] = {
+  "triple_ring_mod",
+  "saw_swarm",
+  "comb_filter",
+  "toy",
+  "digital_filter_lp",
+  "digital_filter_pk",
+  "digital_filter_bp",
+  "digital_filter_hp",
+  "vosim",
+  "vowel",
+  "vowel_fof",
+  "fm",
+  "feedback_fm",
+  "chaotic_feedback_fm",
+  "plucked",
+  "bowed",
+  "blown",
+  "fluted",
+  "struck_bell",
+  "struck_drum",
+  "kick",
+  "cymbal",
+  "snare",
+  "wavetables",
+  "wave_map",
+  "wave_line",
+  "wave_paraphonic",
+  "clocked_noise",
+  "granular_cloud",
+  "bytebeat0",
+  "bytebeat1",
+  "bytebeat2",
+  "bytebeat3",
+  "silence"
+};
+
+const size_t kNumDigitalShapes = OSC_SHAPE_QUESTION_MARK_LAST;
+
+const size_t kMaxNumResults = kNumAnalogShapes + kNumDigitalShapes;
+
+struct BenchmarkResult {
+  char name[32];
+  double ns_per_sample;
+  double worst_block_ns;
+};
+
+BenchmarkResult results[kMaxNumResults];
+size_t num_results;
+
+BenchmarkResult baseline[kMaxNumResults];
+size_t num_baseline_results;
+
+static inline double Now() {
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+// The oscillators are large (the digital one carries its delay lines), so they
+// are kept out of the stack.
+AnalogOscillator analog_oscillator;
+DigitalOscillator digital_oscillator;
+
+// Renders one block with the shape under test.
+template<typename Oscillator>
+struct Renderer { };
+
+template<>
+struct Renderer<AnalogOscillator> {
+  static inline void Configure(
+      AnalogOscillator* osc, int shape, int16_t pitch, int16_t p1, int16_t p2) {
+    osc->set_shape(static_cast<AnalogOscillatorShape>(shape));
+    osc->set_pitch(pitch);
+    osc->set_parameter(p1);
+    osc->set_aux_parameter(p2);
+  }
+  static inline void Strike(AnalogOscillator* osc) {
+    osc->Init();
+  }
+  static inline void Render(
+      AnalogOscillator* osc, const uint8_t* sync, int16_t* buffer) {
+    osc->Render(sync, buffer, NULL, kBlockSize);
+  }
+};
+
+template<>
+struct Renderer<DigitalOscillator> {
+  static inline void Configure(
+      DigitalOscillator* osc, int shape, int16_t pitch, int16_t p1, int16_t p2) {
+    osc->set_shape(static_cast<DigitalOscillatorShape>(shape));
+    osc->set_pitch(pitch);
+    osc->set_parameters(p1, p2);
+  }
+  static inline void Strike(DigitalOscillator* osc) {
+    osc->Strike();
+  }
+  static inline void Render(
+      DigitalOscillator* osc, const uint8_t* sync, int16_t* buffer) {
+    osc->Render(sync, buffer, kBlockSize);
+  }
+};
+
+template<typename Oscillator>
+void Benchmark(Oscillator* osc, int shape, const char* name) {
+  typedef Renderer<Oscillator> R;
+  uint8_t sync[kBlockSize];
+  int16_t buffer[kBlockSize];
+  memset(sync, 0, sizeof(sync));
+
+  // Keep the best of several runs, both for the average and for the worst
+  // block, so that a single preemption by the host OS does not show up as a
+  // deadline miss.
+  double best_total = 0.0;
+  double worst_block = 0.0;
+  size_t num_samples = 0;
+  int32_t checksum = 0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    osc->Init();
+    double total = 0.0;
+    double run_worst_block = 0.0;
+    num_samples = 0;
+    for (size_t i = 0; i < sizeof(pitches) / sizeof(int16_t); ++i) {
+      for (size_t j = 0; j < sizeof(parameters) / sizeof(int16_t); ++j) {
+        for (size_t k = 0; k < sizeof(parameters) / sizeof(int16_t); ++k) {
+          R::Configure(osc, shape, pitches[i], parameters[j], parameters[k]);
+          R::Strike(osc);
+          for (size_t n = 0; n < kNumBlocksPerSetting; ++n) {
+            double start = Now();
+            R::Render(osc, sync, buffer);
+            double elapsed = Now() - start;
+            total += elapsed;
+            if (elapsed > run_worst_block) {
+              run_worst_block = elapsed;
+            }
+            checksum += buffer[n % kBlockSize];
+            num_samples += kBlockSize;
+          }
+        }
+      }
+    }
+    if (run == 0 || total < best_total) {
+      best_total = total;
+    }
+    if (run == 0 || run_worst_block < worst_block) {
+      worst_block = run_worst_block;
+    }
+  }
+
+  BenchmarkResult* r = &results[num_results++];
+  strncpy(r->name, name, sizeof(r->name) - 1);
+  r->name[sizeof(r->name) - 1] = '\0';
+  r->ns_per_sample = best_total / num_samples;
+  r->worst_block_ns = worst_block;
+
+  // The checksum only prevents the compiler from discarding the renders.
+  if (checksum == 0x7fffffff) {
+    fprintf(stderr, "!");
+  }
+}
+
+bool LoadBaseline(const char* file_name) {
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", file_name);
+    return false;
+  }
+  char line[256];
+  num_baseline_results = 0;
+  while (fgets(line, sizeof(line), fp) &&
+         num_baseline_results < kMaxNumResults) {
+    if (line[0] == '#') {
+      continue;
+    }
+    BenchmarkResult* r = &baseline[num_baseline_results];
+    if (sscanf(line, "%31s %lf %lf",
+               r->name, &r->ns_per_sample, &r->worst_block_ns) == 3) {
+      ++num_baseline_results;
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+bool SaveBaseline(const char* file_name) {
+  FILE* fp = fopen(file_name, "w");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", file_name);
+    return false;
+  }
+  fprintf(fp, "# shape ns_per_sample worst_block_ns\n");
+  for (size_t i = 0; i < num_results; ++i) {
+    fprintf(fp, "%s %.3f %.1f\n", results[i].name,
+        results[i].ns_per_sample, results[i].worst_block_ns);
+  }
+  fclose(fp);
+  return true;
+}
+
+const BenchmarkResult* FindBaseline(const char* name) {
+  for (size_t i = 0; i < num_baseline_results; ++i) {
+    if (!strcmp(baseline[i].name, name)) {
+      return &baseline[i];
+    }
+  }
+  return NULL;
+}
+
+int main(int argc, char** argv) {
+  const char* baseline_file = NULL;
+  const char* output_file = NULL;
+  double threshold = 10.0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-b")) {
+      baseline_file = argv[++i];
+    } else if (i + 1 < argc && !strcmp(argv[i], "-w")) {
+      output_file = argv[++i];
+    } else if (i + 1 < argc && !strcmp(argv[i], "-t")) {
+      threshold = atof(argv[++i]);
+    } else {
+      fprintf(stderr,
+          "Usage: %s [-b baseline.txt] [-w baseline.txt] [-t percent]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (baseline_file && !LoadBaseline(baseline_file)) {
+    return 1;
+  }
+
+  char name[32];
+  for (size_t i = 0; i < kNumAnalogShapes; ++i) {
+    snprintf(name, sizeof(name), "analog/%s", analog_shape_names[i]);
+    Benchmark(&analog_oscillator, i, name);
+  }
+  for (size_t i = 0; i < kNumDigitalShapes; ++i) {
+    snprintf(name, sizeof(name), "digital/%s", digital_shape_names[i]);
+    Benchmark(&digital_oscillator, i, name);
+  }
+
+  const double kBlockDeadlineNs = 1e9 * kBlockSize / kSampleRate;
+  size_t num_regressions = 0;
+  printf("%-30s %10s %12s %8s", "shape", "ns/sample", "worst block", "budget");
+  printf(baseline_file ? " %9s\n" : "\n", "vs base");
+  for (size_t i = 0; i < num_results; ++i) {
+    const BenchmarkResult& r = results[i];
+    printf("%-30s %10.2f %10.0fns %7.2f%%", r.name, r.ns_per_sample,
+        r.worst_block_ns, 100.0 * r.worst_block_ns / kBlockDeadlineNs);
+    if (baseline_file) {
+      const BenchmarkResult* b = FindBaseline(r.name);
+      if (b && b->ns_per_sample > 0.0) {
+        double change = 100.0 * (r.ns_per_sample / b->ns_per_sample - 1.0);
+        bool regression = change > threshold;
+        num_regressions += regression ? 1 : 0;
+        printf(" %+8.1f%%%s", change, regression ? " REGRESSION" : "");
+      } else {
+        printf(" %9s", "new");
+      }
+    }
+    printf("\n");
+  }
+
+  if (output_file && !SaveBaseline(output_file)) {
+    return 1;
+  }
+  if (num_regressions) {
+    printf("%zu shape(s) slower than the baseline by more than %.1f%%\n",
+        num_regressions, threshold);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Quality / CPU table of the oversampled digital shapes.
+//
+// Usage:
+//   oversampling_benchmark [-n midi_note] [-p parameter_1 parameter_2]
+//
+// For each shape that supports oversampling, and for each ratio and filter,
+// prints the render time relative to 1x, and the energy outside of the
+// harmonics of the note (aliasing), relative to the total energy. The latter
+// is not meaningful for the noise shapes, or with detuned saw swarms.
+//
+// Oversampling is only compiled in with BRAIDS_OVERSAMPLING: build with
+// DEFINES=-DBRAIDS_OVERSAMPLING (see braids/test/makefile).
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "braids/digital_oscillator.h"
+
+#ifndef BRAIDS_OVERSAMPLING
+#error "oversampling_benchmark needs DEFINES=-DBRAIDS_OVERSAMPLING"
+#endif  // BRAIDS_OVERSAMPLING
+#include "braids/test/fft.h"
+#include "braids/test/timeline.h"
+
+using namespace braids;
+using namespace stmlib;
+
+const size_t kBlockSize = 24;
+const uint32_t kSampleRate = 96000;
+const size_t kFftSize = 16384;
+const size_t kNumSettleBlocks = 400;
+const size_t kNumTimingBlocks = 4000;
+const size_t kNumRuns = 5;
+
+struct OversamplingSetting {
+  const char* name;
+  OversamplingRatio ratio;
+  OversamplingFilter filter;
+};
+
+const OversamplingSetting oversampling_settings[] = {
+  { "1x", OVERSAMPLING_1X, OVERSAMPLING_FILTER_FAST },
+  { "2x fast", OVERSAMPLING_2X, OVERSAMPLING_FILTER_FAST },
+  { "2x hq", OVERSAMPLING_2X, OVERSAMPLING_FILTER_HIGH_QUALITY },
+  { "4x fast", OVERSAMPLING_4X, OVERSAMPLING_FILTER_FAST },
+  { "4x hq", OVERSAMPLING_4X, OVERSAMPLING_FILTER_HIGH_QUALITY },
+};
+
+const size_t kNumSettings = \
+    sizeof(oversampling_settings) / sizeof(OversamplingSetting);
+
+DigitalOscillator osc;
+int16_t samples[kFftSize];
+double re[kFftSize];
+double im[kFftSize];
+
+int16_t parameter[2] = { 8192, 16384 };
+
+void Configure(
+    size_t shape,
+    const OversamplingSetting& setting,
+    int16_t pitch) {
+  osc.Init();
+  osc.set_shape(static_cast<DigitalOscillatorShape>(shape));
+  osc.set_oversampling(setting.ratio, setting.filter);
+  osc.set_parameters(parameter[0], parameter[1]);
+  osc.set_pitch(pitch);
+  osc.Strike();
+}
+
+// Fraction of the energy, in dB, which is not within a few bins of a
+// harmonic of the fundamental.
+double InharmonicEnergy(double frequency) {
+  for (size_t i = 0; i < kFftSize; ++i) {
+    re[i] = samples[i] * BlackmanHarris(i, kFftSize);
+    im[i] = 0.0;
+  }
+  Fft(re, im, kFftSize);
+  double bin_width = static_cast<double>(kSampleRate) / kFftSize;
+  double harmonic = 0.0;
+  double inharmonic = 0.0;
+  for (size_t i = 4; i < kFftSize / 2; ++i) {
+    double f = i * bin_width;
+    double k = floor(f / frequency + 0.5);
+    double energy = re[i] * re[i] + im[i] * im[i];
+    if (k >= 1.0 && fabs(f - k * frequency) <= 4.0 * bin_width) {
+      harmonic += energy;
+    } else {
+      inharmonic += energy;
+    }
+  }
+  return 10.0 * log10((inharmonic + 1e-9) / (harmonic + inharmonic + 1e-9));
+}
+
+double Measure(
+    size_t shape,
+    const OversamplingSetting& setting,
+    int16_t pitch) {
+  uint8_t sync[kBlockSize];
+  memset(sync, 0, sizeof(sync));
+  Configure(shape, setting, pitch);
+  for (size_t i = 0; i < kNumSettleBlocks; ++i) {
+    osc.Render(sync, samples, kBlockSize);
+  }
+  for (size_t i = 0; i < kFftSize; i += kBlockSize) {
+    int16_t block[kBlockSize];
+    osc.Render(sync, block, kBlockSize);
+    size_t n = kFftSize - i < kBlockSize ? kFftSize - i : kBlockSize;
+    memcpy(&samples[i], block, n * sizeof(int16_t));
+  }
+  return InharmonicEnergy(
+      static_cast<double>(osc.phase_increment() << setting.ratio) /
+      4294967296.0 * kSampleRate);
+}
+
+// Best of several runs, in ns per sample.
+double Time(
+    size_t shape,
+    const OversamplingSetting& setting,
+    int16_t pitch) {
+  uint8_t sync[kBlockSize];
+  int16_t block[kBlockSize];
+  memset(sync, 0, sizeof(sync));
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    Configure(shape, setting, pitch);
+    clock_t start = clock();
+    for (size_t i = 0; i < kNumTimingBlocks; ++i) {
+      osc.Render(sync, block, kBlockSize);
+      checksum += block[i % kBlockSize];
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best * 1e9 / (kNumTimingBlocks * kBlockSize);
+}
+
+int main(int argc, char** argv) {
+  int16_t note = 96;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-n")) {
+      note = atoi(argv[++i]);
+    } else if (i + 2 < argc && !strcmp(argv[i], "-p")) {
+      parameter[0] = atoi(argv[++i]);
+      parameter[1] = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [-n midi_note] [-p parameter_1 parameter_2]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  int16_t pitch = note << 7;
+
+  printf("Note %d, parameters %d %d.\n", note, parameter[0], parameter[1]);
+  printf("CPU relative to 1x, inharmonic energy in dB.\n\n");
+  printf("%-22s", "shape");
+  for (size_t i = 0; i < kNumSettings; ++i) {
+    printf(" %15s", oversampling_settings[i].name);
+  }
+  printf("\n");
+
+  for (size_t shape = 0; shape < OSC_SHAPE_QUESTION_MARK_LAST; ++shape) {
+    OversamplingRatio max_ratio = DigitalOscillator::max_oversampling(
+        static_cast<DigitalOscillatorShape>(shape));
+    if (max_ratio == OVERSAMPLING_1X) {
+      continue;
+    }
+    printf("%-22s",
+        macro_shape_names[MACRO_OSC_SHAPE_TRIPLE_RING_MOD + shape]);
+    double reference = 0.0;
+    for (size_t i = 0; i < kNumSettings; ++i) {
+      if (oversampling_settings[i].ratio > max_ratio) {
+        printf(" %15s", "-");
+        continue;
+      }
+      double t = Time(shape, oversampling_settings[i], pitch);
+      double aliasing = Measure(shape, oversampling_settings[i], pitch);
+      if (i == 0) {
+        reference = t;
+      }
+      printf("   %4.1fx %6.1fdB", reference > 0.0 ? t / reference : 0.0,
+          aliasing);
+    }
+    printf("\n");
+  }
+  return 0;
+}
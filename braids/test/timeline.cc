@@ -0,0 +1,391 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Parameter timeline for host-side rendering of the macro oscillator.
+
+#include "braids/test/timeline.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace braids {
+
+using namespace std;
+
+const char* const macro_shape_names[] = {
+  "csaw",
+  "morph",
+  "saw_square",
+  "square_sync",
+  "sine_triangle",
+  "buzz",
+  "triple_saw",
+  "triple_square",
+  "triple_triangle",
+  "triple_sine",
+  "triple_ring_mod",
+  "saw_swarm",
+  "saw_comb",
+  "toy",
+  "digital_filter_lp",
+  "digital_filter_pk",
+  "digital_filter_bp",
+  "digital_filter_hp",
+  "vosim",
+  "vowel",
+  "vowel_fof",
+  "fm",
+  "feedback_fm",
+  "chaotic_feedback_fm",
+  "plucked",
+  "bowed",
+  "blown",
+  "fluted",
+  "struck_bell",
+  "struck_drum",
+  "kick",
+  "cymbal",
+  "snare",
+  "wavetables",
+  "wave_map",
+  "wave_line",
+  "wave_paraphonic",
+  "clocked_noise",
+  "granular_cloud",
+  "bytebeat0",
+  "bytebeat1",
+  "bytebeat2",
+  "bytebeat3",
+  "silence",
+  NULL
+};
+
+MacroOscillatorShape ParseShapeName(const char* name) {
+  for (int32_t i = 0; i < MACRO_OSC_SHAPE_LAST; ++i) {
+    if (!strcmp(name, macro_shape_names[i])) {
+      return static_cast<MacroOscillatorShape>(i);
+    }
+  }
+  char* end;
+  long index = strtol(name, &end, 10);
+  if (*end == '\0' && end != name && index >= 0 &&
+      index < MACRO_OSC_SHAPE_LAST) {
+    return static_cast<MacroOscillatorShape>(index);
+  }
+  return MACRO_OSC_SHAPE_LAST;
+}
+
+static bool ParseTime(const char* token, uint32_t* time) {
+  char* end;
+  double value = strtod(token, &end);
+  if (end == token || value < 0.0) {
+    return false;
+  }
+  if (*end == 's' && end[1] == '\0') {
+    value *= kTimelineSampleRate;
+  } else if (*end != '\0') {
+    return false;
+  }
+  *time = static_cast<uint32_t>(value);
+  return true;
+}
+
+static bool ParseValue(const char* token, int32_t* value) {
+  if (!token) {
+    return false;
+  }
+  char* end;
+  *value = strtol(token, &end, 0);
+  return end != token && *end == '\0';
+}
+
+static bool TimelineEventLessThan(
+    const TimelineEvent& a,
+    const TimelineEvent& b) {
+  return a.time < b.time;
+}
+
+void Timeline::Init() {
+  events_.clear();
+  duration_ = 0;
+  has_shape_events_ = false;
+}
+
+void Timeline::AddEvent(
+    uint32_t time,
+    TimelineEventType type,
+    int32_t value,
+    int32_t period) {
+  TimelineEvent e;
+  e.time = time;
+  e.type = type;
+  e.value = value;
+  e.period = period;
+  events_.push_back(e);
+  if (type == TIMELINE_EVENT_SHAPE) {
+    has_shape_events_ = true;
+  }
+}
+
+void Timeline::Finalize() {
+  // Stable, so that events sharing a time stamp keep the file order.
+  stable_sort(events_.begin(), events_.end(), TimelineEventLessThan);
+  duration_ = 0;
+  for (size_t i = 0; i < events_.size(); ++i) {
+    const TimelineEvent& e = events_[i];
+    uint32_t end = e.time;
+    if (e.type == TIMELINE_EVENT_SYNC) {
+      end += e.value * e.period;
+    }
+    if (e.type == TIMELINE_EVENT_END) {
+      duration_ = e.time;
+      break;
+    }
+    duration_ = max(duration_, end);
+  }
+}
+
+bool Timeline::ParseLine(char* line) {
+  char* comment = strchr(line, '#');
+  if (comment) {
+    *comment = '\0';
+  }
+  const char* separators = " \t\r\n";
+  char* time_token = strtok(line, separators);
+  if (!time_token) {
+    return true;
+  }
+  char* event_token = strtok(NULL, separators);
+  char* arg_1 = strtok(NULL, separators);
+  char* arg_2 = strtok(NULL, separators);
+
+  uint32_t time;
+  if (!ParseTime(time_token, &time) || !event_token) {
+    return false;
+  }
+
+  int32_t value = 0;
+  int32_t period = 0;
+  if (!strcmp(event_token, "shape")) {
+    MacroOscillatorShape shape = arg_1
+        ? ParseShapeName(arg_1)
+        : MACRO_OSC_SHAPE_LAST;
+    if (shape == MACRO_OSC_SHAPE_LAST) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_SHAPE, shape, 0);
+  } else if (!strcmp(event_token, "pitch")) {
+    if (!ParseValue(arg_1, &value)) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_PITCH, value, 0);
+  } else if (!strcmp(event_token, "note")) {
+    if (!ParseValue(arg_1, &value)) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_PITCH, value << 7, 0);
+  } else if (!strcmp(event_token, "parameters")) {
+    if (!ParseValue(arg_1, &value) || !ParseValue(arg_2, &period)) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_PARAMETER_1, value, 0);
+    AddEvent(time, TIMELINE_EVENT_PARAMETER_2, period, 0);
+  } else if (!strcmp(event_token, "timbre")) {
+    if (!ParseValue(arg_1, &value)) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_PARAMETER_1, value, 0);
+  } else if (!strcmp(event_token, "color")) {
+    if (!ParseValue(arg_1, &value)) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_PARAMETER_2, value, 0);
+  } else if (!strcmp(event_token, "strike")) {
+    AddEvent(time, TIMELINE_EVENT_STRIKE, 0, 0);
+  } else if (!strcmp(event_token, "sync")) {
+    value = 1;
+    period = 1;
+    if (arg_1 && !ParseValue(arg_1, &value)) {
+      return false;
+    }
+    if (arg_2 && !ParseValue(arg_2, &period)) {
+      return false;
+    }
+    if (value < 1 || period < 1) {
+      return false;
+    }
+    AddEvent(time, TIMELINE_EVENT_SYNC, value, period);
+  } else if (!strcmp(event_token, "end")) {
+    AddEvent(time, TIMELINE_EVENT_END, 0, 0);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Timeline::Load(const char* file_name) {
+  Init();
+  FILE* fp = fopen(file_name, "r");
+  if (!fp) {
+    fprintf(stderr, "Cannot open %s\n", file_name);
+    return false;
+  }
+  char line[256];
+  char copy[256];
+  uint32_t line_number = 0;
+  bool success = true;
+  while (fgets(line, sizeof(line), fp)) {
+    ++line_number;
+    strcpy(copy, line);
+    if (!ParseLine(line)) {
+      fprintf(stderr, "%s:%u: cannot parse: %s",
+          file_name, line_number, copy);
+      success = false;
+      break;
+    }
+  }
+  fclose(fp);
+  Finalize();
+  return success;
+}
+
+void Timeline::InitDefault(uint32_t duration) {
+  Init();
+  AddEvent(0, TIMELINE_EVENT_PITCH, 48 << 7, 0);
+  AddEvent(0, TIMELINE_EVENT_PARAMETER_1, 0, 0);
+  AddEvent(0, TIMELINE_EVENT_PARAMETER_2, 16384, 0);
+  AddEvent(0, TIMELINE_EVENT_STRIKE, 0, 0);
+
+  // Timbre ramps up and back down, one step every 10ms ; the pitch climbs
+  // by a fifth every quarter of the render ; strikes every 250ms.
+  const uint32_t kStep = kTimelineSampleRate / 100;
+  uint32_t num_steps = duration / kStep;
+  for (uint32_t i = 1; i < num_steps; ++i) {
+    int32_t ramp = i * 65535 / num_steps;
+    int32_t tri = ramp > 32767 ? 65535 - ramp : ramp;
+    AddEvent(i * kStep, TIMELINE_EVENT_PARAMETER_1, tri, 0);
+    if ((i % 25) == 0) {
+      AddEvent(i * kStep, TIMELINE_EVENT_STRIKE, 0, 0);
+    }
+    if ((i % (num_steps / 4 + 1)) == 0) {
+      AddEvent(i * kStep, TIMELINE_EVENT_PITCH,
+          (48 << 7) + (i / (num_steps / 4 + 1)) * (7 << 7), 0);
+    }
+  }
+  AddEvent(duration, TIMELINE_EVENT_END, 0, 0);
+  Finalize();
+}
+
+void TimelinePlayer::Init(
+    const Timeline* timeline,
+    MacroOscillator* osc,
+    MacroOscillatorShape shape_override) {
+  timeline_ = timeline;
+  osc_ = osc;
+  shape_override_ = shape_override;
+  next_event_ = 0;
+  time_ = 0;
+  parameter_[0] = 0;
+  parameter_[1] = 0;
+  next_sync_ = 0;
+  sync_count_ = 0;
+  sync_period_ = 1;
+
+  osc_->Init();
+  osc_->set_shape(shape_override == MACRO_OSC_SHAPE_LAST
+      ? MACRO_OSC_SHAPE_CSAW
+      : shape_override);
+  osc_->set_pitch(60 << 7);
+  osc_->set_parameters(0, 0);
+}
+
+void TimelinePlayer::Apply(const TimelineEvent& e) {
+  switch (e.type) {
+    case TIMELINE_EVENT_SHAPE:
+      if (shape_override_ == MACRO_OSC_SHAPE_LAST) {
+        osc_->set_shape(static_cast<MacroOscillatorShape>(e.value));
+      }
+      break;
+
+    case TIMELINE_EVENT_PITCH:
+      osc_->set_pitch(e.value);
+      break;
+
+    case TIMELINE_EVENT_PARAMETER_1:
+      parameter_[0] = e.value;
+      osc_->set_parameters(parameter_[0], parameter_[1]);
+      break;
+
+    case TIMELINE_EVENT_PARAMETER_2:
+      parameter_[1] = e.value;
+      osc_->set_parameters(parameter_[0], parameter_[1]);
+      break;
+
+    case TIMELINE_EVENT_STRIKE:
+      osc_->Strike();
+      break;
+
+    case TIMELINE_EVENT_SYNC:
+      next_sync_ = e.time;
+      sync_count_ = e.value;
+      sync_period_ = e.period;
+      break;
+
+    case TIMELINE_EVENT_END:
+      break;
+  }
+}
+
+size_t TimelinePlayer::Render(int16_t* buffer) {
+  uint32_t duration = timeline_->duration();
+  if (time_ >= duration) {
+    return 0;
+  }
+  uint32_t block_end = time_ + kTimelineBlockSize;
+  while (next_event_ < timeline_->num_events() &&
+         timeline_->event(next_event_).time < block_end) {
+    Apply(timeline_->event(next_event_));
+    ++next_event_;
+  }
+
+  memset(sync_buffer_, 0, sizeof(sync_buffer_));
+  while (sync_count_ && next_sync_ < block_end) {
+    if (next_sync_ >= time_) {
+      sync_buffer_[next_sync_ - time_] = 1;
+    }
+    next_sync_ += sync_period_;
+    --sync_count_;
+  }
+
+  osc_->Render(sync_buffer_, buffer, kTimelineBlockSize);
+  size_t rendered = min(duration - time_, block_end - time_);
+  time_ = block_end;
+  return rendered;
+}
+
+}  // namespace braids
@@ -0,0 +1,173 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Parameter timeline for host-side rendering of the macro oscillator.
+//
+// A timeline is a text file with one event per line:
+//
+//   <time> <event> [<value> [<value>]]
+//
+// <time> is a sample position at 96kHz, or a number of seconds when suffixed
+// with "s" (eg. 1.5s). Events are:
+//
+//   shape <name or index>   select a MacroOscillatorShape (eg. csaw, fm)
+//   pitch <value>           raw pitch, in 1/128th of semitone
+//   note <value>            MIDI note number
+//   parameters <p1> <p2>    set both parameters (0 .. 32767)
+//   timbre <p1>             set parameter 1
+//   color <p2>              set parameter 2
+//   strike                  retrigger the oscillator
+//   sync <count> <period>   hardsync pulses, every <period> samples
+//   end                     end of the render
+//
+// Lines starting with '#' are ignored. Events are applied at the beginning of
+// the 24-sample block containing their time stamp, as they would be by the
+// firmware ; sync pulses are sample-accurate.
+
+#ifndef BRAIDS_TEST_TIMELINE_H_
+#define BRAIDS_TEST_TIMELINE_H_
+
+#include "stmlib/stmlib.h"
+
+#include <vector>
+
+#include "braids/macro_oscillator.h"
+#include "braids/settings.h"
+
+namespace braids {
+
+const uint32_t kTimelineSampleRate = 96000;
+const size_t kTimelineBlockSize = 24;
+
+enum TimelineEventType {
+  TIMELINE_EVENT_SHAPE,
+  TIMELINE_EVENT_PITCH,
+  TIMELINE_EVENT_PARAMETER_1,
+  TIMELINE_EVENT_PARAMETER_2,
+  TIMELINE_EVENT_STRIKE,
+  TIMELINE_EVENT_SYNC,
+  TIMELINE_EVENT_END
+};
+
+struct TimelineEvent {
+  uint32_t time;
+  TimelineEventType type;
+  int32_t value;
+  int32_t period;
+};
+
+extern const char* const macro_shape_names[];
+
+// Returns MACRO_OSC_SHAPE_LAST when the name (or index) is not recognized.
+MacroOscillatorShape ParseShapeName(const char* name);
+
+class Timeline {
+ public:
+  Timeline() { }
+  ~Timeline() { }
+
+  void Init();
+
+  // Parses a timeline file. Returns false and prints the offending line on
+  // error.
+  bool Load(const char* file_name);
+
+  // A simple stimulus (pitch sweep, parameter ramps, periodic strikes) used
+  // when no timeline file is given.
+  void InitDefault(uint32_t duration);
+
+  void AddEvent(
+      uint32_t time,
+      TimelineEventType type,
+      int32_t value,
+      int32_t period);
+
+  // Sorts the events by time and computes the duration. Must be called once
+  // all events have been added.
+  void Finalize();
+
+  inline uint32_t duration() const { return duration_; }
+  inline size_t num_events() const { return events_.size(); }
+  inline const TimelineEvent& event(size_t index) const {
+    return events_[index];
+  }
+  inline bool has_shape_events() const { return has_shape_events_; }
+
+ private:
+  bool ParseLine(char* line);
+
+  std::vector<TimelineEvent> events_;
+  uint32_t duration_;
+  bool has_shape_events_;
+
+  DISALLOW_COPY_AND_ASSIGN(Timeline);
+};
+
+// Walks a timeline and drives a MacroOscillator, one block at a time.
+class TimelinePlayer {
+ public:
+  TimelinePlayer() { }
+  ~TimelinePlayer() { }
+
+  // When shape_override is not MACRO_OSC_SHAPE_LAST, shape events are
+  // ignored and this shape is used for the whole render.
+  void Init(
+      const Timeline* timeline,
+      MacroOscillator* osc,
+      MacroOscillatorShape shape_override);
+
+  // Applies all events falling in the next block, then renders
+  // kTimelineBlockSize samples. Returns the number of samples that belong to
+  // the timeline (less than a block at the end), 0 once it is over.
+  size_t Render(int16_t* buffer);
+
+  inline uint32_t time() const { return time_; }
+
+ private:
+  void Apply(const TimelineEvent& e);
+
+  const Timeline* timeline_;
+  MacroOscillator* osc_;
+  MacroOscillatorShape shape_override_;
+
+  size_t next_event_;
+  uint32_t time_;
+
+  int16_t parameter_[2];
+
+  // Pending sync pulse train.
+  uint32_t next_sync_;
+  int32_t sync_count_;
+  int32_t sync_period_;
+
+  uint8_t sync_buffer_[kTimelineBlockSize];
+
+  DISALLOW_COPY_AND_ASSIGN(TimelinePlayer);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_TEST_TIMELINE_H_
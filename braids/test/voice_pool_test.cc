@@ -0,0 +1,232 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Polyphonic voice pool: memory footprint and rendering speed.
+//
+// Usage:
+//   voice_pool_test [-s shape] [-d seconds]
+//
+// Plays dense chords (more notes than voices, to exercise voice stealing) for
+// 16, 32 and 64 voices, writes the 16-voice render to poly.wav, and reports
+// the memory per voice and the number of voices one core can render in real
+// time.
+//
+// Built with -DBRAIDS_SHARED_DELAY_LINES, the voices share a pool of delay
+// lines, enough for a quarter of them to play a comb filter or physical
+// model at the same time. A first check plays more plucked notes, one after
+// the other, than there are delay lines, and fails if the lines of the notes
+// which have died out are not reused.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "stmlib/test/wav_writer.h"
+
+#include "braids/voice_pool.h"
+#include "braids/test/timeline.h"
+
+using namespace braids;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 96000;
+const size_t kMaxVoices = 64;
+const size_t kRenderChunk = kVoicePoolBlockSize * 40;  // 10ms.
+
+const uint8_t chord_roots[] = { 36, 41, 43, 38 };
+const uint8_t chord_intervals[] = { 0, 7, 12, 16, 19, 24, 28, 31 };
+
+VoicePool<kMaxVoices> pool;
+
+#ifdef BRAIDS_SHARED_DELAY_LINES
+const size_t kNumDelayLines = kMaxVoices / 4;
+DelayLines delay_lines[kNumDelayLines];
+DelayLinePool delay_line_pool;
+
+const size_t kNumReuseVoices = 8;
+const size_t kNumReuseDelayLines = 2;
+VoicePool<kNumReuseVoices> reuse_pool;
+DelayLines reuse_delay_lines[kNumReuseDelayLines];
+DelayLinePool reuse_delay_line_pool;
+
+bool CheckDelayLineReuse() {
+  reuse_delay_line_pool.Init(reuse_delay_lines, kNumReuseDelayLines);
+  reuse_pool.Init();
+  reuse_pool.set_delay_line_pool(&reuse_delay_line_pool);
+  reuse_pool.set_shape(MACRO_OSC_SHAPE_PLUCKED);
+  reuse_pool.set_parameters(12000, 20000);
+  reuse_pool.set_envelope(0, 20, 64, 10);
+
+  int16_t buffer[kRenderChunk];
+  for (size_t i = 0; i < kNumReuseVoices; ++i) {
+    uint8_t note = 48 + 5 * i;
+    reuse_pool.NoteOn(note, 127);
+    int32_t peak = 0;
+    for (size_t j = 0; j < 10; ++j) {
+      reuse_pool.Render(buffer, kRenderChunk);
+      for (size_t k = 0; k < kRenderChunk; ++k) {
+        peak = std::max(peak, static_cast<int32_t>(abs(buffer[k])));
+      }
+    }
+    reuse_pool.NoteOff(note);
+    // Let the release die out, for at most 2s.
+    for (size_t j = 0; j < 200 && reuse_pool.num_active_voices(); ++j) {
+      reuse_pool.Render(buffer, kRenderChunk);
+    }
+    if (peak == 0) {
+      printf("Delay line reuse: note %zu is silent, %zu active voices, "
+          "%zu free delay lines\n", i, reuse_pool.num_active_voices(),
+          reuse_delay_line_pool.num_free());
+      return false;
+    }
+    if (reuse_pool.num_active_voices() ||
+        reuse_delay_line_pool.num_free() != kNumReuseDelayLines) {
+      printf("Delay line reuse: %zu free delay lines after note %zu died "
+          "out\n", reuse_delay_line_pool.num_free(), i);
+      return false;
+    }
+  }
+  printf("Delay line reuse: %zu notes played with %zu delay lines.\n",
+      kNumReuseVoices, kNumReuseDelayLines);
+  return true;
+}
+#endif  // BRAIDS_SHARED_DELAY_LINES
+
+// Returns the time spent rendering, in seconds.
+double Play(
+    size_t num_voices,
+    MacroOscillatorShape shape,
+    uint32_t duration,
+    WavWriter* wav_writer,
+    size_t* max_active_voices) {
+  pool.Init();
+  pool.set_num_voices(num_voices);
+  pool.set_shape(shape);
+  pool.set_parameters(12000, 20000);
+  pool.set_mix_gain(65535 / 8);
+
+  // A new chord every 250ms, spread over several octaves, with 25% more
+  // notes than voices to force stealing.
+  const uint32_t kChordDuration = kSampleRate / 4;
+  int16_t buffer[kRenderChunk];
+  uint32_t chord_time = 0;
+  size_t chord = 0;
+  size_t num_held = 0;
+  uint8_t held[kMaxVoices * 2];
+
+  double elapsed = 0.0;
+  *max_active_voices = 0;
+  for (uint32_t t = 0; t < duration; t += kRenderChunk) {
+    if (t >= chord_time) {
+      for (size_t i = 0; i < num_held; ++i) {
+        pool.NoteOff(held[i]);
+      }
+      num_held = 0;
+      uint8_t root = chord_roots[chord % sizeof(chord_roots)];
+      for (size_t i = 0; i < num_voices + num_voices / 4; ++i) {
+        uint8_t note = root + chord_intervals[i % sizeof(chord_intervals)] +
+            12 * (i / sizeof(chord_intervals) % 5) + i / 40;
+        pool.NoteOn(note, 64 + (i * 37 % 64));
+        held[num_held++] = note;
+      }
+      ++chord;
+      chord_time += kChordDuration;
+    }
+
+    clock_t start = clock();
+    pool.Render(buffer, kRenderChunk);
+    elapsed += static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+
+    size_t active = pool.num_active_voices();
+    if (active > *max_active_voices) {
+      *max_active_voices = active;
+    }
+    if (wav_writer) {
+      wav_writer->WriteFrames(buffer, kRenderChunk);
+    }
+  }
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  MacroOscillatorShape shape = MACRO_OSC_SHAPE_CSAW;
+  uint32_t seconds = 4;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+      shape = ParseShapeName(argv[++i]);
+      if (shape == MACRO_OSC_SHAPE_LAST) {
+        fprintf(stderr, "Unknown shape: %s\n", argv[i]);
+        return 1;
+      }
+    } else if (i + 1 < argc && !strcmp(argv[i], "-d")) {
+      seconds = atoi(argv[++i]);
+    } else {
+      fprintf(stderr, "Usage: %s [-s shape] [-d seconds]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  // A whole number of seconds is also a whole number of chunks.
+  uint32_t duration = seconds * kSampleRate;
+
+  printf("Memory per voice: %zu bytes (oscillator: %zu bytes)\n",
+      VoicePool<kMaxVoices>::memory_per_voice(), sizeof(MacroOscillator));
+  printf("Shared memory: %zu bytes\n", VoicePool<kMaxVoices>::memory_shared());
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  if (!CheckDelayLineReuse()) {
+    return 1;
+  }
+  delay_line_pool.Init(delay_lines, kNumDelayLines);
+  pool.set_delay_line_pool(&delay_line_pool);
+  printf("Delay lines: %zu x %zu bytes\n", kNumDelayLines, sizeof(DelayLines));
+#endif  // BRAIDS_SHARED_DELAY_LINES
+  printf("Shape: %s\n\n", macro_shape_names[shape]);
+  printf("%8s %10s %12s %12s %14s\n",
+      "voices", "memory", "max active", "x realtime", "voices/core");
+
+  const size_t num_voices[] = { 16, 32, 64 };
+  for (size_t i = 0; i < sizeof(num_voices) / sizeof(size_t); ++i) {
+    size_t max_active;
+    double elapsed;
+    if (i == 0) {
+      WavWriter wav_writer(1, kSampleRate, seconds);
+      wav_writer.Open("poly.wav");
+      elapsed = Play(num_voices[i], shape, duration, &wav_writer, &max_active);
+    } else {
+      elapsed = Play(num_voices[i], shape, duration, NULL, &max_active);
+    }
+    double audio = static_cast<double>(duration) / kSampleRate;
+    double realtime = elapsed > 0.0 ? audio / elapsed : 0.0;
+    printf("%8zu %9zuk %12zu %11.1fx %14.0f\n",
+        num_voices[i],
+        num_voices[i] * VoicePool<kMaxVoices>::memory_per_voice() / 1024,
+        max_active,
+        realtime,
+        realtime * max_active);
+  }
+  return 0;
+}
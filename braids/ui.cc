@@ -268,6 +268,8 @@ void Ui::DoEvents() {
     }
     refresh_display_ = true;
   }
+  // Make the edits visible to RenderBlock.
+  settings.Publish();
   if (queue_.idle_time() > 1000) {
     refresh_display_ = true;
   }
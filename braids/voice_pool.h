@@ -0,0 +1,277 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Polyphonic engine: a pool of macro oscillators, each with its own amplitude
+// envelope, mixed into a single output.
+//
+// Each voice is rendered for several consecutive blocks before moving on to
+// the next one, so that its oscillator state (several kB) stays in cache while
+// it is being used, instead of cycling through all voices every 24 samples.
+// Voices whose envelope has died out are not rendered at all, and give their
+// delay lines, if any, back to the shared pool.
+
+#ifndef BRAIDS_VOICE_POOL_H_
+#define BRAIDS_VOICE_POOL_H_
+
+#include "stmlib/stmlib.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "stmlib/utils/dsp.h"
+
+#include "braids/envelope.h"
+#include "braids/macro_oscillator.h"
+#include "braids/settings.h"
+
+namespace braids {
+
+const size_t kVoicePoolBlockSize = 24;
+const size_t kVoicePoolBatchSize = 8;  // Blocks rendered in a row per voice.
+
+struct PoolVoice {
+  MacroOscillator osc;
+  Envelope envelope;
+  uint32_t age;  // Allocation stamp, for voice stealing.
+  uint8_t note;
+  uint8_t velocity;
+  bool gate;
+};
+
+template<size_t max_voices>
+class VoicePool {
+ public:
+  VoicePool() { }
+  ~VoicePool() { }
+
+  void Init() {
+    num_voices_ = max_voices;
+    clock_ = 0;
+    shape_ = MACRO_OSC_SHAPE_CSAW;
+    parameter_[0] = parameter_[1] = 0;
+    mix_gain_ = 65535 / 4;
+    memset(sync_buffer_, 0, sizeof(sync_buffer_));
+    for (size_t i = 0; i < max_voices; ++i) {
+      PoolVoice* v = &voice_[i];
+      v->osc.Init();
+      v->osc.set_shape(shape_);
+      v->envelope.Init();
+      v->envelope.Trigger(ENV_SEGMENT_DEAD);
+      v->age = 0;
+      v->note = 0;
+      v->velocity = 0;
+      v->gate = false;
+    }
+    set_envelope(0, 40, 96, 40);
+  }
+
+  inline void set_num_voices(size_t num_voices) {
+    num_voices_ = std::min(std::max(num_voices, static_cast<size_t>(1)),
+        max_voices);
+  }
+
+  inline void set_shape(MacroOscillatorShape shape) {
+    shape_ = shape;
+  }
+
+  inline void set_parameters(int16_t parameter_1, int16_t parameter_2) {
+    parameter_[0] = parameter_1;
+    parameter_[1] = parameter_2;
+  }
+
+  // Envelope times and sustain level, 0 .. 127.
+  inline void set_envelope(uint8_t a, uint8_t d, uint8_t s, uint8_t r) {
+    for (size_t i = 0; i < max_voices; ++i) {
+      voice_[i].envelope.Update(a, d, s, r, false, 0, 0);
+    }
+  }
+
+#ifdef BRAIDS_SHARED_DELAY_LINES
+  // Voices playing the comb filter or physical models take their delay lines
+  // from this pool, and are silent when it is exhausted. The lines are given
+  // back when the envelope of the voice dies, or when the voice is stolen.
+  inline void set_delay_line_pool(DelayLinePool* pool) {
+    for (size_t i = 0; i < max_voices; ++i) {
+      voice_[i].osc.set_delay_line_pool(pool);
+    }
+  }
+#endif  // BRAIDS_SHARED_DELAY_LINES
+
+  // Gain applied to the sum of all voices. Full-scale voices summed at unity
+  // gain clip quickly, hence a default of -12dB.
+  inline void set_mix_gain(uint16_t gain) {
+    mix_gain_ = gain;
+  }
+
+  // Returns the index of the voice allocated to the note.
+  size_t NoteOn(uint8_t note, uint8_t velocity) {
+    size_t index = FindVoiceToSteal(note);
+    PoolVoice* v = &voice_[index];
+    v->note = note;
+    v->velocity = velocity;
+    v->gate = true;
+    v->age = ++clock_;
+#ifdef BRAIDS_SHARED_DELAY_LINES
+    // The new note starts from cleared delay lines, and does not hold on to
+    // them if its shape does not need any.
+    v->osc.ReleaseDelayLines();
+#endif  // BRAIDS_SHARED_DELAY_LINES
+    v->osc.set_shape(shape_);
+    v->osc.Strike();
+    v->envelope.Trigger(ENV_SEGMENT_ATTACK);
+    return index;
+  }
+
+  void NoteOff(uint8_t note) {
+    for (size_t i = 0; i < num_voices_; ++i) {
+      PoolVoice* v = &voice_[i];
+      if (v->gate && v->note == note) {
+        v->gate = false;
+        v->envelope.Trigger(ENV_SEGMENT_RELEASE);
+      }
+    }
+  }
+
+  void AllNotesOff() {
+    for (size_t i = 0; i < num_voices_; ++i) {
+      if (voice_[i].gate) {
+        NoteOff(voice_[i].note);
+      }
+    }
+  }
+
+  // Renders and mixes all voices. size should be a multiple of
+  // kVoicePoolBlockSize: the oscillators always render whole blocks, and the
+  // end of a trailing partial block is dropped.
+  void Render(int16_t* out, size_t size) {
+    const size_t kBatchSamples = kVoicePoolBlockSize * kVoicePoolBatchSize;
+    while (size) {
+      size_t batch_size = std::min(size, kBatchSamples);
+      std::fill(&mix_[0], &mix_[batch_size], 0);
+      for (size_t i = 0; i < num_voices_; ++i) {
+        PoolVoice* v = &voice_[i];
+        if (v->envelope.segment() != ENV_SEGMENT_DEAD) {
+          RenderVoice(v, batch_size);
+#ifdef BRAIDS_SHARED_DELAY_LINES
+          if (v->envelope.segment() == ENV_SEGMENT_DEAD) {
+            v->osc.ReleaseDelayLines();
+          }
+#endif  // BRAIDS_SHARED_DELAY_LINES
+        }
+      }
+      int32_t gain = mix_gain_ >> 8;
+      for (size_t i = 0; i < batch_size; ++i) {
+        int32_t sample = (mix_[i] >> 8) * gain >> 8;
+        CLIP(sample)
+        out[i] = sample;
+      }
+      out += batch_size;
+      size -= batch_size;
+    }
+  }
+
+  size_t num_active_voices() const {
+    size_t n = 0;
+    for (size_t i = 0; i < num_voices_; ++i) {
+      n += voice_[i].envelope.segment() != ENV_SEGMENT_DEAD ? 1 : 0;
+    }
+    return n;
+  }
+
+  inline size_t num_voices() const { return num_voices_; }
+  inline const PoolVoice& voice(size_t index) const { return voice_[index]; }
+
+  static inline size_t memory_per_voice() { return sizeof(PoolVoice); }
+  static inline size_t memory_shared() {
+    return sizeof(VoicePool<max_voices>) - max_voices * sizeof(PoolVoice);
+  }
+
+ private:
+  size_t FindVoiceToSteal(uint8_t note) const {
+    // A voice already playing this note is retriggered.
+    for (size_t i = 0; i < num_voices_; ++i) {
+      if (voice_[i].gate && voice_[i].note == note) {
+        return i;
+      }
+    }
+    // Otherwise, prefer the oldest silent voice, then the oldest released
+    // voice, then the oldest held voice.
+    size_t best = 0;
+    uint32_t best_score = 0;
+    for (size_t i = 0; i < num_voices_; ++i) {
+      const PoolVoice& v = voice_[i];
+      uint32_t priority = v.envelope.segment() == ENV_SEGMENT_DEAD
+          ? 2 : (v.gate ? 0 : 1);
+      // Older voices have a smaller age, hence a larger score. The age
+      // difference is kept below 2^30, so that the priority always wins.
+      uint32_t elapsed = std::min(clock_ - v.age,
+          static_cast<uint32_t>(0x3fffffff));
+      uint32_t score = (priority << 30) | elapsed;
+      if (i == 0 || score > best_score) {
+        best = i;
+        best_score = score;
+      }
+    }
+    return best;
+  }
+
+  void RenderVoice(PoolVoice* v, size_t size) {
+    v->osc.set_pitch(v->note << 7);
+    v->osc.set_parameters(parameter_[0], parameter_[1]);
+    int16_t* buffer = render_buffer_;
+    int32_t* mix = mix_;
+    while (size) {
+      size_t block_size = std::min(size, kVoicePoolBlockSize);
+      // The envelope runs at the block rate, as in the firmware.
+      int32_t gain = static_cast<int32_t>(v->envelope.Render()) *
+          v->velocity >> 7;
+      v->osc.Render(sync_buffer_, buffer, kVoicePoolBlockSize);
+      for (size_t i = 0; i < block_size; ++i) {
+        mix[i] += buffer[i] * gain >> 8;
+      }
+      mix += block_size;
+      size -= block_size;
+    }
+  }
+
+  PoolVoice voice_[max_voices];
+  size_t num_voices_;
+  uint32_t clock_;
+
+  MacroOscillatorShape shape_;
+  int16_t parameter_[2];
+  uint16_t mix_gain_;
+
+  int32_t mix_[kVoicePoolBlockSize * kVoicePoolBatchSize];
+  int16_t render_buffer_[kVoicePoolBlockSize];
+  uint8_t sync_buffer_[kVoicePoolBlockSize];
+
+  DISALLOW_COPY_AND_ASSIGN(VoicePool);
+};
+
+}  // namespace braids
+
+#endif  // BRAIDS_VOICE_POOL_H_
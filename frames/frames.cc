@@ -138,7 +138,7 @@ int main(void) {
   ui.TryCalibration();
   
   bool trigger_detector_armed = false;
-  uint8_t sequencer_step = 0;
+  uint16_t sequencer_step = 0;
   int32_t dc_offset_frame_modulation = keyframer.dc_offset_frame_modulation();
 
   while (1) {
@@ -175,7 +175,7 @@ int main(void) {
           if (sequencer_step >= keyframer.num_keyframes()) {
             sequencer_step = 0;
           }
-          frame = keyframer.keyframe(sequencer_step).timestamp;
+          frame = keyframer.keyframe(sequencer_step).timestamp();
         }
         
         keyframer.Evaluate(frame);
@@ -29,6 +29,7 @@
 #include "frames/keyframer.h"
 
 #include <algorithm>
+#include <cstring>
 
 #ifndef TEST
 #include "stmlib/system/storage.h"
@@ -54,11 +55,66 @@ const uint8_t Keyframer::palette_[kNumPaletteEntries][3] = {
 
 #ifndef TEST
 stmlib::Storage<0x8020000, 4> storage;
+
+// Layout of the settings saved by the firmware which stored 64 unpacked
+// keyframes.
+struct LegacyKeyframe {
+  uint16_t timestamp;
+  uint16_t id;
+  uint16_t values[kNumChannels];
+};
+
+const uint16_t kLegacyMaxNumKeyframe = 64;
+
+struct LegacySettings {
+  LegacyKeyframe keyframes[kLegacyMaxNumKeyframe];
+  ChannelSettings settings[kNumChannels];
+  uint16_t num_keyframes;
+  uint16_t id_counter;
+  uint32_t extra_settings;
+  int32_t dc_offset_frame_modulation;
+};
+
+bool Keyframer::LoadLegacySettings() {
+  // The legacy settings are read into the keyframes array, and the keyframes
+  // are packed in place: keyframe i is read before it is overwritten by the
+  // packed keyframe i, which never reaches keyframe i + 1.
+  uint8_t* data = reinterpret_cast<uint8_t*>(&keyframes_[0]);
+  if (!storage.ParsimoniousLoad(data, sizeof(LegacySettings), &version_token_)) {
+    return false;
+  }
+  const LegacySettings* legacy = reinterpret_cast<const LegacySettings*>(data);
+  copy(legacy->settings, legacy->settings + kNumChannels, settings_);
+  num_keyframes_ = min(legacy->num_keyframes, kLegacyMaxNumKeyframe);
+  id_counter_ = legacy->id_counter;
+  extra_settings_ = legacy->extra_settings;
+  dc_offset_frame_modulation_ = legacy->dc_offset_frame_modulation;
+  
+  for (uint16_t i = 0; i < num_keyframes_; ++i) {
+    LegacyKeyframe source;
+    memcpy(&source, data + i * sizeof(LegacyKeyframe), sizeof(LegacyKeyframe));
+    Keyframe k;
+    k.set_timestamp(source.timestamp, source.id);
+    for (uint8_t j = 0; j < kNumChannels; ++j) {
+      k.set_value(j, source.values[j]);
+    }
+    memcpy(data + i * sizeof(Keyframe), &k, sizeof(Keyframe));
+  }
+  Keyframe empty;
+  memset(&empty, 0, sizeof(empty));
+  fill(&keyframes_[num_keyframes_], &keyframes_[kMaxNumKeyframe], empty);
+  
+  // The storage pages are filled with blocks of the legacy size, which are
+  // not aligned with the new ones: the next save must start by erasing them.
+  version_token_ = 0xffff;
+  return true;
+}
 #endif  // TEST
 
 void Keyframer::Init() {
 #ifndef TEST
-  if (!storage.ParsimoniousLoad(keyframes_, SETTINGS_SIZE, &version_token_)) {
+  if (!storage.ParsimoniousLoad(keyframes_, SETTINGS_SIZE, &version_token_) &&
+      !LoadLegacySettings()) {
     for (uint8_t i = 0; i < kNumChannels; ++i) {
       settings_[i].easing_curve = EASING_CURVE_LINEAR;
       settings_[i].response = 0;
@@ -68,6 +124,7 @@ void Keyframer::Init() {
     Clear();
   }
 #endif  // TEST
+  dirty_ = true;
 }
 
 void Keyframer::Save(uint32_t extra_settings) {
@@ -86,24 +143,22 @@ void Keyframer::Calibrate(int32_t dc_offset_frame_modulation) {
 
 void Keyframer::Clear() {
   Keyframe empty;
-  empty.timestamp = 0;
-  empty.id = 0;
-  fill(&empty.values[0], &empty.values[kNumChannels], 0);
+  empty.set_timestamp(0, 0);
+  fill(&empty.packed_values[0], &empty.packed_values[kNumChannels - 1], 0);
   fill(&keyframes_[0], &keyframes_[kMaxNumKeyframe], empty);
   num_keyframes_ = 0;
   id_counter_ = 0;
+  dirty_ = true;
 }
 
 uint16_t Keyframer::FindKeyframe(uint16_t timestamp) {
   if (!num_keyframes_) {
     return 0;
   }
-  Keyframe dummy;
-  dummy.timestamp = timestamp;
   return lower_bound(
       keyframes_,
       keyframes_ + num_keyframes_,
-      dummy,
+      timestamp,
       KeyframeLess()) - keyframes_;
 }
 
@@ -122,11 +177,8 @@ uint16_t Keyframer::ConvertToDacCode(uint16_t gain, uint8_t response) {
   return (linear + ((exponential - linear) * balance >> 15)) >> 4;
 }
 
-inline uint16_t Keyframer::Easing(
-    int32_t from,
-    int32_t to,
-    uint32_t scale,
-    EasingCurve curve) {
+/* static */
+inline int32_t Keyframer::ShapeScale(uint32_t scale, EasingCurve curve) {
   int32_t shaped_scale = scale;
   if (curve == EASING_CURVE_STEP) {
     shaped_scale = scale < 32768 ? 0 : 65535;
@@ -138,7 +190,15 @@ inline uint16_t Keyframer::Easing(
     shaped_scale = scale_a + (((scale_b - scale_a) >> 1) * \
       ((scale << 10) & 0xffff) >> 15);
   }
-  return from + ((to - from) * (shaped_scale >> 1) >> 15);
+  return shaped_scale;
+}
+
+inline uint16_t Keyframer::Easing(
+    int32_t from,
+    int32_t to,
+    uint32_t scale,
+    EasingCurve curve) {
+  return from + ((to - from) * (ShapeScale(scale, curve) >> 1) >> 15);
 }
 
 uint16_t Keyframer::SampleAnimation(
@@ -167,7 +227,7 @@ int16_t Keyframer::FindNearestKeyframe(uint16_t timestamp, uint16_t tolerance) {
   uint16_t search_start = index ? index - 1 : 0;
   uint16_t search_end = index < num_keyframes_ - 1 ? index + 2 : num_keyframes_;
   for (uint16_t i = search_start; i < search_end; ++i) {
-    uint16_t t = keyframes_[i].timestamp;
+    uint16_t t = keyframes_[i].timestamp();
     int32_t distance = static_cast<int32_t>(t) - static_cast<int32_t>(timestamp);
     if (distance < tolerance && -distance < tolerance) {
       return i;
@@ -181,17 +241,20 @@ bool Keyframer::AddKeyframe(uint16_t timestamp, uint16_t* values) {
     return false;
   }
   
+  timestamp &= kTimestampMask;
   uint16_t insertion_point = FindKeyframe(timestamp);
   if (insertion_point >= num_keyframes_ ||
-      keyframes_[insertion_point].timestamp != timestamp) {
+      keyframes_[insertion_point].timestamp() != timestamp) {
     for (int16_t i = num_keyframes_ - 1; i >= insertion_point; --i) {
       keyframes_[i + 1] = keyframes_[i];
     }
-    keyframes_[insertion_point].timestamp = timestamp;
-    keyframes_[insertion_point].id = id_counter_++;
+    keyframes_[insertion_point].set_timestamp(timestamp, id_counter_++);
     ++num_keyframes_;
   }
-  copy(values, values + kNumChannels, keyframes_[insertion_point].values);
+  for (uint8_t i = 0; i < kNumChannels; ++i) {
+    keyframes_[insertion_point].set_value(i, values[i]);
+  }
+  dirty_ = true;
   return true;
 }
 
@@ -199,8 +262,9 @@ bool Keyframer::RemoveKeyframe(uint16_t timestamp) {
   if (!num_keyframes_) {
     return false;
   }
+  timestamp &= kTimestampMask;
   uint16_t splice_point = FindKeyframe(timestamp);
-  if (keyframes_[splice_point].timestamp != timestamp) {
+  if (keyframes_[splice_point].timestamp() != timestamp) {
     return false;
   }
   
@@ -208,52 +272,112 @@ bool Keyframer::RemoveKeyframe(uint16_t timestamp) {
     keyframes_[i] = keyframes_[i + 1];
   }
   --num_keyframes_;
+  dirty_ = true;
   return true;
 }
 
+uint16_t Keyframer::Seek(uint16_t timestamp) {
+  const uint8_t kMaxSteps = 2;
+  uint16_t position = position_ < 0 ? 0 : position_;
+  if (position > num_keyframes_) {
+    position = num_keyframes_;
+  }
+  for (uint8_t i = 0; i < kMaxSteps; ++i) {
+    if (position < num_keyframes_ &&
+        keyframes_[position].timestamp() < timestamp) {
+      ++position;
+    } else if (position > 0 &&
+        keyframes_[position - 1].timestamp() >= timestamp) {
+      --position;
+    } else {
+      return position;
+    }
+  }
+  return FindKeyframe(timestamp);
+}
+
+void Keyframer::LoadSegment(uint16_t position) {
+  position_ = position;
+  
+  // Check for the areas before the first keyframe, and after the last
+  // keyframe.
+  if (position == 0 || position == num_keyframes_) {
+    const Keyframe& source = keyframes_[position == 0 ? 0 : num_keyframes_ - 1];
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      levels_[i] = source.value(i);
+    }
+    const uint8_t* palette = palette_[source.color()];
+    copy(palette, palette + 3, color_);
+    segment_duration_ = 0;
+  } else {
+    const Keyframe& a = keyframes_[position - 1];
+    const Keyframe& b = keyframes_[position];
+    segment_start_ = a.timestamp();
+    segment_duration_ = b.timestamp() - a.timestamp();
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      from_[i] = a.value(i);
+      delta_[i] = b.value(i) - a.value(i);
+    }
+    for (uint8_t i = 0; i < 3; ++i) {
+      uint8_t a_color = palette_[a.color()][i];
+      uint8_t b_color = palette_[b.color()][i];
+      from_color_[i] = a_color;
+      delta_color_[i] = b_color - a_color;
+    }
+  }
+}
+
 void Keyframer::Evaluate(uint16_t timestamp) {
   if (!num_keyframes_) {
     copy(immediate_, immediate_ + kNumChannels, levels_);
     fill(color_, color_ + 3, 0xff);
     position_ = -1;
     nearest_keyframe_ = -1;
-  } else {
-    uint16_t position = FindKeyframe(timestamp);
-    position_ = position;
-
-    // Check for the areas before the first keyframe, and after the last
-    // keyframe.
-    if (position == 0 || position == num_keyframes_) {
-      const Keyframe& source = keyframes_[position == 0 ? 0 : num_keyframes_ - 1];
-      copy(source.values, source.values + kNumChannels, levels_);
-      const uint8_t* palette = palette_[source.id & (kNumPaletteEntries - 1)];
-      copy(palette, palette + 3, color_);
-    } else {
-      // This is where the real interpolation takes place.
-      const Keyframe& a = keyframes_[position - 1];
-      const Keyframe& b = keyframes_[position];
-      uint32_t scale = timestamp - a.timestamp;
-      scale <<= 16;
-      scale /= (b.timestamp - a.timestamp);
-      for (uint8_t i = 0; i < kNumChannels; ++i) {
-        int32_t from = a.values[i];
-        int32_t to = b.values[i];
-        levels_[i] = Easing(from, to, scale, settings_[i].easing_curve);
-      }
-      for (uint8_t i = 0; i < 3; ++i) {
-        uint8_t a_color = palette_[a.id & (kNumPaletteEntries - 1)][i];
-        uint8_t b_color = palette_[b.id & (kNumPaletteEntries - 1)][i];
-        color_[i] = a_color + ((b_color - a_color) * scale >> 16);
-      }
+    for (uint16_t i = 0; i < kNumChannels; ++i) {
+      dac_code_[i] = ConvertToDacCode(levels_[i], settings_[i].response);
+    }
+    dirty_ = true;
+    return;
+  }
+  
+  if (!dirty_ && timestamp == timestamp_) {
+    return;
+  }
+  
+  uint16_t position = Seek(timestamp);
+  bool reload = dirty_ || position != position_;
+  if (reload) {
+    LoadSegment(position);
+    dirty_ = false;
+  }
+  timestamp_ = timestamp;
+  
+  uint16_t previous_levels[kNumChannels];
+  copy(levels_, levels_ + kNumChannels, previous_levels);
+  if (segment_duration_) {
+    // This is where the real interpolation takes place.
+    uint32_t scale = timestamp - segment_start_;
+    scale <<= 16;
+    scale /= segment_duration_;
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      int32_t shaped_scale = ShapeScale(scale, settings_[i].easing_curve);
+      levels_[i] = from_[i] + (delta_[i] * (shaped_scale >> 1) >> 15);
+    }
+    for (uint8_t i = 0; i < 3; ++i) {
+      color_[i] = from_color_[i] + (delta_color_[i] * scale >> 16);
     }
-    uint16_t t_this = timestamp - \
-        (position == 0 ? 0 : keyframes_[position - 1].timestamp);
-    uint16_t t_next = keyframes_[position].timestamp - timestamp;
-    nearest_keyframe_ = t_next < t_this ? position + 1 : position;
   }
   
+  uint16_t t_this = timestamp - \
+      (position == 0 ? 0 : keyframes_[position - 1].timestamp());
+  uint16_t t_next = keyframes_[position].timestamp() - timestamp;
+  nearest_keyframe_ = t_next < t_this ? position + 1 : position;
+  
+  // The response curve is only applied to the levels which have changed.
   for (uint16_t i = 0; i < kNumChannels; ++i) {
-    dac_code_[i] = ConvertToDacCode(levels_[i], settings_[i].response);
+    if (reload || levels_[i] != previous_levels[i]) {
+      dac_code_[i] = ConvertToDacCode(levels_[i], settings_[i].response);
+    }
   }
 }
 
@@ -34,9 +34,14 @@
 namespace frames {
   
 const uint8_t kNumChannels = 4;
-const uint8_t kMaxNumKeyframe = 64;
+// The saved settings take 804 bytes. Like the 812 bytes of the legacy layout,
+// five copies fit in the 4 storage pages, so there are as many saves between
+// two erases. The sizes must differ, or a legacy block would be loaded as a
+// packed one.
+const uint16_t kMaxNumKeyframe = 95;
 
 const uint8_t kNumPaletteEntries = 8;
+const uint16_t kTimestampMask = 0xffff & ~(kNumPaletteEntries - 1);
 
 enum EasingCurve {
   EASING_CURVE_STEP,
@@ -52,15 +57,59 @@ struct ChannelSettings {
   uint8_t response;
 };
 
+// Keyframes are packed in 8 bytes, and saved to flash as they are laid out in
+// RAM. The timestamp is quantized to 13 bits, and the 3 lower bits of the
+// first word store the palette entry. The values are quantized to 12 bits, the
+// resolution of the ADC they come from: the 3 first values keep their 12 most
+// significant bits in the 3 packed words, and the last value is split across
+// their lower nibbles.
 struct Keyframe {
-  uint16_t timestamp;
-  uint16_t id;
-  uint16_t values[kNumChannels];
+  uint16_t timestamp_color;
+  uint16_t packed_values[kNumChannels - 1];
+  
+  inline uint16_t timestamp() const {
+    return timestamp_color & kTimestampMask;
+  }
+  
+  inline uint8_t color() const {
+    return timestamp_color & (kNumPaletteEntries - 1);
+  }
+  
+  inline void set_timestamp(uint16_t timestamp, uint8_t color) {
+    timestamp_color = (timestamp & kTimestampMask) | \
+        (color & (kNumPaletteEntries - 1));
+  }
+  
+  // The upper bits are copied into the lower bits, so that a full scale value
+  // is restored as 65535.
+  inline uint16_t value(uint8_t channel) const {
+    uint16_t value;
+    if (channel < kNumChannels - 1) {
+      value = packed_values[channel] & 0xfff0;
+    } else {
+      value = (packed_values[0] & 0xf) << 12;
+      value |= (packed_values[1] & 0xf) << 8;
+      value |= (packed_values[2] & 0xf) << 4;
+    }
+    return value | (value >> 12);
+  }
+  
+  inline void set_value(uint8_t channel, uint16_t value) {
+    if (channel < kNumChannels - 1) {
+      packed_values[channel] &= 0xf;
+      packed_values[channel] |= value & 0xfff0;
+    } else {
+      for (uint8_t i = 0; i < kNumChannels - 1; ++i) {
+        packed_values[i] &= 0xfff0;
+        packed_values[i] |= (value >> (12 - 4 * i)) & 0xf;
+      }
+    }
+  }
 };
 
 struct KeyframeLess {
-  bool operator()(const Keyframe& lhs, const Keyframe& rhs) {
-    return lhs.timestamp < rhs.timestamp;
+  bool operator()(const Keyframe& lhs, uint16_t timestamp) {
+    return lhs.timestamp() < timestamp;
   }
 };
 
@@ -100,6 +149,7 @@ class Keyframer {
   void Evaluate(uint16_t timestamp);
   
   inline ChannelSettings* mutable_settings(uint8_t channel) {
+    dirty_ = true;
     return &settings_[channel];
   }
 
@@ -108,6 +158,7 @@ class Keyframer {
   }
   
   inline Keyframe* mutable_keyframe(uint16_t index) {
+    dirty_ = true;
     return &keyframes_[index];
   }
   
@@ -139,6 +190,15 @@ class Keyframer {
   
  private:
   uint16_t FindKeyframe(uint16_t timestamp);
+#ifndef TEST
+  bool LoadLegacySettings();
+#endif  // TEST
+  static int32_t ShapeScale(uint32_t scale, EasingCurve curve);
+  
+  // Moves the position of the last evaluation towards the segment containing
+  // the timestamp, and falls back to a binary search if it is far away.
+  uint16_t Seek(uint16_t timestamp);
+  void LoadSegment(uint16_t position);
    
   Keyframe keyframes_[kMaxNumKeyframe];
   ChannelSettings settings_[kNumChannels];
@@ -159,6 +219,18 @@ class Keyframer {
 
   int16_t position_;
   int16_t nearest_keyframe_;
+  
+  // The segment used by the last evaluation. It is reloaded when the
+  // position changes, or when the keyframes or settings have been modified.
+  bool dirty_;
+  uint16_t timestamp_;
+  uint16_t segment_start_;
+  // 0 before the first and after the last keyframe.
+  uint16_t segment_duration_;
+  int32_t from_[kNumChannels];
+  int32_t delta_[kNumChannels];
+  int16_t from_color_[3];
+  int16_t delta_color_[3];
 
   uint16_t dac_code_[kNumChannels];
   uint16_t levels_[kNumChannels];
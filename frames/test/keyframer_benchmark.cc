@@ -0,0 +1,339 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks the packing of the keyframes, then checks that the incremental
+// keyframer evaluation gives the same levels, DAC codes and colors as the
+// original binary search, and compares their throughput.
+//
+// Usage:
+//   keyframer_benchmark
+//
+// Each scenario is a stream of frame positions, as read from the FRAME knob
+// and CV input, or as generated by the sequencer mode. The keyframes and
+// channel settings are randomly edited every few thousand ticks, as done from
+// the UI while the module is running.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "frames/keyframer.h"
+#include "frames/resources.h"
+
+using namespace frames;
+
+const uint32_t kNumTicks = 200000;
+const uint32_t kNumRuns = 5;
+const uint32_t kEditInterval = 5000;
+
+// Copy of Keyframer::palette_.
+const uint8_t palette[kNumPaletteEntries][3] = {
+  { 255, 0, 0 },
+  { 255, 64, 0 },
+  { 255, 255, 0 },
+  { 64, 255, 0 },
+  { 0, 255, 64 },
+  { 0, 0, 255 },
+  { 255, 0, 255 },
+  { 255, 0, 64 },
+};
+
+struct State {
+  uint16_t levels[kNumChannels];
+  uint16_t dac_code[kNumChannels];
+  uint8_t color[3];
+  int16_t position;
+  int16_t nearest_keyframe;
+};
+
+// The original algorithm: binary search for the segment, and interpolation of
+// all the channels on each call.
+uint16_t ReferenceEasing(
+    int32_t from,
+    int32_t to,
+    uint32_t scale,
+    EasingCurve curve) {
+  int32_t shaped_scale = scale;
+  if (curve == EASING_CURVE_STEP) {
+    shaped_scale = scale < 32768 ? 0 : 65535;
+  } else if (curve >= EASING_CURVE_IN_QUARTIC) {
+    const uint16_t* easing_curve = lookup_table_table[
+        curve - EASING_CURVE_IN_QUARTIC];
+    int32_t scale_a = easing_curve[scale >> 6];
+    int32_t scale_b = easing_curve[(scale >> 6) + 1];
+    shaped_scale = scale_a + (((scale_b - scale_a) >> 1) * \
+      ((scale << 10) & 0xffff) >> 15);
+  }
+  return from + ((to - from) * (shaped_scale >> 1) >> 15);
+}
+
+void ReferenceEvaluate(
+    const Keyframer& keyframer,
+    uint16_t timestamp,
+    State* state) {
+  uint16_t num_keyframes = keyframer.num_keyframes();
+  const Keyframe* first = &keyframer.keyframe(0);
+  uint16_t position = std::lower_bound(
+      first,
+      first + num_keyframes,
+      timestamp,
+      KeyframeLess()) - first;
+  state->position = position;
+  if (position == 0 || position == num_keyframes) {
+    const Keyframe& source = keyframer.keyframe(
+        position == 0 ? 0 : num_keyframes - 1);
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      state->levels[i] = source.value(i);
+    }
+    const uint8_t* p = palette[source.color()];
+    std::copy(p, p + 3, state->color);
+  } else {
+    const Keyframe& a = keyframer.keyframe(position - 1);
+    const Keyframe& b = keyframer.keyframe(position);
+    uint32_t scale = timestamp - a.timestamp();
+    scale <<= 16;
+    scale /= (b.timestamp() - a.timestamp());
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      int32_t from = a.value(i);
+      int32_t to = b.value(i);
+      state->levels[i] = ReferenceEasing(
+          from, to, scale, keyframer.mutable_settings(i).easing_curve);
+    }
+    for (uint8_t i = 0; i < 3; ++i) {
+      uint8_t a_color = palette[a.color()][i];
+      uint8_t b_color = palette[b.color()][i];
+      state->color[i] = a_color + ((b_color - a_color) * scale >> 16);
+    }
+  }
+  uint16_t t_this = timestamp - \
+      (position == 0 ? 0 : keyframer.keyframe(position - 1).timestamp());
+  uint16_t t_next = keyframer.keyframe(position).timestamp() - timestamp;
+  state->nearest_keyframe = t_next < t_this ? position + 1 : position;
+  for (uint8_t i = 0; i < kNumChannels; ++i) {
+    state->dac_code[i] = Keyframer::ConvertToDacCode(
+        state->levels[i], keyframer.mutable_settings(i).response);
+  }
+}
+
+void ReadState(const Keyframer& keyframer, State* state) {
+  for (uint8_t i = 0; i < kNumChannels; ++i) {
+    state->levels[i] = keyframer.level(i);
+    state->dac_code[i] = keyframer.dac_code(i);
+  }
+  std::copy(keyframer.color(), keyframer.color() + 3, state->color);
+  state->position = keyframer.position();
+  state->nearest_keyframe = keyframer.nearest_keyframe();
+}
+
+bool Equal(const State& a, const State& b) {
+  return std::equal(a.levels, a.levels + kNumChannels, b.levels) &&
+      std::equal(a.dac_code, a.dac_code + kNumChannels, b.dac_code) &&
+      std::equal(a.color, a.color + 3, b.color) &&
+      a.position == b.position &&
+      a.nearest_keyframe == b.nearest_keyframe;
+}
+
+enum Scenario {
+  // The knob or a slow CV sweeps the frame back and forth, with some noise.
+  SCENARIO_SWEEP,
+  // The frame does not move.
+  SCENARIO_STATIC,
+  // The frame is modulated by noise.
+  SCENARIO_RANDOM,
+  // Sequencer mode: the frame jumps from one keyframe to the next.
+  SCENARIO_SEQUENCER,
+  SCENARIO_LAST
+};
+
+const char* scenario_names[] = { "sweep", "static", "random", "sequencer" };
+
+uint16_t timestamps[kNumTicks];
+uint32_t rng_state = 0x21;
+
+inline uint32_t Random32() {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return rng_state;
+}
+
+void MakeKeyframes(Keyframer* keyframer, uint16_t num_keyframes) {
+  keyframer->Clear();
+  while (keyframer->num_keyframes() < num_keyframes) {
+    uint16_t values[kNumChannels];
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      values[i] = Random32() >> 16;
+    }
+    keyframer->AddKeyframe(Random32() >> 16, values);
+  }
+  for (uint8_t i = 0; i < kNumChannels; ++i) {
+    keyframer->mutable_settings(i)->easing_curve = static_cast<EasingCurve>(
+        (Random32() >> 16) % (EASING_CURVE_BOUNCE + 1));
+    keyframer->mutable_settings(i)->response = Random32() >> 24;
+  }
+}
+
+void MakeTimestamps(Scenario scenario, const Keyframer& keyframer) {
+  int32_t frame = 0;
+  int32_t direction = 1;
+  uint16_t step = 0;
+  for (uint32_t i = 0; i < kNumTicks; ++i) {
+    if (scenario == SCENARIO_SWEEP) {
+      // About 5 seconds for a full sweep at the 8kHz update rate.
+      frame += direction * 2;
+      if (frame >= 65535 || frame <= 0) {
+        direction = -direction;
+      }
+      int32_t t = frame + static_cast<int32_t>((Random32() >> 16) % 17) - 8;
+      CONSTRAIN(t, 0, 65535);
+      timestamps[i] = t;
+    } else if (scenario == SCENARIO_STATIC) {
+      timestamps[i] = 23456;
+    } else if (scenario == SCENARIO_RANDOM) {
+      timestamps[i] = Random32() >> 16;
+    } else {
+      if (i % 64 == 0) {
+        step = (step + 1) % keyframer.num_keyframes();
+      }
+      timestamps[i] = keyframer.keyframe(step).timestamp();
+    }
+  }
+}
+
+// Changes a keyframe value, or a channel setting.
+void Edit(Keyframer* keyframer) {
+  uint8_t channel = (Random32() >> 16) % kNumChannels;
+  if ((Random32() >> 16) & 1) {
+    uint16_t index = (Random32() >> 16) % keyframer->num_keyframes();
+    keyframer->mutable_keyframe(index)->set_value(channel, Random32() >> 16);
+  } else {
+    keyframer->mutable_settings(channel)->easing_curve = \
+        static_cast<EasingCurve>(
+            (Random32() >> 16) % (EASING_CURVE_BOUNCE + 1));
+    keyframer->mutable_settings(channel)->response = Random32() >> 24;
+  }
+}
+
+// Best of several runs, in evaluations per second.
+template<bool reference>
+double Time(Keyframer* keyframer) {
+  double best = 0.0;
+  int32_t checksum = 0;
+  State state;
+  for (uint32_t run = 0; run < kNumRuns; ++run) {
+    clock_t start = clock();
+    for (uint32_t i = 0; i < kNumTicks; ++i) {
+      if (reference) {
+        ReferenceEvaluate(*keyframer, timestamps[i], &state);
+        checksum += state.dac_code[i & 3];
+      } else {
+        keyframer->Evaluate(timestamps[i]);
+        checksum += keyframer->dac_code(i & 3);
+      }
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best > 0.0 ? kNumTicks / best : 0.0;
+}
+
+// Checks that each value of a packed keyframe can be written without
+// changing the other ones, and is restored within the quantization step.
+bool CheckPacking() {
+  Keyframe k;
+  k.set_timestamp(0, 0);
+  std::fill(&k.packed_values[0], &k.packed_values[kNumChannels - 1], 0);
+  for (uint8_t i = 0; i < kNumChannels; ++i) {
+    k.set_value(i, 0xffff);
+  }
+  for (uint32_t value = 0; value < 65536; ++value) {
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      uint16_t other = (i + 1) % kNumChannels;
+      uint16_t before = k.value(other);
+      k.set_value(i, value);
+      int32_t error = static_cast<int32_t>(k.value(i)) - value;
+      if (error < -15 || error > 15 || k.value(other) != before) {
+        printf("value %u on channel %d restored as %u\n",
+            value, i, k.value(i));
+        return false;
+      }
+    }
+    k.set_timestamp(value, value);
+    if (k.timestamp() != (value & kTimestampMask) ||
+        k.color() != (value & (kNumPaletteEntries - 1))) {
+      printf("timestamp %u restored as %u\n", value, k.timestamp());
+      return false;
+    }
+  }
+  return k.value(0) == 65535 && k.value(kNumChannels - 1) == 65535;
+}
+
+Keyframer keyframer;
+
+int main(void) {
+  if (!CheckPacking()) {
+    return 1;
+  }
+  printf("%d keyframes of %d bytes.\n\n",
+      kMaxNumKeyframe, static_cast<int>(sizeof(Keyframe)));
+  
+  const uint16_t num_keyframes[] = { 2, 8, 32, 64, kMaxNumKeyframe };
+  printf("%-10s %9s %16s %16s %8s\n",
+      "scenario", "keyframes", "reference ev/s", "cursor ev/s", "speedup");
+  for (size_t i = 0; i < SCENARIO_LAST; ++i) {
+    Scenario scenario = static_cast<Scenario>(i);
+    for (size_t j = 0; j < sizeof(num_keyframes) / sizeof(uint16_t); ++j) {
+      MakeKeyframes(&keyframer, num_keyframes[j]);
+      MakeTimestamps(scenario, keyframer);
+      
+      for (uint32_t k = 0; k < kNumTicks; ++k) {
+        if (k % kEditInterval == kEditInterval - 1) {
+          Edit(&keyframer);
+        }
+        State expected;
+        State actual;
+        ReferenceEvaluate(keyframer, timestamps[k], &expected);
+        keyframer.Evaluate(timestamps[k]);
+        ReadState(keyframer, &actual);
+        if (!Equal(expected, actual)) {
+          printf("%s, %d keyframes: mismatch at tick %u, frame %u\n",
+              scenario_names[i], num_keyframes[j], k, timestamps[k]);
+          return 1;
+        }
+      }
+      
+      double t_reference = Time<true>(&keyframer);
+      double t_cursor = Time<false>(&keyframer);
+      printf("%-10s %9d %16.0f %16.0f %7.2fx\n",
+          scenario_names[i], num_keyframes[j], t_reference, t_cursor,
+          t_reference > 0.0 ? t_cursor / t_reference : 0.0);
+    }
+  }
+  return 0;
+}
@@ -184,7 +184,7 @@ void Ui::Poll() {
       } else {
         animation_counter_ += 256;
         int32_t distance = frame() - \
-            keyframer_->keyframe(active_keyframe_).timestamp;
+            keyframer_->keyframe(active_keyframe_).timestamp();
         distance = min(distance * distance >> 18, int32_t(15));
         ++keyframe_led_pwm_counter_;
         if ((keyframe_led_pwm_counter_ & 15) >= distance) {
@@ -318,7 +318,7 @@ void Ui::OnSwitchReleased(const Event& e) {
           if (mode_ == UI_MODE_NORMAL && !poly_lfo_mode_) {
             if (active_keyframe_ != -1) {
               keyframer_->RemoveKeyframe(
-                  keyframer_->keyframe(active_keyframe_).timestamp);
+                  keyframer_->keyframe(active_keyframe_).timestamp());
             }
             FindNearestKeyframe();
             SyncWithPots();
@@ -366,7 +366,7 @@ void Ui::OnPotChanged(const Event& e) {
         if (mode_ == UI_MODE_NORMAL || mode_ == UI_MODE_SPLASH) {
           if (active_keyframe_ != -1) {
             Keyframe* k = keyframer_->mutable_keyframe(active_keyframe_);
-            k->values[e.control_id] = e.data;
+            k->set_value(e.control_id, e.data);
           } else {
             keyframer_->set_immediate(e.control_id, e.data);
           }
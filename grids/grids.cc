@@ -371,5 +371,6 @@ int main(void) {
   while (1) {
     // Use any spare cycles to read the CVs and update the potentiometers
     ScanPots();
+    pattern_generator.UpdateDrumMapCache();
   }
 }
@@ -17,10 +17,12 @@
 #define GRIDS_HARDWARE_CONFIG_H_
 
 #include "avrlib/base.h"
+#ifndef TEST
 #include "avrlib/gpio.h"
 #include "avrlib/parallel_io.h"
 #include "avrlib/serial.h"
 #include "avrlib/spi.h"
+#endif  // TEST
 
 namespace grids {
 
@@ -49,6 +51,7 @@ enum InputBits {
   INPUT_SW_RESET = 8
 };
 
+#ifndef TEST
 using avrlib::Gpio;
 using avrlib::ParallelPort;
 using avrlib::PortB;
@@ -61,6 +64,7 @@ typedef ParallelPort<PortD, avrlib::PARALLEL_NIBBLE_HIGH> Leds;
 typedef ParallelPort<PortD, avrlib::PARALLEL_NIBBLE_LOW> Inputs;
 typedef SpiMaster<Gpio<PortB, 2>, avrlib::MSB_FIRST, 2> ShiftRegister;
 typedef Serial<SerialPort0, 31250, avrlib::POLLED, avrlib::DISABLED> MidiInput;
+#endif  // TEST
 }  // namespace grids
 
 #endif  // GRIDS_HARDWARE_CONFIG_H_
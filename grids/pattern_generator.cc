@@ -63,6 +63,21 @@ PatternGeneratorSettings PatternGenerator::settings_;
 /* static */
 uint8_t PatternGenerator::factory_testing_;
 
+/* static */
+uint8_t PatternGenerator::drum_map_cache_[kNumParts][kStepsPerPattern];
+
+/* static */
+uint8_t PatternGenerator::drum_map_x_;
+
+/* static */
+uint8_t PatternGenerator::drum_map_y_;
+
+/* static */
+uint8_t PatternGenerator::drum_map_refresh_step_;
+
+/* static */
+uint8_t PatternGenerator::drum_map_refresh_count_;
+
 /* extern */
 PatternGenerator pattern_generator;
 
@@ -94,6 +109,50 @@ uint8_t PatternGenerator::ReadDrumMap(
   return U8Mix(U8Mix(a, b, x << 2), U8Mix(c, d, x << 2), y << 2);
 }
 
+/* static */
+void PatternGenerator::FillDrumMapCache() {
+  drum_map_x_ = settings_.options.drums.x;
+  drum_map_y_ = settings_.options.drums.y;
+  for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      drum_map_cache_[i][step] = ReadDrumMap(
+          step, i, drum_map_x_, drum_map_y_);
+    }
+  }
+  drum_map_refresh_count_ = 0;
+}
+
+static inline uint8_t Distance(uint8_t a, uint8_t b) {
+  return a > b ? a - b : b - a;
+}
+
+/* static */
+void PatternGenerator::UpdateDrumMapCache() {
+  uint8_t x = settings_.options.drums.x;
+  uint8_t y = settings_.options.drums.y;
+  if (Distance(x, drum_map_x_) >= kDrumMapCacheThreshold ||
+      Distance(y, drum_map_y_) >= kDrumMapCacheThreshold) {
+    // Start from the step about to be played. The cache is refreshed in
+    // place: each entry is a single byte, which the ISR reads either before
+    // or after the update.
+    drum_map_x_ = x;
+    drum_map_y_ = y;
+    drum_map_refresh_step_ = step_;
+    drum_map_refresh_count_ = kStepsPerPattern;
+  }
+  
+  if (!drum_map_refresh_count_) {
+    return;
+  }
+  
+  uint8_t step = drum_map_refresh_step_;
+  for (uint8_t i = 0; i < kNumParts; ++i) {
+    drum_map_cache_[i][step] = ReadDrumMap(step, i, drum_map_x_, drum_map_y_);
+  }
+  drum_map_refresh_step_ = (step + 1) & (kStepsPerPattern - 1);
+  --drum_map_refresh_count_;
+}
+
 /* static */
 void PatternGenerator::EvaluateDrums() {
   // At the beginning of a pattern, decide on perturbation levels.
@@ -106,11 +165,9 @@ void PatternGenerator::EvaluateDrums() {
   }
   
   uint8_t instrument_mask = 1;
-  uint8_t x = settings_.options.drums.x;
-  uint8_t y = settings_.options.drums.y;
   uint8_t accent_bits = 0;
   for (uint8_t i = 0; i < kNumParts; ++i) {
-    uint8_t level = ReadDrumMap(step_, i, x, y);
+    uint8_t level = drum_map_cache_[i][step_];
     if (level < 255 - part_perturbation_[i]) {
       level += part_perturbation_[i];
     } else {
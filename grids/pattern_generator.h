@@ -39,6 +39,8 @@ const uint8_t kNumParts = 3;
 const uint8_t kPulsesPerStep = 3;  // 24 ppqn ; 8 steps per quarter note.
 const uint8_t kStepsPerPattern = 32;
 const uint8_t kPulseDuration = 8;  // 8 ticks of the main clock.
+// The drum map cache is not refreshed for smaller X/Y movements.
+const uint8_t kDrumMapCacheThreshold = 2;
 
 struct DrumsSettings {
   uint8_t x;
@@ -121,6 +123,7 @@ class PatternGenerator {
   static inline void Init() {
     LoadSettings();
     Reset();
+    FillDrumMapCache();
   }
 
   static inline void Reset() {
@@ -213,6 +216,10 @@ class PatternGenerator {
 
   static void SaveSettings();
   
+  // Called from the main loop. When X or Y have moved, refreshes one step of
+  // the drum map cache, starting from the current step.
+  static void UpdateDrumMapCache();
+  
   static inline uint8_t led_pattern() {
     uint8_t result = 0;
     if (state_ & 1) {
@@ -232,6 +239,7 @@ class PatternGenerator {
   static void Evaluate();
   static void EvaluateEuclidean();
   static void EvaluateDrums();
+  static void FillDrumMapCache();
   
   static uint8_t ReadDrumMap(
       uint8_t step,
@@ -256,6 +264,14 @@ class PatternGenerator {
   
   static PatternGeneratorSettings settings_;
   
+  // Levels of the 3 instruments, interpolated from the drum map at the
+  // coordinates (drum_map_x_, drum_map_y_).
+  static uint8_t drum_map_cache_[kNumParts][kStepsPerPattern];
+  static uint8_t drum_map_x_;
+  static uint8_t drum_map_y_;
+  static uint8_t drum_map_refresh_step_;
+  static uint8_t drum_map_refresh_count_;
+  
   DISALLOW_COPY_AND_ASSIGN(PatternGenerator);
 };
 
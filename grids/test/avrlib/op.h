@@ -0,0 +1,51 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for avrlib/op.h: the portable versions of the fixed point
+// operations, which give the same results as the AVR assembly ones.
+
+#ifndef GRIDS_TEST_AVRLIB_OP_H_
+#define GRIDS_TEST_AVRLIB_OP_H_
+
+#include "avrlib/base.h"
+
+namespace avrlib {
+
+static inline uint8_t U8Mix(uint8_t a, uint8_t b, uint8_t balance) {
+  return (a * (255 - balance) + b * balance) >> 8;
+}
+
+static inline uint8_t U8U8MulShift8(uint8_t a, uint8_t b) {
+  return (a * b) >> 8;
+}
+
+static inline uint16_t U8U8Mul(uint8_t a, uint8_t b) {
+  return a * b;
+}
+
+}  // namespace avrlib
+
+#endif  // GRIDS_TEST_AVRLIB_OP_H_
@@ -0,0 +1,61 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for avrlib/random.h, with the same 16-bit Galois LFSR.
+
+#ifndef GRIDS_TEST_AVRLIB_RANDOM_H_
+#define GRIDS_TEST_AVRLIB_RANDOM_H_
+
+#include "avrlib/base.h"
+
+namespace avrlib {
+
+class Random {
+ public:
+  static inline void Update() {
+    // Galois LFSR with feedback polynomial = x^16 + x^14 + x^13 + x^11.
+    // Period: 65535.
+    rng_state_ = (rng_state_ >> 1) ^ (-(rng_state_ & 1) & 0xb400);
+  }
+  
+  static inline uint16_t state() { return rng_state_; }
+  
+  static inline void Seed(uint16_t seed) { rng_state_ = seed; }
+  
+  static inline uint8_t GetByte() {
+    Update();
+    return rng_state_ >> 8;
+  }
+  
+ private:
+  static uint16_t rng_state_;
+  
+  DISALLOW_COPY_AND_ASSIGN(Random);
+};
+
+}  // namespace avrlib
+
+#endif  // GRIDS_TEST_AVRLIB_RANDOM_H_
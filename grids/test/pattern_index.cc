@@ -0,0 +1,424 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Enumerates the drum patterns of the grids pattern generator over a grid of
+// settings into a binary index, and searches this index for a groove.
+//
+// Usage:
+//   pattern_index [-o index.bin] [-x step] [-y step] [-d step] [-r step]
+//       [-j jobs]
+//   pattern_index -i index.bin -s bd sd hh [-n count]
+//
+// For each point of the grid, the PatternGenerator is reset and clocked
+// through a full bar, and the trigger and accent bits of the 3 parts are
+// recorded. The 3 parts use the same density: the parts are evaluated
+// independently, so a pattern with different densities is made of the parts
+// of several records. Before each bar, the random generator is set back to
+// its power-on state. The records for increasing randomness values are thus
+// the same random draw, with a growing perturbation.
+//
+// The grid covers 0 to 255 with the given steps, 255 being always included.
+// The x columns are rendered in parallel by child processes: the pattern
+// generator only has static state, so threads are not an option. Each child
+// writes its records at their final position in the index.
+//
+// Index format, in the byte order of the host: an IndexHeader, followed by
+// the Patterns in x, y, density, randomness order. Bit n of each mask is
+// step n.
+//
+// Search: bd, sd and hh are strings of 32 steps, or of 16 steps which are
+// then placed on the even steps, with 'x' for a trigger. The records are
+// ranked by the number of steps which differ.
+
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "avrlib/random.h"
+
+#include "grids/pattern_generator.h"
+
+using namespace avrlib;
+using namespace grids;
+
+enum Axis {
+  AXIS_X,
+  AXIS_Y,
+  AXIS_DENSITY,
+  AXIS_RANDOMNESS,
+  AXIS_LAST
+};
+
+const char kMagic[4] = { 'G', 'R', 'D', 'X' };
+const uint8_t kVersion = 1;
+const uint16_t kRandomSeed = 0x21;
+const size_t kMaxMatches = 100;
+
+struct IndexHeader {
+  char magic[4];
+  uint8_t version;
+  uint8_t step[AXIS_LAST];
+  uint8_t padding[3];
+};
+
+struct Pattern {
+  uint32_t triggers[kNumParts];
+  uint32_t accents[kNumParts];
+};
+
+struct Match {
+  uint32_t index;
+  uint8_t distance;
+};
+
+inline uint16_t NumValues(uint8_t step) {
+  return (255 + step - 1) / step + 1;
+}
+
+inline uint8_t Value(uint8_t step, uint16_t index) {
+  uint16_t value = index * step;
+  return value > 255 ? 255 : value;
+}
+
+inline size_t NumRecords(const IndexHeader& header) {
+  size_t n = 1;
+  for (size_t i = 0; i < AXIS_LAST; ++i) {
+    n *= NumValues(header.step[i]);
+  }
+  return n;
+}
+
+inline double Now() {
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+void RenderBar(Pattern* pattern) {
+  Random::Seed(kRandomSeed);
+  PatternGenerator::Reset();
+  memset(pattern, 0, sizeof(Pattern));
+  for (uint8_t step = 0; step < kStepsPerPattern; ++step) {
+    PatternGenerator::TickClock(kPulsesPerStep);
+    uint8_t state = PatternGenerator::state();
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      if (state & (1 << i)) {
+        pattern->triggers[i] |= 1UL << step;
+      }
+      // Without clock output, the accents of the 3 parts are on bits 3 to 5.
+      if (state & (8 << i)) {
+        pattern->accents[i] |= 1UL << step;
+      }
+    }
+  }
+}
+
+// Renders and writes all the records with the same x.
+bool RenderColumn(const IndexHeader& header, uint16_t x_index, int fd) {
+  uint16_t num_y = NumValues(header.step[AXIS_Y]);
+  uint16_t num_density = NumValues(header.step[AXIS_DENSITY]);
+  uint16_t num_randomness = NumValues(header.step[AXIS_RANDOMNESS]);
+  size_t num_records = num_y * num_density * num_randomness;
+  Pattern* patterns = new Pattern[num_records];
+  
+  PatternGeneratorSettings* settings = PatternGenerator::mutable_settings();
+  Pattern* pattern = patterns;
+  for (uint16_t y = 0; y < num_y; ++y) {
+    settings->options.drums.x = Value(header.step[AXIS_X], x_index);
+    settings->options.drums.y = Value(header.step[AXIS_Y], y);
+    // Fills the drum map cache for these coordinates.
+    PatternGenerator::Init();
+    PatternGenerator::set_output_mode(OUTPUT_MODE_DRUMS);
+    PatternGenerator::set_swing(false);
+    PatternGenerator::set_output_clock(false);
+    PatternGenerator::set_gate_mode(false);
+    for (uint16_t d = 0; d < num_density; ++d) {
+      memset(settings->density, Value(header.step[AXIS_DENSITY], d),
+          kNumParts);
+      for (uint16_t r = 0; r < num_randomness; ++r) {
+        settings->options.drums.randomness = Value(
+            header.step[AXIS_RANDOMNESS], r);
+        RenderBar(pattern++);
+      }
+    }
+  }
+  
+  size_t size = num_records * sizeof(Pattern);
+  off_t offset = sizeof(IndexHeader) + x_index * size;
+  bool success = pwrite(fd, patterns, size, offset) == \
+      static_cast<ssize_t>(size);
+  delete[] patterns;
+  return success;
+}
+
+// Renders all the x columns, with up to num_jobs child processes at a time.
+bool Build(const char* file_name, const IndexHeader& header, long num_jobs) {
+  int fd = open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(file_name);
+    return false;
+  }
+  if (write(fd, &header, sizeof(header)) != sizeof(header)) {
+    perror(file_name);
+    close(fd);
+    return false;
+  }
+  
+  bool success = true;
+  long num_running = 0;
+  uint16_t num_x = NumValues(header.step[AXIS_X]);
+  for (uint16_t x = 0; x < num_x || num_running; ) {
+    if (x < num_x && num_running < num_jobs) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        perror("fork");
+        success = false;
+        num_x = x;
+        continue;
+      } else if (pid == 0) {
+        _exit(RenderColumn(header, x, fd) ? 0 : 1);
+      }
+      ++num_running;
+      ++x;
+    } else {
+      int status;
+      wait(&status);
+      --num_running;
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        success = false;
+      }
+    }
+  }
+  close(fd);
+  if (!success) {
+    fprintf(stderr, "Could not write all the records to %s\n", file_name);
+  }
+  return success;
+}
+
+bool ParsePattern(const char* s, uint32_t* bits) {
+  size_t length = strlen(s);
+  if (length != kStepsPerPattern && length != kStepsPerPattern / 2) {
+    fprintf(stderr, "%s: expected %d or %d steps\n",
+        s, kStepsPerPattern, kStepsPerPattern / 2);
+    return false;
+  }
+  uint8_t stride = kStepsPerPattern / length;
+  *bits = 0;
+  for (size_t i = 0; i < length; ++i) {
+    if (s[i] == 'x' || s[i] == 'X') {
+      *bits |= 1UL << (i * stride);
+    }
+  }
+  return true;
+}
+
+void PrintPattern(uint32_t triggers, uint32_t accents) {
+  for (uint8_t i = 0; i < kStepsPerPattern; ++i) {
+    uint32_t mask = 1UL << i;
+    printf("%c", accents & mask ? 'X' : (triggers & mask ? 'x' : '.'));
+  }
+}
+
+inline uint8_t CountBits(uint32_t x) {
+  uint8_t count = 0;
+  while (x) {
+    x &= x - 1;
+    ++count;
+  }
+  return count;
+}
+
+bool Search(const char* file_name, const uint32_t* target, size_t count) {
+  FILE* fp = fopen(file_name, "rb");
+  if (!fp) {
+    perror(file_name);
+    return false;
+  }
+  IndexHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.magic, kMagic, sizeof(kMagic)) ||
+      header.version != kVersion) {
+    fprintf(stderr, "%s: not a pattern index\n", file_name);
+    fclose(fp);
+    return false;
+  }
+  
+  // Sorted by distance, then by record index.
+  Match matches[kMaxMatches];
+  size_t num_matches = 0;
+  size_t num_records = NumRecords(header);
+  for (size_t i = 0; i < num_records; ++i) {
+    Pattern pattern;
+    if (fread(&pattern, sizeof(pattern), 1, fp) != 1) {
+      fprintf(stderr, "%s: truncated after %zu records\n", file_name, i);
+      fclose(fp);
+      return false;
+    }
+    uint8_t distance = 0;
+    for (uint8_t j = 0; j < kNumParts; ++j) {
+      distance += CountBits(pattern.triggers[j] ^ target[j]);
+    }
+    if (num_matches == count && distance >= matches[count - 1].distance) {
+      continue;
+    }
+    size_t k = num_matches < count ? num_matches++ : count - 1;
+    while (k > 0 && matches[k - 1].distance > distance) {
+      matches[k] = matches[k - 1];
+      --k;
+    }
+    matches[k].index = i;
+    matches[k].distance = distance;
+  }
+  
+  uint16_t size[AXIS_LAST];
+  for (size_t i = 0; i < AXIS_LAST; ++i) {
+    size[i] = NumValues(header.step[i]);
+  }
+  printf("%5s %3s %3s %7s %10s  %s\n",
+      "steps", "x", "y", "density", "randomness", "bd / sd / hh");
+  for (size_t i = 0; i < num_matches; ++i) {
+    uint32_t index = matches[i].index;
+    uint16_t coordinates[AXIS_LAST];
+    for (int8_t j = AXIS_LAST - 1; j >= 0; --j) {
+      coordinates[j] = index % size[j];
+      index /= size[j];
+    }
+    Pattern pattern;
+    fseek(fp, sizeof(header) + matches[i].index * sizeof(Pattern), SEEK_SET);
+    if (fread(&pattern, sizeof(pattern), 1, fp) != 1) {
+      break;
+    }
+    printf("%5d %3d %3d %7d %10d  ",
+        matches[i].distance,
+        Value(header.step[AXIS_X], coordinates[AXIS_X]),
+        Value(header.step[AXIS_Y], coordinates[AXIS_Y]),
+        Value(header.step[AXIS_DENSITY], coordinates[AXIS_DENSITY]),
+        Value(header.step[AXIS_RANDOMNESS], coordinates[AXIS_RANDOMNESS]));
+    for (uint8_t j = 0; j < kNumParts; ++j) {
+      PrintPattern(pattern.triggers[j], pattern.accents[j]);
+      printf(j == kNumParts - 1 ? "\n" : " ");
+    }
+  }
+  fclose(fp);
+  return true;
+}
+
+void Usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-o index.bin] [-x step] [-y step] [-d step] "
+      "[-r step] [-j jobs]\n", name);
+  fprintf(stderr, "       %s -i index.bin -s bd sd hh [-n count]\n", name);
+}
+
+int main(int argc, char** argv) {
+  const char* output_file = "pattern_index.bin";
+  const char* input_file = NULL;
+  const char* target_strings[kNumParts] = { NULL, NULL, NULL };
+  long num_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  long count = 10;
+  int step[AXIS_LAST] = { 8, 8, 8, 64 };
+  const char* step_flags = "xydr";
+  
+  for (int i = 1; i < argc; ++i) {
+    const char* flag = argv[i];
+    const char* axis = flag[0] == '-' && flag[1] && !flag[2]
+        ? strchr(step_flags, flag[1]) : NULL;
+    if (i + 1 < argc && axis) {
+      step[axis - step_flags] = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(flag, "-o")) {
+      output_file = argv[++i];
+    } else if (i + 1 < argc && !strcmp(flag, "-j")) {
+      num_jobs = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(flag, "-i")) {
+      input_file = argv[++i];
+    } else if (i + 1 < argc && !strcmp(flag, "-n")) {
+      count = atoi(argv[++i]);
+    } else if (i + kNumParts < argc && !strcmp(flag, "-s")) {
+      for (uint8_t j = 0; j < kNumParts; ++j) {
+        target_strings[j] = argv[++i];
+      }
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  
+  if (input_file) {
+    uint32_t target[kNumParts];
+    if (!target_strings[0]) {
+      Usage(argv[0]);
+      return 1;
+    }
+    for (uint8_t i = 0; i < kNumParts; ++i) {
+      if (!ParsePattern(target_strings[i], &target[i])) {
+        return 1;
+      }
+    }
+    if (count < 1 || count > static_cast<long>(kMaxMatches)) {
+      count = kMaxMatches;
+    }
+    return Search(input_file, target, count) ? 0 : 1;
+  }
+  
+  IndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  for (size_t i = 0; i < AXIS_LAST; ++i) {
+    if (step[i] < 1 || step[i] > 255) {
+      fprintf(stderr, "Steps must be between 1 and 255\n");
+      return 1;
+    }
+    header.step[i] = step[i];
+  }
+  if (num_jobs < 1) {
+    num_jobs = 1;
+  }
+  
+  double start = Now();
+  if (!Build(output_file, header, num_jobs)) {
+    return 1;
+  }
+  double elapsed = Now() - start;
+  size_t num_records = NumRecords(header);
+  printf("%zu patterns (%dx%dx%dx%d), %zu bytes, %.2fs with %ld jobs: "
+      "%.0f patterns/s.\n",
+      num_records,
+      NumValues(header.step[AXIS_X]),
+      NumValues(header.step[AXIS_Y]),
+      NumValues(header.step[AXIS_DENSITY]),
+      NumValues(header.step[AXIS_RANDOMNESS]),
+      sizeof(header) + num_records * sizeof(Pattern),
+      elapsed,
+      num_jobs,
+      elapsed > 0.0 ? num_records / elapsed : 0.0);
+  return 0;
+}
@@ -32,6 +32,7 @@
 
 #include "peaks/drums/high_hat.h"
 
+#include <algorithm>
 #include <cstdio>
 
 #include "stmlib/utils/dsp.h"
@@ -42,6 +43,11 @@
 namespace peaks {
 
 using namespace stmlib;
+using namespace braids;
+
+static const uint32_t kIncrements[kNumMetallicNoiseOscillators] = {
+  48318382, 71582788, 37044092, 54313440, 66214079, 93952409
+};
 
 void HighHat::Init() {
   noise_.Init();
@@ -58,6 +64,22 @@ void HighHat::Init() {
 }
 
 void HighHat::Process(const GateFlags* gate_flags, int16_t* out, size_t size) {
+  while (size) {
+    size_t block_size = std::min(size, kMetallicNoiseBlockSize);
+    ProcessBlock(gate_flags, out, block_size);
+    gate_flags += block_size;
+    out += block_size;
+    size -= block_size;
+  }
+}
+
+void HighHat::ProcessBlock(
+    const GateFlags* gate_flags,
+    int16_t* out,
+    size_t size) {
+  uint8_t metallic_noise[kMetallicNoiseBlockSize];
+  metallic_noise_.Render(kIncrements, metallic_noise, size);
+  const uint8_t* metallic_noise_ptr = metallic_noise;
   while (size--) {
     GateFlags gate_flag = *gate_flags++;
 
@@ -123,21 +145,7 @@ void HighHat::Process(const GateFlags* gate_flags, int16_t* out, size_t size) {
       vca_envelope_.Trigger(32768 * 15);
     }
 
-    phase_[0] += 48318382;
-    phase_[1] += 71582788;
-    phase_[2] += 37044092;
-    phase_[3] += 54313440;
-    phase_[4] += 66214079;
-    phase_[5] += 93952409;
-
-    int16_t noise = 0;
-    noise += phase_[0] >> 31;
-    noise += phase_[1] >> 31;
-    noise += phase_[2] >> 31;
-    noise += phase_[3] >> 31;
-    noise += phase_[4] >> 31;
-    noise += phase_[5] >> 31;
-    noise <<= 12;
+    int16_t noise = *metallic_noise_ptr++ << 12;
 
     // Run the SVF at the double of the original sample rate for stability.
     int32_t filtered_noise = 0;
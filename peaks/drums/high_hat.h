@@ -35,6 +35,8 @@
 
 #include "stmlib/stmlib.h"
 
+#include "braids/metallic_noise.h"
+
 #include "peaks/drums/svf.h"
 #include "peaks/drums/excitation.h"
 
@@ -94,11 +96,13 @@ class HighHat {
   }
 
  private:
+  void ProcessBlock(const GateFlags* gate_flags, int16_t* out, size_t size);
+
   Svf noise_;
   // Svf vca_coloration_;
   Excitation vca_envelope_;
 
-  uint32_t phase_[6];
+  braids::MetallicNoise metallic_noise_;
 
   uint16_t frequency_randomness_ ;
   uint16_t decay_randomness_ ;
@@ -1,6 +1,10 @@
-// Copyright 2015 Olivier Gillet.
+// Copyright 2015 Olivier Gillet, 2015 Tim Churches
 //
 // Author: Olivier Gillet (ol.gillet@gmail.com)
+// Modifications: Tim Churches (tim.churches@gmail.com)
+// Modifications may be determined by examining the differences between the last commit
+// by Olivier Gillet (pichenettes) and the HEAD commit at
+// https://github.com/timchurches/Mutated-Mutables/tree/master/peaks
 //
 // Permission is hereby granted, free of charge, to any person obtaining a copy
 // of this software and associated documentation files (the "Software"), to deal
@@ -36,15 +40,24 @@
 
 namespace peaks {
 
+// The block size trades latency for CPU: the processors are dispatched, and
+// the pots polled, once per block. The latency from gate input to output is
+// kNumBlocks * kBlockSize samples (0.17ms with 4-sample blocks, 1.3ms with
+// 32-sample blocks). Build with, for example, -DPEAKS_BLOCK_SIZE=16.
+#ifndef PEAKS_BLOCK_SIZE
+#define PEAKS_BLOCK_SIZE 4
+#endif  // PEAKS_BLOCK_SIZE
+
 const size_t kNumBlocks = 2;
 const size_t kNumChannels = 2;
-const size_t kBlockSize = 4;
+const size_t kBlockSize = PEAKS_BLOCK_SIZE;
 
-class IOBuffer {
+template<size_t block_size, size_t num_blocks>
+class BlockBuffer {
  public:
   struct Block {
-    GateFlags input[kNumChannels][kBlockSize];
-    uint16_t output[kNumChannels][kBlockSize];
+    GateFlags input[kNumChannels][block_size];
+    uint16_t output[kNumChannels][block_size];
   };
   
   struct Slice {
@@ -54,19 +67,19 @@ class IOBuffer {
 
   typedef void ProcessFn(Block* block, size_t size);
 
-  IOBuffer() { }
-  ~IOBuffer() { }
+  BlockBuffer() { }
+  ~BlockBuffer() { }
   
   void Init() {
     io_block_ = 0;
-    render_block_ = kNumBlocks / 2;
+    render_block_ = num_blocks / 2;
     io_frame_ = 0;
   }
   
   inline void Process(ProcessFn* fn) {
     while (render_block_ != io_block_) {
-      (*fn)(&block_[render_block_], kBlockSize);
-      render_block_ = (render_block_ + 1) % kNumBlocks;
+      (*fn)(&block_[render_block_], block_size);
+      render_block_ = (render_block_ + 1) % num_blocks;
     }
   }
   
@@ -75,9 +88,9 @@ class IOBuffer {
     s.block = &block_[io_block_];
     s.frame_index = io_frame_;
     io_frame_ += size;
-    if (io_frame_ >= kBlockSize) {
-      io_frame_ -= kBlockSize;
-      io_block_ = (io_block_ + 1) % kNumBlocks;
+    if (io_frame_ >= block_size) {
+      io_frame_ -= block_size;
+      io_block_ = (io_block_ + 1) % num_blocks;
     }
     return s;
   }
@@ -87,15 +100,23 @@ class IOBuffer {
   }
   
  private:
-  Block block_[kNumBlocks];
+  STATIC_ASSERT(
+      block_size == 4 || block_size == 8 || block_size == 16 ||
+      block_size == 32,
+      unsupported_block_size);
+  STATIC_ASSERT(num_blocks >= 2, not_enough_blocks);
+
+  Block block_[num_blocks];
   
   size_t io_frame_;
   volatile size_t io_block_;
   volatile size_t render_block_;
   
-  DISALLOW_COPY_AND_ASSIGN(IOBuffer);
+  DISALLOW_COPY_AND_ASSIGN(BlockBuffer);
 };
 
+typedef BlockBuffer<kBlockSize, kNumBlocks> IOBuffer;
+
 }  // namespace peaks
 
 #endif  // PEAKS_IO_BUFFER_H_
@@ -40,6 +40,16 @@ const uint8_t kMaxEquationIndex = 1;
 
 using namespace stmlib;
 
+// The Cortex-M3 returns 0 for a division by zero, where the host traps.
+// The equations below rely on the former with some parameter values.
+inline uint32_t Div(uint32_t a, uint32_t b) {
+  return b ? a / b : 0;
+}
+
+inline uint32_t Mod(uint32_t a, uint32_t b) {
+  return b ? a % b : a;
+}
+
 void ByteBeats::Init() {
   frequency_ = 32678;
   phase_ = 0;
@@ -49,6 +59,46 @@ void ByteBeats::Init() {
   equation_index_ = 0;
 }
 
+#ifdef PEAKS_BYTEBEAT_VM
+void ByteBeats::ProcessProgram(
+    const braids::BytebeatVm& program,
+    uint16_t bytepitch,
+    const GateFlags* gate_flags,
+    int16_t* out,
+    size_t size) {
+  uint32_t t[braids::kMaxBytebeatBlockSize];
+  uint32_t value[braids::kMaxBytebeatBlockSize];
+  while (size > 0) {
+    // One value of the formula for every kDownsample samples.
+    size_t n = 0;
+    size_t remaining = size;
+    while (remaining > 0 && n < braids::kMaxBytebeatBlockSize) {
+      size_t cycles = (remaining > kDownsample) ? kDownsample : remaining;
+      for (size_t i = 0; i < cycles; ++i) {
+        if (*gate_flags++ & GATE_FLAG_RISING) {
+          phase_ = 0;
+          t_ = 0;
+        }
+      }
+      ++phase_;
+      if (phase_ % bytepitch == 0) ++t_;
+      t[n++] = t_;
+      remaining -= cycles;
+    }
+    program.Evaluate(t, p0_, p1_, p2_, value, n);
+    for (size_t i = 0; i < n; ++i) {
+      int32_t sample = (value[i] & 0xff) << 8;
+      CLIP(sample)
+      size_t cycles = (size > kDownsample) ? kDownsample : size;
+      size -= cycles;
+      while (cycles--) {
+        *out++ = sample;
+      }
+    }
+  }
+}
+#endif  // PEAKS_BYTEBEAT_VM
+
 void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size) {
   uint32_t p0 = 0;
   uint32_t p1 = 0;
@@ -64,6 +114,14 @@ void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size)
     bytepitch = 1;
   }
   equation_index_ = p2_ >> 13 ;
+#ifdef PEAKS_BYTEBEAT_VM
+  if (equation_index_ < kNumByteBeatsPrograms &&
+      programs_[equation_index_].loaded()) {
+    ProcessProgram(
+        programs_[equation_index_], bytepitch, gate_flags, out, size);
+    return;
+  }
+#endif  // PEAKS_BYTEBEAT_VM
 
   while (size > 0) {
     int cycles = (size > kDownsample) ? kDownsample : size;
@@ -109,7 +167,7 @@ void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size)
         p0 = p0_ >> 11;
         p1 = p1_ >> 9;
         // This one is the second one listed at from http://xifeng.weebly.com/bytebeats.html
-        sample = ((( (((((t_ >> p0) | t_) | (t_ >> p0)) * 10) & ((5 * t_) | (t_ >> 10)) ) | (t_ ^ (t_ % p1)) ) & 0xFF)) << 8 ;
+        sample = ((( (((((t_ >> p0) | t_) | (t_ >> p0)) * 10) & ((5 * t_) | (t_ >> 10)) ) | (t_ ^ Mod(t_, p1)) ) & 0xFF)) << 8 ;
         break;
       case 4:
         p0 = p0_ >> 12; // was 9
@@ -117,7 +175,7 @@ void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size)
         //  BitWiz Transplant from Equation Composer Ptah bank
         // run at twice normal sample rate
         for (j = 0; j < 2; ++j) {
-          sample = t_*(((t_>>p1)^((t_>>p1)-1)^1)%p0) ;
+          sample = t_*Mod(((t_>>p1)^((t_>>p1)-1)^1), p0) ;
           if (j == 0) ++t_ ;
         }
         break;
@@ -128,8 +186,8 @@ void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size)
         // run at twice normal sample rate
         // for (uint8_t j = 0; j < 2; ++j) {
           p = ((t_/(1236+p0)) % 128) & ((t_>>(p1>>5))*p1);
-          q = (t_/(t_/((500*p1) % 5) + 1)) % p;
-          sample = (t_>>q>>(p1>>5)) + (t_/(t_>>((p1>>5)&12))>>p);
+          q = Mod(t_/(Div(t_, (500*p1) % 5) + 1), p);
+          sample = (t_>>q>>(p1>>5)) + (Div(t_, t_>>((p1>>5)&12))>>p);
         //  if (j == 0) ++t_ ;
         // }
         break;
@@ -137,26 +195,26 @@ void ByteBeats::Process(const GateFlags* gate_flags, int16_t* out, size_t size)
         p0 = p0_ >> 9;
         p1 = p1_ >> 10; // was 9
         // The Smoker from Equation Composer Khepri bank
-        sample = sample ^ (t_>>(p1>>4)) >> ((t_/6988*t_%(p0+1))+(t_<<t_/(p1 * 4)));
+        sample = sample ^ (t_>>(p1>>4)) >> ((t_/6988*t_%(p0+1))+(t_<<Div(t_, p1 * 4)));
         break;
       default:
         p0 = p0_ >> 9;
-        p1 = t_ % p1_ ;
+        p1 = Mod(t_, p1_) ;
         // // run at twice normal sample rate
         for (j = 0; j < 2; ++j) {
           // Warping overtone echo drone, from BitWiz
-          sample = ((t_&p0)-(t_%p1))^(t_>>7);
+          sample = ((t_&p0)-Mod(t_, p1))^(t_>>7);
           // sample = t_*(((t_>>p1)^((t_>>p1)-1)^1)%p0) ;
           if (j == 0) ++t_ ;
         }
         break;
     }
     CLIP(sample)
-    cycles = kDownsample;
+    // The last value is cut short when size is not a multiple of
+    // kDownsample.
+    size -= cycles;
     while (cycles-- > 0) {
-      if (size-- > 0) {
-        *out++ = sample;
-      }
+      *out++ = sample;
     }
   }
 }
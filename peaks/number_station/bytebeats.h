@@ -34,8 +34,18 @@
 #include "peaks/drums/svf.h"
 #include "peaks/gate_processor.h"
 
+#ifdef PEAKS_BYTEBEAT_VM
+#include "braids/bytebeat_vm.h"
+#endif  // PEAKS_BYTEBEAT_VM
+
 namespace peaks {
 
+#ifdef PEAKS_BYTEBEAT_VM
+// The formulas of the first equations can be replaced by bytebeat programs.
+// There is no way to load them on the module yet.
+const size_t kNumByteBeatsPrograms = 4;
+#endif  // PEAKS_BYTEBEAT_VM
+
 class ByteBeats {
  public:
   ByteBeats() { }
@@ -73,7 +83,32 @@ class ByteBeats {
     p2_ = parameter;
   }
 
+#ifdef PEAKS_BYTEBEAT_VM
+  // Replaces the built-in formula of one of the first equations with a
+  // program for the VM, or restores it if program is NULL. p0, p1 and p2 are
+  // the 16-bit parameters, see braids/bytebeat_vm.h.
+  inline bool set_program(
+      uint8_t index,
+      const uint8_t* program,
+      size_t size) {
+    if (!program) {
+      programs_[index].Unload();
+      return true;
+    }
+    return programs_[index].Load(program, size);
+  }
+#endif  // PEAKS_BYTEBEAT_VM
+
  private:
+#ifdef PEAKS_BYTEBEAT_VM
+  void ProcessProgram(
+      const braids::BytebeatVm& program,
+      uint16_t bytepitch,
+      const GateFlags* gate_flags,
+      int16_t* out,
+      size_t size);
+#endif  // PEAKS_BYTEBEAT_VM
+
   uint16_t frequency_;
   uint16_t p0_;
   uint16_t p1_;
@@ -81,7 +116,9 @@ class ByteBeats {
   uint32_t t_;
   uint32_t phase_;
   uint8_t equation_index_ ;
-
+#ifdef PEAKS_BYTEBEAT_VM
+  braids::BytebeatVm programs_[kNumByteBeatsPrograms];
+#endif  // PEAKS_BYTEBEAT_VM
 
 
   DISALLOW_COPY_AND_ASSIGN(ByteBeats);
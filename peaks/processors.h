@@ -85,6 +85,12 @@ enum ProcessorFunction {
   PROCESSOR_FUNCTION_LAST
 };
 
+// The pulse shaper and pulse randomizer update their state once per call,
+// and their delays and durations are counted in 4-sample blocks. Larger
+// blocks are split before being passed to them.
+const size_t kPulseProcessorBlockSize = 4;
+const size_t kMaxProcessorBlockSize = 0xffff;
+
 #define DECLARE_PROCESSOR(ClassName, variable) \
   void ClassName ## Init() { \
     variable.Init(); \
@@ -134,6 +140,10 @@ class Processors {
     fmlfo_.set_mod_type(function == PROCESSOR_FUNCTION_RFMLFO);
     wsmlfo_.set_mod_type(function == PROCESSOR_FUNCTION_RWSMLFO);
     plo_.set_sync(function == PROCESSOR_FUNCTION_PLO);
+    max_block_size_ = function == PROCESSOR_FUNCTION_PULSE_SHAPER ||
+        function == PROCESSOR_FUNCTION_PULSE_RANDOMIZER
+            ? kPulseProcessorBlockSize
+            : kMaxProcessorBlockSize;
     callbacks_ = callbacks_table_[function];
     if (function != PROCESSOR_FUNCTION_TAP_LFO and
         function != PROCESSOR_FUNCTION_PLO) {
@@ -145,6 +155,12 @@ class Processors {
   inline ProcessorFunction function() const { return function_; }
 
   inline void Process(const GateFlags* gate_flags, int16_t* output, size_t size) {
+    while (size > max_block_size_) {
+      (this->*callbacks_.process_fn)(gate_flags, output, max_block_size_);
+      gate_flags += max_block_size_;
+      output += max_block_size_;
+      size -= max_block_size_;
+    }
     (this->*callbacks_.process_fn)(gate_flags, output, size);
   }
 
@@ -157,6 +173,7 @@ class Processors {
 
   ControlMode control_mode_;
   ProcessorFunction function_;
+  size_t max_block_size_;
   uint16_t parameter_[4];
 
   ProcessorCallbacks callbacks_;
@@ -0,0 +1,242 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Cost of the block size of the IOBuffer.
+//
+// Usage:
+//   io_buffer_benchmark [-f function] [-s seconds]
+//
+// Replays the firmware loop of peaks.cc on both channels: one slice per
+// sample on the DAC interrupt side, one Process call per block on the main
+// loop side. Prints the time per sample for 4, 8, 16 and 32-sample blocks,
+// with still pots, and with moving pots (Configure() called on every block,
+// as when the pots are turned).
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "peaks/io_buffer.h"
+#include "peaks/processors.h"
+
+using namespace peaks;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 48000;
+const size_t kNumRuns = 3;
+
+const char* const function_names[PROCESSOR_FUNCTION_LAST] = {
+  "envelope",
+  "lfo",
+  "tap_lfo",
+  "bass_drum",
+  "snare_drum",
+  "high_hat",
+  "fm_drum",
+  "pulse_shaper",
+  "pulse_randomizer",
+  "mini_sequencer",
+  "number_station",
+  "bytebeats",
+  "dual_attack_envelope",
+  "repeating_attack_envelope",
+  "looping_envelope",
+  "randomised_envelope",
+  "bouncing_ball",
+  "randomised_bass_drum",
+  "randomised_snare_drum",
+  "turing_machine",
+  "mod_sequencer",
+  "fmlfo",
+  "rfmlfo",
+  "wsmlfo",
+  "rwsmlfo",
+  "plo"
+};
+
+std::vector<GateFlags> gate_flags;
+bool moving_pots;
+uint16_t pot_value;
+int16_t output_buffer[32];
+int32_t checksum;
+
+// The main loop and DAC interrupt of peaks.cc, for a given block size.
+template<size_t block_size>
+class FirmwareLoop {
+ public:
+  typedef BlockBuffer<block_size, kNumBlocks> Buffer;
+
+  static void Process(typename Buffer::Block* block, size_t size) {
+    if (moving_pots) {
+      pot_value += 64;
+      for (size_t i = 0; i < kNumChannels; ++i) {
+        for (uint8_t j = 0; j < 4; ++j) {
+          processors[i].set_parameter(j, pot_value + (j << 12));
+        }
+      }
+    }
+    for (size_t i = 0; i < kNumChannels; ++i) {
+      processors[i].Process(block->input[i], output_buffer, size);
+      for (size_t j = 0; j < size; ++j) {
+        block->output[i][j] = output_buffer[j] + 32768;
+      }
+    }
+  }
+
+  static void Run() {
+    io_buffer_.Init();
+    for (size_t t = 0; t < gate_flags.size(); ++t) {
+      if (io_buffer_.new_block()) {
+        io_buffer_.Process(&Process);
+      }
+      typename Buffer::Slice slice = io_buffer_.NextSlice(1);
+      GateFlags flags = gate_flags[t];
+      checksum += slice.block->output[0][slice.frame_index];
+      checksum += slice.block->output[1][slice.frame_index];
+      slice.block->input[0][slice.frame_index] = flags | (flags << 4);
+      slice.block->input[1][slice.frame_index] = flags;
+    }
+  }
+
+ private:
+  static Buffer io_buffer_;
+};
+
+template<size_t block_size>
+typename FirmwareLoop<block_size>::Buffer FirmwareLoop<block_size>::io_buffer_;
+
+typedef void (*RunFn)();
+
+struct BlockSizeSetting {
+  size_t block_size;
+  RunFn run_fn;
+};
+
+const BlockSizeSetting block_size_settings[] = {
+  { 4, &FirmwareLoop<4>::Run },
+  { 8, &FirmwareLoop<8>::Run },
+  { 16, &FirmwareLoop<16>::Run },
+  { 32, &FirmwareLoop<32>::Run },
+};
+
+const size_t kNumSettings = \
+    sizeof(block_size_settings) / sizeof(BlockSizeSetting);
+
+// Gate input of the whole run: a 4 Hz clock, 25% duty cycle.
+void MakeGateFlags(uint32_t duration) {
+  const uint32_t period = kSampleRate / 4;
+  gate_flags.resize(duration * kSampleRate);
+  GateFlags previous = GATE_FLAG_LOW;
+  for (size_t i = 0; i < gate_flags.size(); ++i) {
+    previous = ExtractGateFlags(previous, i % period < (period / 4));
+    gate_flags[i] = previous;
+  }
+}
+
+// Best of several runs, in ns per sample (for both channels).
+double Time(ProcessorFunction function, RunFn run_fn) {
+  double best = 0.0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    for (uint8_t i = 0; i < kNumChannels; ++i) {
+      processors[i].Init(i);
+      processors[i].set_function(function);
+    }
+    pot_value = 0;
+    clock_t start = clock();
+    (*run_fn)();
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best * 1e9 / gate_flags.size();
+}
+
+void PrintTable(int function, bool moving) {
+  moving_pots = moving;
+  printf("%s pots, ns/sample\n", moving ? "Moving" : "Still");
+  printf("%-26s", "function");
+  for (size_t i = 0; i < kNumSettings; ++i) {
+    printf(" %8zu", block_size_settings[i].block_size);
+  }
+  printf("  %8s\n", "32 vs 4");
+  for (int i = 0; i < PROCESSOR_FUNCTION_LAST; ++i) {
+    if (function != -1 && i != function) {
+      continue;
+    }
+    printf("%-26s", function_names[i]);
+    double t[kNumSettings];
+    for (size_t j = 0; j < kNumSettings; ++j) {
+      t[j] = Time(static_cast<ProcessorFunction>(i),
+          block_size_settings[j].run_fn);
+      printf(" %8.2f", t[j]);
+    }
+    printf("  %7.0f%%\n", t[0] > 0.0 ? 100.0 * (t[kNumSettings - 1] - t[0]) /
+        t[0] : 0.0);
+  }
+  printf("\n");
+}
+
+int main(int argc, char** argv) {
+  int function = -1;
+  uint32_t duration = 2;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-f")) {
+      const char* name = argv[++i];
+      function = PROCESSOR_FUNCTION_LAST;
+      for (int j = 0; j < PROCESSOR_FUNCTION_LAST; ++j) {
+        if (!strcmp(name, function_names[j])) {
+          function = j;
+        }
+      }
+    } else if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+      duration = atoi(argv[++i]);
+    } else {
+      function = PROCESSOR_FUNCTION_LAST;
+      break;
+    }
+  }
+  if (function == PROCESSOR_FUNCTION_LAST || !duration) {
+    fprintf(stderr, "Usage: %s [-f function] [-s seconds]\n", argv[0]);
+    return 1;
+  }
+
+  MakeGateFlags(duration);
+  printf("Latency:");
+  for (size_t i = 0; i < kNumSettings; ++i) {
+    size_t latency = block_size_settings[i].block_size * kNumBlocks;
+    printf(" %zu samples (%.2fms)%s", latency, 1000.0 * latency / kSampleRate,
+        i == kNumSettings - 1 ? ".\n\n" : ",");
+  }
+  PrintTable(function, false);
+  PrintTable(function, true);
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return 0;
+}
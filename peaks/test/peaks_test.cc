@@ -1,6 +1,7 @@
-// Copyright 2013 Olivier Gillet.
+// Copyright 2013 Olivier Gillet, 2015 Tim Churches
 //
 // Author: Olivier Gillet (ol.gillet@gmail.com)
+// Modifications: Tim Churches (tim.churches@gmail.com)
 //
 // This program is free software: you can redistribute it and/or modify
 // it under the terms of the GNU General Public License as published by
@@ -12,78 +13,174 @@
 // GNU General Public License for more details.
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
+//
+// -----------------------------------------------------------------------------
+//
+// Batch renderer of the processor functions.
+//
+// Usage:
+//   peaks_test [-f function] [-s seconds] [-b block_size] [-w]
+//
+// Every ProcessorFunction, or only the one given with -f, is driven by a
+// clock on the gate input (4 Hz, 25% duty cycle) and rendered in large
+// blocks, and its throughput is reported. -w writes the output of each
+// function to <function>.wav. The test fails if a function renders silence.
 
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <ctime>
+#include <vector>
 
 #include "peaks/processors.h"
 
+#include "stmlib/algorithms/pattern_predictor.h"
 #include "stmlib/test/wav_writer.h"
 
 using namespace peaks;
 using namespace stmlib;
 
 const uint32_t kSampleRate = 48000;
+const size_t kNumRuns = 3;
 
-void write_wav_header(FILE* fp, int num_samples, int num_channels) {
-  uint32_t l;
-  uint16_t s;
-  
-  fwrite("RIFF", 4, 1, fp);
-  l = 36 + num_samples * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-  fwrite("WAVE", 4, 1, fp);
-  
-  fwrite("fmt ", 4, 1, fp);
-  l = 16;
-  fwrite(&l, 4, 1, fp);
-  s = 1;
-  fwrite(&s, 2, 1, fp);
-  s = num_channels;
-  fwrite(&s, 2, 1, fp);
-  l = kSampleRate;
-  fwrite(&l, 4, 1, fp);
-  l = static_cast<uint32_t>(kSampleRate) * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-  s = 2 * num_channels;
-  fwrite(&s, 2, 1, fp);
-  s = 16;
-  fwrite(&s, 2, 1, fp);
-  
-  fwrite("data", 4, 1, fp);
-  l = num_samples * 2 * num_channels;
-  fwrite(&l, 4, 1, fp);
-}
+const char* const function_names[PROCESSOR_FUNCTION_LAST] = {
+  "envelope",
+  "lfo",
+  "tap_lfo",
+  "bass_drum",
+  "snare_drum",
+  "high_hat",
+  "fm_drum",
+  "pulse_shaper",
+  "pulse_randomizer",
+  "mini_sequencer",
+  "number_station",
+  "bytebeats",
+  "dual_attack_envelope",
+  "repeating_attack_envelope",
+  "looping_envelope",
+  "randomised_envelope",
+  "bouncing_ball",
+  "randomised_bass_drum",
+  "randomised_snare_drum",
+  "turing_machine",
+  "mod_sequencer",
+  "fmlfo",
+  "rfmlfo",
+  "wsmlfo",
+  "rwsmlfo",
+  "plo"
+};
 
-void TestFMDrum() {
-  WavWriter wav_writer(1, kSampleRate, 10);
-  wav_writer.Open("fm_drum.wav");
+// Gate input of the whole render: a 4 Hz clock, 25% duty cycle.
+void MakeGateFlags(std::vector<GateFlags>* gate_flags) {
+  const uint32_t period = kSampleRate / 4;
+  GateFlags previous = GATE_FLAG_LOW;
+  for (size_t i = 0; i < gate_flags->size(); ++i) {
+    previous = ExtractGateFlags(previous, i % period < (period / 4));
+    (*gate_flags)[i] = previous;
+  }
+}
 
-  processors[0].Init(1);
+void Configure(ProcessorFunction function) {
+  processors[0].Init(0);
   processors[0].set_control_mode(CONTROL_MODE_FULL);
-  processors[0].set_function(PROCESSOR_FUNCTION_FM_DRUM);
+  processors[0].set_function(function);
   processors[0].set_parameter(0, 25000);
   processors[0].set_parameter(1, 8192);
-  processors[0].set_parameter(2, 65535);
-  processors[0].set_parameter(3, 0);
+  processors[0].set_parameter(2, 40000);
+  processors[0].set_parameter(3, 32768);
+  if (function == PROCESSOR_FUNCTION_BYTEBEATS) {
+    // The gate resets the formula every 250ms. At the default settings, t
+    // does not grow large enough for the formula to output anything but
+    // zeros, and the last parameter selects an equation which is always
+    // silent with these settings: use the first equation, at a high rate.
+    processors[0].set_parameter(0, 60000);
+    processors[0].set_parameter(3, 0);
+  }
+}
+
+struct Statistics {
+  double ns_per_sample;
+  int32_t peak;
+  double rms;
+};
 
-  uint32_t period = kSampleRate / 2;
-  for (uint32_t i = 0; i < kSampleRate * 10 ; ++i) {
-    uint16_t tri = i;
-    tri = tri > 32767 ? 65535 - tri : tri;
-    uint8_t gate_flag = 0;
-    if (i % period < (period / 4)) {
-      control |= CONTROL_GATE;
+// Renders the whole gate input in blocks of block_size samples. The timing
+// is the best of several runs; the output is that of the last run.
+void Render(
+    ProcessorFunction function,
+    const std::vector<GateFlags>& gate_flags,
+    size_t block_size,
+    std::vector<int16_t>* output,
+    Statistics* statistics) {
+  size_t num_samples = gate_flags.size();
+  double best = 0.0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    Configure(function);
+    clock_t start = clock();
+    for (size_t i = 0; i < num_samples; i += block_size) {
+      processors[0].Process(&gate_flags[i], &(*output)[i],
+          std::min(block_size, num_samples - i));
     }
-    if (i % period == 0) {
-      control |= GATE_FLAG_RISING;
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
     }
-    int16_t s = processors[0].Process(control);
-    wav_writer.WriteFrames(&s, 1);
-    processors[0].Buffer();
   }
+  double sum_squares = 0.0;
+  int32_t peak = 0;
+  for (size_t i = 0; i < num_samples; ++i) {
+    int32_t s = (*output)[i];
+    sum_squares += static_cast<double>(s) * s;
+    peak = std::max(peak, s < 0 ? -s : s);
+  }
+  statistics->ns_per_sample = best * 1e9 / num_samples;
+  statistics->peak = peak;
+  statistics->rms = sqrt(sum_squares / num_samples);
+}
+
+// Returns false if a function rendered nothing but silence, in which case
+// its timing measures nothing.
+bool RenderAll(
+    int function,
+    uint32_t duration,
+    size_t block_size,
+    bool write_wav) {
+  const double kSamplePeriodNs = 1e9 / kSampleRate;
+  std::vector<GateFlags> gate_flags(duration * kSampleRate);
+  std::vector<int16_t> output(gate_flags.size());
+  MakeGateFlags(&gate_flags);
+  printf("%u s at %u Hz, blocks of %zu samples.\n\n",
+      duration, kSampleRate, block_size);
+  printf("%-26s %10s %10s %8s %8s\n",
+      "function", "ns/sample", "realtime", "peak", "rms");
+  bool success = true;
+  for (int i = 0; i < PROCESSOR_FUNCTION_LAST; ++i) {
+    if (function != -1 && i != function) {
+      continue;
+    }
+    Statistics s;
+    Render(static_cast<ProcessorFunction>(i), gate_flags, block_size,
+        &output, &s);
+    if (write_wav) {
+      char file_name[64];
+      sprintf(file_name, "%s.wav", function_names[i]);
+      WavWriter wav_writer(1, kSampleRate, duration);
+      wav_writer.Open(file_name);
+      wav_writer.WriteFrames(&output[0], output.size());
+    }
+    printf("%-26s %10.2f %9.0fx %8d %8.0f\n", function_names[i],
+        s.ns_per_sample,
+        s.ns_per_sample > 0.0 ? kSamplePeriodNs / s.ns_per_sample : 0.0,
+        s.peak, s.rms);
+    if (s.peak == 0) {
+      printf("%s: silent output\n", function_names[i]);
+      success = false;
+    }
+  }
+  return success;
 }
 
 void TestPatternPredictor() {
@@ -109,7 +206,40 @@ void TestPatternPredictor() {
   }
 }
 
-int main(void) {
-  TestFMDrum();
+int main(int argc, char** argv) {
+  int function = -1;
+  uint32_t duration = 10;
+  size_t block_size = 1024;
+  bool write_wav = false;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-f")) {
+      const char* name = argv[++i];
+      function = PROCESSOR_FUNCTION_LAST;
+      for (int j = 0; j < PROCESSOR_FUNCTION_LAST; ++j) {
+        if (!strcmp(name, function_names[j])) {
+          function = j;
+        }
+      }
+    } else if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+      duration = atoi(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-b")) {
+      block_size = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-w")) {
+      write_wav = true;
+    } else {
+      function = PROCESSOR_FUNCTION_LAST;
+      break;
+    }
+  }
+  if (function == PROCESSOR_FUNCTION_LAST || block_size < 1 || !duration) {
+    fprintf(stderr,
+        "Usage: %s [-f function] [-s seconds] [-b block_size] [-w]\n",
+        argv[0]);
+    return 1;
+  }
+  if (!RenderAll(function, duration, block_size, write_wav)) {
+    return 1;
+  }
   TestPatternPredictor();
+  return 0;
 }
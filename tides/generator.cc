@@ -41,12 +41,57 @@ namespace tides {
 using namespace stmlib;
 
 const int16_t kOctave = 12 * 128;
-const uint16_t kSlopeBits = 12;
 const uint32_t kSyncCounterMaxTime = 8 * 48000;
 
 const int32_t kDownsampleCoefficient[4] = { 17162, 19069, 17162, 12140 };
 
 
+// Sources of control bytes and sinks of samples for the rendering code: the
+// ring buffers used on the module, or the arrays passed to Render().
+class RingBufferSource {
+ public:
+  RingBufferSource(RingBuffer<uint8_t, kBlockSize * 2>* buffer)
+      : buffer_(buffer) { }
+  inline uint8_t Read() { return buffer_->ImmediateRead(); }
+
+ private:
+  RingBuffer<uint8_t, kBlockSize * 2>* buffer_;
+};
+
+class RingBufferSink {
+ public:
+  RingBufferSink(RingBuffer<GeneratorSample, kBlockSize * 2>* buffer)
+      : buffer_(buffer) { }
+  inline void Write(const GeneratorSample& sample) {
+    buffer_->Overwrite(sample);
+  }
+
+ private:
+  RingBuffer<GeneratorSample, kBlockSize * 2>* buffer_;
+};
+
+class ArraySource {
+ public:
+  ArraySource(const uint8_t* control) : control_(control) { }
+  inline uint8_t Read() { return *control_++; }
+
+ private:
+  const uint8_t* control_;
+};
+
+class ArraySink {
+ public:
+  ArraySink(const GeneratorBuffers& buffers) : buffers_(buffers) { }
+  inline void Write(const GeneratorSample& sample) {
+    *buffers_.unipolar++ = sample.unipolar;
+    *buffers_.bipolar++ = sample.bipolar;
+    *buffers_.flags++ = sample.flags;
+  }
+
+ private:
+  GeneratorBuffers buffers_;
+};
+
 /* static */
 const FrequencyRatio Generator::frequency_ratios_[] = {
   { 1, 1 },
@@ -72,6 +117,9 @@ void Generator::Init() {
   range_ = GENERATOR_RANGE_HIGH;
   clock_divider_ = 1;
   phase_ = 0;
+  // Reset before set_pitch(), which depends on them.
+  sync_ = false;
+  previous_pitch_ = 0;
   set_pitch(60 << 7);
   output_buffer_.Init();
   input_buffer_.Init();
@@ -91,18 +139,26 @@ void Generator::Init() {
   smoothed_slope_ = 0;
   smoothness_ = 0;
   
+  setup_dirty_ = SETUP_PITCH | SETUP_SLOPE | SETUP_SHAPER | SETUP_CUTOFF;
+  setup_pitch_ = 0;
+  
   previous_sample_.unipolar = previous_sample_.bipolar = 0;
+  previous_sample_.flags = 0;
   running_ = false;
+  wrap_ = false;
+  eor_counter_ = 0;
+  sub_phase_ = 0;
+  x_ = y_ = z_ = 0;
   
   ClearFilterState();
   
   sync_counter_ = kSyncCounterMaxTime;
   frequency_ratio_.p = 1;
   frequency_ratio_.q = 1;
-  sync_ = false;
   phase_increment_ = 9448928;
   local_osc_phase_increment_ = phase_increment_;
   target_phase_increment_ = phase_increment_;
+  local_osc_phase_ = 0;
 }
 
 void Generator::ComputeFrequencyRatio(int16_t pitch) {
@@ -131,7 +187,10 @@ void Generator::ComputeFrequencyRatio(int16_t pitch) {
   }
 }
 
-uint32_t Generator::ComputePhaseIncrement(int16_t pitch) {
+/* static */
+uint32_t Generator::ComputePhaseIncrement(
+    int16_t pitch,
+    uint32_t clock_divider) {
   int16_t num_shifts = 0;
   while (pitch < 0) {
     pitch += kOctave;
@@ -146,7 +205,7 @@ uint32_t Generator::ComputePhaseIncrement(int16_t pitch) {
   uint32_t b = lut_increments[(pitch >> 4) + 1];
   uint32_t phase_increment = a + ((b - a) * (pitch & 0xf) >> 4);
   // Compensate for downsampling
-  phase_increment *= clock_divider_;
+  phase_increment *= clock_divider;
   return num_shifts >= 0
       ? phase_increment << num_shifts
       : phase_increment >> -num_shifts;
@@ -177,8 +236,12 @@ int16_t Generator::ComputePitch(uint32_t phase_increment) {
   return pitch;
 }
 
-int32_t Generator::ComputeCutoffFrequency(int16_t pitch, int16_t smoothness) {
-  uint8_t shifts = clock_divider_;
+/* static */
+int32_t Generator::ComputeCutoffFrequency(
+    int16_t pitch,
+    int16_t smoothness,
+    uint32_t clock_divider) {
+  uint8_t shifts = clock_divider;
   while (shifts > 1) {
     shifts >>= 1;
     pitch += kOctave;
@@ -233,6 +296,77 @@ int32_t Generator::ComputeAntialiasAttenuation(
   return p;
 }
 
+void Generator::ComputeAudioRateSetup(uint8_t flags) {
+#ifndef CORE_ONLY
+  AudioRateSetup* s = &setup_;
+  if (antialiasing_) {
+    flags |= SETUP_SHAPER;
+  }
+  
+  // Load wavetable pointers for bandlimiting - they depend on pitch value.
+  if (flags & SETUP_PITCH) {
+    uint16_t xfade = pitch_ << 6;
+    uint16_t index = pitch_ >> 10;
+    if (pitch_ < 0) {
+      index = 0;
+      xfade = 0;
+    }
+    s->wave_1 = waveform_table[WAV_BANDLIMITED_PARABOLA_0 + index];
+    s->wave_2 = waveform_table[WAV_BANDLIMITED_PARABOLA_0 + index + 1];
+    s->xfade = xfade;
+    flags |= SETUP_CUTOFF;
+  }
+
+  // The gain compensation and the phase offsets only depend on the slope,
+  // and it is not worth paying for a division when the pitch moves.
+  if (flags & SETUP_SLOPE) {
+    int32_t gain = slope_;
+    gain = (32768 - (gain * gain >> 15)) * 3 >> 1;
+    s->gain = 32768 * 1024 / gain;
+    s->phase_offset_a_bi = (slope_ - (slope_ >> 1)) << 16;
+    s->phase_offset_b_bi = (32768 - (slope_ >> 1)) << 16;
+    s->phase_offset_b_uni = (32768 + 49152 - slope_) << 16;
+  }
+  
+  if (flags & SETUP_SHAPER) {
+    int32_t attenuation = 32767;
+    if (antialiasing_) {
+      attenuation = ComputeAntialiasAttenuation(
+            pitch_,
+            slope_,
+            shape_,
+            smoothness_);
+    }
+
+    uint16_t shape = static_cast<uint16_t>(
+        (shape_ * attenuation >> 15) + 32768);
+    uint16_t wave_index = WAV_INVERSE_TAN_AUDIO + (shape >> 14);
+    s->shape_1 = waveform_table[wave_index];
+    s->shape_2 = waveform_table[wave_index + 1];
+    s->shape_xfade = shape << 2;
+    s->wf_gain = 2048;
+    s->wf_balance = 0;
+    if (smoothness_ > 0) {
+      int16_t attenuated_smoothness = smoothness_ * attenuation >> 15;
+      s->wf_gain += attenuated_smoothness * (32767 - 1024) >> 14;
+      s->wf_balance = attenuated_smoothness;
+    }
+  }
+  
+  if (flags & SETUP_CUTOFF) {
+    int32_t frequency = ComputeCutoffFrequency(
+        pitch_,
+        smoothness_,
+        clock_divider_);
+    int32_t f_a = lut_cutoff[frequency >> 7] >> 16;
+    int32_t f_b = lut_cutoff[(frequency >> 7) + 1] >> 16;
+    s->f = f_a + ((f_b - f_a) * (frequency & 0x7f) >> 7);
+  }
+#endif  // CORE_ONLY
+  setup_pitch_ = pitch_;
+  setup_dirty_ = 0;
+}
+
 // There are to our knowledge three ways of generating an "asymmetric" ramp:
 //
 // 1. Use the difference between two parabolic waves.
@@ -266,14 +400,13 @@ int32_t Generator::ComputeAntialiasAttenuation(
 // 2. has a terrible behaviour in the audio range, because it causes audible FM
 // when the slope parameter is modulated by a LFO.
 
-void Generator::FillBufferAudioRate() {
-  uint8_t size = kBlockSize;
-  
+template<typename Source, typename Sink>
+void Generator::RenderAudioRate(Source* source, Sink* sink, uint8_t size) {
   GeneratorSample sample = previous_sample_;
   if (sync_) {
     pitch_ = ComputePitch(phase_increment_);
   } else {
-    phase_increment_ = ComputePhaseIncrement(pitch_);
+    phase_increment_ = ComputePhaseIncrement(pitch_, clock_divider_);
     local_osc_phase_increment_ = phase_increment_;
     target_phase_increment_ = phase_increment_;
   }
@@ -282,52 +415,27 @@ void Generator::FillBufferAudioRate() {
   }
 
 #ifndef CORE_ONLY
-  // Load wavetable pointers for bandlimiting - they depend on pitch value.
-  uint16_t xfade = pitch_ << 6;
-  uint16_t index = pitch_ >> 10;
-  if (pitch_ < 0) {
-    index = 0;
-    xfade = 0;
-  }
-  
-  const int16_t* wave_1 = waveform_table[WAV_BANDLIMITED_PARABOLA_0 + index];
-  const int16_t* wave_2 = waveform_table[WAV_BANDLIMITED_PARABOLA_0 + index + 1];
-
-  int32_t gain = slope_;
-  gain = (32768 - (gain * gain >> 15)) * 3 >> 1;
-  gain = 32768 * 1024 / gain;
-  
-  uint32_t phase_offset_a_bi = (slope_ - (slope_ >> 1)) << 16;
-  uint32_t phase_offset_b_bi = (32768 - (slope_ >> 1)) << 16;
-  uint32_t phase_offset_a_uni = 49152 << 16;
-  uint32_t phase_offset_b_uni = (32768 + 49152 - slope_) << 16;
-  
-  int32_t attenuation = 32767;
-  if (antialiasing_) {
-    attenuation = ComputeAntialiasAttenuation(
-          pitch_,
-          slope_,
-          shape_,
-          smoothness_);
+  uint8_t setup_flags = setup_dirty_;
+  if (pitch_ != setup_pitch_) {
+    setup_flags |= SETUP_PITCH;
   }
-
-  uint16_t shape = static_cast<uint16_t>((shape_ * attenuation >> 15) + 32768);
-  uint16_t wave_index = WAV_INVERSE_TAN_AUDIO + (shape >> 14);
-  const int16_t* shape_1 = waveform_table[wave_index];
-  const int16_t* shape_2 = waveform_table[wave_index + 1];
-  uint16_t shape_xfade = shape << 2;
-  
-  int32_t frequency = ComputeCutoffFrequency(pitch_, smoothness_);
-  int32_t f_a = lut_cutoff[frequency >> 7] >> 16;
-  int32_t f_b = lut_cutoff[(frequency >> 7) + 1] >> 16;
-  int32_t f = f_a + ((f_b - f_a) * (frequency & 0x7f) >> 7);
-  int32_t wf_gain = 2048;
-  int32_t wf_balance = 0;
-  if (smoothness_ > 0) {
-    int16_t attenuated_smoothness = smoothness_ * attenuation >> 15;
-    wf_gain += attenuated_smoothness * (32767 - 1024) >> 14;
-    wf_balance = attenuated_smoothness;
+  if (setup_flags) {
+    ComputeAudioRateSetup(setup_flags);
   }
+  const int16_t* wave_1 = setup_.wave_1;
+  const int16_t* wave_2 = setup_.wave_2;
+  uint16_t xfade = setup_.xfade;
+  int32_t gain = setup_.gain;
+  uint32_t phase_offset_a_bi = setup_.phase_offset_a_bi;
+  uint32_t phase_offset_b_bi = setup_.phase_offset_b_bi;
+  uint32_t phase_offset_a_uni = 49152 << 16;
+  uint32_t phase_offset_b_uni = setup_.phase_offset_b_uni;
+  const int16_t* shape_1 = setup_.shape_1;
+  const int16_t* shape_2 = setup_.shape_2;
+  uint16_t shape_xfade = setup_.shape_xfade;
+  int32_t f = setup_.f;
+  int32_t wf_gain = setup_.wf_gain;
+  int32_t wf_balance = setup_.wf_balance;
 #endif  // CORE_ONLY  
   
   uint32_t end_of_attack = (static_cast<uint32_t>(slope_ + 32768) << 16);
@@ -352,7 +460,7 @@ void Generator::FillBufferAudioRate() {
   
   while (size--) {
     ++sync_counter_;
-    uint8_t control = input_buffer_.ImmediateRead();
+    uint8_t control = source->Read();
 
     // When freeze is high, discard any start/reset command.
     if (!(control & CONTROL_FREEZE)) {
@@ -394,7 +502,7 @@ void Generator::FillBufferAudioRate() {
     }
     
     if (control & CONTROL_FREEZE) {
-      output_buffer_.Overwrite(sample);
+      sink->Write(sample);
       continue;
     }
     
@@ -467,7 +575,7 @@ void Generator::FillBufferAudioRate() {
        sample.flags |= FLAG_END_OF_RELEASE;
        --eor_counter_;
     }
-    output_buffer_.Overwrite(sample);
+    sink->Write(sample);
     
     if (running_ && !sustained) {
       phase += phase_increment;
@@ -486,13 +594,12 @@ void Generator::FillBufferAudioRate() {
   wrap_ = wrap;
 }
 
-void Generator::FillBufferControlRate() {
-  uint8_t size = kBlockSize;
-  
+template<typename Source, typename Sink>
+void Generator::RenderControlRate(Source* source, Sink* sink, uint8_t size) {
   if (sync_) {
     pitch_ = ComputePitch(phase_increment_);
   } else {
-    phase_increment_ = ComputePhaseIncrement(pitch_);
+    phase_increment_ = ComputePhaseIncrement(pitch_, clock_divider_);
     local_osc_phase_increment_ = phase_increment_;
     target_phase_increment_ = phase_increment_;
   }
@@ -507,7 +614,10 @@ void Generator::FillBufferControlRate() {
   const int16_t* shape_2 = waveform_table[wave_index + 1];
   uint16_t shape_xfade = shape << 3;
   
-  int64_t frequency = ComputeCutoffFrequency(pitch_, smoothness_);
+  int64_t frequency = ComputeCutoffFrequency(
+      pitch_,
+      smoothness_,
+      clock_divider_);
   int64_t f_a = lut_cutoff[frequency >> 7];
   int64_t f_b = lut_cutoff[(frequency >> 7) + 1];
   int64_t f = f_a + ((f_b - f_a) * (frequency & 0x7f) >> 7);
@@ -539,7 +649,7 @@ void Generator::FillBufferControlRate() {
     // Low-pass filter the slope parameter.
     smoothed_slope += (slope_ - smoothed_slope) >> 4;
     
-    uint8_t control = input_buffer_.ImmediateRead();
+    uint8_t control = source->Read();
 
     // When freeze is high, discard any start/reset command.
     if (!(control & CONTROL_FREEZE)) {
@@ -568,7 +678,7 @@ void Generator::FillBufferControlRate() {
     }
     
     if (control & CONTROL_FREEZE) {
-      output_buffer_.Overwrite(sample);
+      sink->Write(sample);
       continue;
     }
     
@@ -667,7 +777,7 @@ void Generator::FillBufferControlRate() {
       sample.flags &= ~FLAG_END_OF_ATTACK;
     }
     
-    output_buffer_.Overwrite(sample);
+    sink->Write(sample);
     if (running_ && !sustained) {
       phase += phase_increment;
       wrap = phase < phase_increment;
@@ -689,14 +799,13 @@ void Generator::FillBufferControlRate() {
 }
 
 
-void Generator::FillBufferWavetable() {
-  uint8_t size = kBlockSize;
-  
+template<typename Source, typename Sink>
+void Generator::RenderWavetable(Source* source, Sink* sink, uint8_t size) {
   GeneratorSample sample = previous_sample_;
   if (sync_) {
     pitch_ = ComputePitch(phase_increment_);
   } else {
-    phase_increment_ = ComputePhaseIncrement(pitch_);
+    phase_increment_ = ComputePhaseIncrement(pitch_, clock_divider_);
   }
 
   uint32_t phase = phase_;
@@ -717,7 +826,10 @@ void Generator::FillBufferWavetable() {
   int32_t wf_gain = smoothness_ > 0 ? smoothness_ : 0;
   wf_gain = wf_gain * wf_gain >> 15;
   
-  int32_t frequency = ComputeCutoffFrequency(pitch_, smoothness_);
+  int32_t frequency = ComputeCutoffFrequency(
+      pitch_,
+      smoothness_,
+      clock_divider_);
   int32_t f_a = lut_cutoff[frequency >> 7] >> 16;
   int32_t f_b = lut_cutoff[(frequency >> 7) + 1] >> 16;
   int32_t f = f_a + ((f_b - f_a) * (frequency & 0x7f) >> 7);
@@ -727,7 +839,7 @@ void Generator::FillBufferWavetable() {
   const int16_t* bank = wt_waves + mode_ * 64 * 257 - (mode_ & 2) * 4 * 257;
   while (size--) {
     ++sync_counter_;
-    uint8_t control = input_buffer_.ImmediateRead();
+    uint8_t control = source->Read();
     
     // When freeze is high, discard any start/reset command.
     if (!(control & CONTROL_FREEZE)) {
@@ -798,7 +910,7 @@ void Generator::FillBufferWavetable() {
     y += y_increment;
   
     if (control & CONTROL_FREEZE) {
-      output_buffer_.Overwrite(sample);
+      sink->Write(sample);
       continue;
     }
     
@@ -833,7 +945,7 @@ void Generator::FillBufferWavetable() {
     if (sub_phase & 0x80000000) {
       sample.flags |= FLAG_END_OF_RELEASE;
     }
-    output_buffer_.Overwrite(sample);
+    sink->Write(sample);
     sub_phase += phase_increment >> 1;
   }
   previous_sample_ = sample;
@@ -846,4 +958,45 @@ void Generator::FillBufferWavetable() {
   bi_lp_state_[1] = lp_state_1;
 }
 
+void Generator::FillBufferAudioRate() {
+  RingBufferSource source(&input_buffer_);
+  RingBufferSink sink(&output_buffer_);
+  RenderAudioRate(&source, &sink, kBlockSize);
+}
+
+void Generator::FillBufferControlRate() {
+  RingBufferSource source(&input_buffer_);
+  RingBufferSink sink(&output_buffer_);
+  RenderControlRate(&source, &sink, kBlockSize);
+}
+
+void Generator::FillBufferWavetable() {
+  RingBufferSource source(&input_buffer_);
+  RingBufferSink sink(&output_buffer_);
+  RenderWavetable(&source, &sink, kBlockSize);
+}
+
+void Generator::Render(
+    const uint8_t* control,
+    const GeneratorBuffers& output,
+    size_t size) {
+  ArraySource source(control);
+  ArraySink sink(output);
+  // Same block size as on the module, since the parameters are only read
+  // at the beginning of each block.
+  while (size) {
+    uint8_t block_size = size > kBlockSize ? kBlockSize : size;
+#ifndef WAVETABLE_HACK
+    if (range_ == GENERATOR_RANGE_HIGH) {
+      RenderAudioRate(&source, &sink, block_size);
+    } else {
+      RenderControlRate(&source, &sink, block_size);
+    }
+#else
+    RenderWavetable(&source, &sink, block_size);
+#endif
+    size -= block_size;
+  }
+}
+
 }  // namespace tides
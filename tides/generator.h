@@ -70,8 +70,48 @@ struct GeneratorSample {
   uint8_t flags;
 };
 
+// Destination of Generator::Render, one array per output.
+struct GeneratorBuffers {
+  uint16_t* unipolar;
+  int16_t* bipolar;
+  uint8_t* flags;
+};
+
 const uint16_t kBlockSize = 16;
 
+// Fixed point resolution of the slope factors of the control rate renderer.
+const uint16_t kSlopeBits = 12;
+
+// Groups of coefficients of the audio rate renderer which have to be
+// recomputed because one of the parameters they depend on has changed.
+// The antialiasing attenuation of the waveshaper depends on all the
+// parameters, so SETUP_SHAPER is implied by any other group when it is
+// enabled.
+enum AudioRateSetupFlag {
+  SETUP_PITCH = 1,
+  SETUP_SLOPE = 2,
+  SETUP_SHAPER = 4,
+  SETUP_CUTOFF = 8
+};
+
+// Coefficients of the audio rate renderer which only depend on the
+// parameters, and not on the state of the generator.
+struct AudioRateSetup {
+  const int16_t* wave_1;
+  const int16_t* wave_2;
+  uint16_t xfade;
+  int32_t gain;
+  uint32_t phase_offset_a_bi;
+  uint32_t phase_offset_b_bi;
+  uint32_t phase_offset_b_uni;
+  const int16_t* shape_1;
+  const int16_t* shape_2;
+  uint16_t shape_xfade;
+  int32_t f;
+  int32_t wf_gain;
+  int32_t wf_balance;
+};
+
 struct FrequencyRatio {
   uint32_t p;
   uint32_t q;
@@ -88,6 +128,7 @@ class Generator {
     ClearFilterState();
     range_ = range;
     clock_divider_ = range_ == GENERATOR_RANGE_LOW ? 4 : 1;
+    setup_dirty_ |= SETUP_CUTOFF;
   }
   
   void set_mode(GeneratorMode mode) {
@@ -108,8 +149,13 @@ class Generator {
     pitch_ = pitch;
   }
   
+  // The setters are called before every block: they only invalidate the
+  // cached coefficients of the audio rate renderer when the value changes.
   void set_shape(int16_t shape) {
-    shape_ = shape;
+    if (shape != shape_) {
+      shape_ = shape;
+      setup_dirty_ |= SETUP_SHAPER;
+    }
   }
 
   void set_slope(int16_t slope) {
@@ -118,11 +164,17 @@ class Generator {
       CONSTRAIN(slope, -32512, 32512);
     }
 #endif  // WAVETABLE_HACK
-    slope_ = slope;
+    if (slope != slope_) {
+      slope_ = slope;
+      setup_dirty_ |= SETUP_SLOPE;
+    }
   }
 
   void set_smoothness(int16_t smoothness) {
-    smoothness_ = smoothness;
+    if (smoothness != smoothness_) {
+      smoothness_ = smoothness;
+      setup_dirty_ |= SETUP_SHAPER | SETUP_CUTOFF;
+    }
   }
   
   void set_frequency_ratio(FrequencyRatio ratio) {
@@ -130,7 +182,10 @@ class Generator {
   }
   
   void set_waveshaper_antialiasing(bool antialiasing) {
-    antialiasing_ = antialiasing;
+    if (antialiasing != antialiasing_) {
+      antialiasing_ = antialiasing;
+      setup_dirty_ |= SETUP_SHAPER;
+    }
   }
   
   void set_sync(bool sync) {
@@ -178,6 +233,24 @@ class Generator {
   uint32_t clock_divider() const {
     return clock_divider_;
   }
+  
+  // Block API for host and offline use. Renders size samples, one per
+  // control byte, straight into the output arrays, without going through
+  // the ring buffers. The parameters are read every kBlockSize samples: when
+  // size is a multiple of kBlockSize, the output is that of Process(),
+  // without its latency of kBlockSize samples. Do not mix with Process() on
+  // the same generator.
+  void Render(
+      const uint8_t* control,
+      const GeneratorBuffers& output,
+      size_t size);
+
+  // Also used by GeneratorBank.
+  static uint32_t ComputePhaseIncrement(int16_t pitch, uint32_t clock_divider);
+  static int32_t ComputeCutoffFrequency(
+      int16_t pitch,
+      int16_t smoothness,
+      uint32_t clock_divider);
 
  private:
   // There are two versions of the rendering code, one optimized for audio, with
@@ -185,6 +258,16 @@ class Generator {
   void FillBufferAudioRate();
   void FillBufferControlRate();
   void FillBufferWavetable();
+  
+  // The rendering code reads control bytes from a Source and writes samples
+  // to a Sink: the ring buffers on the module, or arrays with Render().
+  template<typename Source, typename Sink>
+  void RenderAudioRate(Source* source, Sink* sink, uint8_t size);
+  template<typename Source, typename Sink>
+  void RenderControlRate(Source* source, Sink* sink, uint8_t size);
+  template<typename Source, typename Sink>
+  void RenderWavetable(Source* source, Sink* sink, uint8_t size);
+  void ComputeAudioRateSetup(uint8_t flags);
   int32_t ComputeAntialiasAttenuation(
         int16_t pitch,
         int16_t slope,
@@ -196,9 +279,7 @@ class Generator {
     bi_lp_state_[0] = bi_lp_state_[1] = 0;
   }
 
-  uint32_t ComputePhaseIncrement(int16_t pitch);
   int16_t ComputePitch(uint32_t phase_increment);
-  int32_t ComputeCutoffFrequency(int16_t pitch, int16_t smoothness);
   void ComputeFrequencyRatio(int16_t pitch);
   
   stmlib::RingBuffer<uint8_t, kBlockSize * 2> input_buffer_;
@@ -245,6 +326,13 @@ class Generator {
   
   bool running_;
   
+  // The coefficients are recomputed when one of the setters has changed a
+  // parameter, or when the pitch differs from the one they were computed
+  // for - it is not only set by set_pitch(), but also tracked in sync mode.
+  AudioRateSetup setup_;
+  uint8_t setup_dirty_;
+  int16_t setup_pitch_;
+  
   static const FrequencyRatio frequency_ratios_[];
   static const int16_t num_frequency_ratios_;
   
@@ -0,0 +1,290 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bank of tidal generators.
+
+#include "tides/generator_bank.h"
+
+#include <algorithm>
+
+#include "stmlib/utils/dsp.h"
+
+#include "tides/resources.h"
+
+namespace tides {
+
+using namespace stmlib;
+
+void GeneratorBank::Init(size_t num_generators) {
+  num_generators_ = std::min(num_generators, kMaxNumGenerators);
+  num_lanes_ = (num_generators_ + kNumLanes - 1) & ~(kNumLanes - 1);
+  // Same defaults as Generator::Init(), followed by set_range().
+  for (size_t i = 0; i < kMaxNumGenerators; ++i) {
+    mode_[i] = GENERATOR_MODE_LOOPING;
+    range_[i] = GENERATOR_RANGE_MEDIUM;
+    clock_divider_[i] = 1;
+    pitch_[i] = (60 << 7) + (12 << 7);
+    shape_[i] = 0;
+    slope_[i] = 0;
+    smoothness_[i] = 0;
+    
+    phase_[i] = 0;
+    phase_increment_[i] = 9448928;
+    smoothed_slope_[i] = 0;
+    eor_counter_[i] = 0;
+    running_[i] = 0;
+    wrap_[i] = 0;
+    uni_lp_state_0_[i] = uni_lp_state_1_[i] = 0;
+    bi_lp_state_0_[i] = bi_lp_state_1_[i] = 0;
+    
+    unipolar_[i] = 0;
+    bipolar_[i] = 0;
+    flags_[i] = 0;
+    
+    // The generators past num_generators, which only pad the last group of
+    // the phase update, keep these values.
+    control_[i] = 0;
+    end_of_attack_[i] = 1UL << 31;
+    attack_factor_[i] = 1 << kSlopeBits;
+    decay_factor_[i] = 1 << kSlopeBits;
+  }
+}
+
+void GeneratorBank::ComputeBlockCoefficients() {
+  for (size_t i = 0; i < num_generators_; ++i) {
+    phase_increment_[i] = Generator::ComputePhaseIncrement(
+        pitch_[i],
+        clock_divider_[i]);
+    
+    uint16_t shape = static_cast<uint16_t>(shape_[i] + 32768);
+    shape = (shape >> 2) * 3;
+    uint16_t wave_index = WAV_REVERSED_CONTROL + (shape >> 13);
+    shape_1_[i] = waveform_table[wave_index];
+    shape_2_[i] = waveform_table[wave_index + 1];
+    shape_xfade_[i] = shape << 3;
+    
+    int64_t frequency = Generator::ComputeCutoffFrequency(
+        pitch_[i],
+        smoothness_[i],
+        clock_divider_[i]);
+    int64_t f_a = lut_cutoff[frequency >> 7];
+    int64_t f_b = lut_cutoff[(frequency >> 7) + 1];
+    f_[i] = f_a + ((f_b - f_a) * (frequency & 0x7f) >> 7);
+    wf_gain_[i] = 2048;
+    wf_balance_[i] = 0;
+    if (smoothness_[i] > 0) {
+      wf_gain_[i] += smoothness_[i] * (32767 - 1024) >> 14;
+      wf_balance_[i] = smoothness_[i];
+    }
+    
+    previous_smoothed_slope_[i] = 0x7fffffff;
+    end_of_attack_[i] = 1UL << 31;
+    attack_factor_[i] = 1 << kSlopeBits;
+    decay_factor_[i] = 1 << kSlopeBits;
+  }
+}
+
+// The slope factors need two divisions. The smoothed slope settles after a
+// few dozen samples, after which this pass only does comparisons.
+void GeneratorBank::ComputeSlopeFactors() {
+  for (size_t i = 0; i < num_generators_; ++i) {
+    smoothed_slope_[i] += (slope_[i] - smoothed_slope_[i]) >> 4;
+    if (control_[i] & CONTROL_FREEZE ||
+        smoothed_slope_[i] == previous_smoothed_slope_[i]) {
+      continue;
+    }
+    uint32_t slope_offset = Interpolate88(
+        lut_slope_compression, smoothed_slope_[i] + 32768);
+    if (slope_offset <= 1) {
+      decay_factor_[i] = 32768 << kSlopeBits;
+      attack_factor_[i] = 1 << (kSlopeBits - 1);
+    } else {
+      decay_factor_[i] = (32768 << kSlopeBits) / slope_offset;
+      attack_factor_[i] = (32768 << kSlopeBits) / (65536 - slope_offset);
+    }
+    previous_smoothed_slope_[i] = smoothed_slope_[i];
+    end_of_attack_[i] = slope_offset << 16;
+  }
+}
+
+// 1 if the bit of control is set, 0 otherwise. Comparisons with zero would
+// produce bools, and conversions from bool are not vectorized.
+static inline uint32_t Bit(uint32_t control, ControlBitMask bit) {
+  return (control / bit) & 1;
+}
+
+// Gates, phase skewing, flags and phase increment. The conditions are 0 or 1
+// integers combined with bitwise operators, and applied with masks rather
+// than branches, so that the compiler can vectorize this loop.
+void GeneratorBank::RenderPhase() {
+  // Groups with a constant size, so that the vectorized loop needs no
+  // scalar epilogue.
+  for (size_t group = 0; group < num_lanes_; group += kNumLanes) {
+    for (size_t i = group; i < group + kNumLanes; ++i) {
+      uint32_t c = control_[i];
+      uint32_t previous_phase = phase_[i];
+      uint32_t previous_wrap = wrap_[i];
+      uint32_t previous_running = running_[i];
+      uint32_t previous_eor_counter = eor_counter_[i];
+      uint32_t previous_flags = flags_[i];
+      uint32_t phase_increment = phase_increment_[i];
+      uint32_t end_of_attack = end_of_attack_[i];
+      uint32_t mode = mode_[i];
+
+      uint32_t frozen = Bit(c, CONTROL_FREEZE);
+      uint32_t triggered = (frozen ^ 1) & Bit(c, CONTROL_GATE_RISING);
+      uint32_t looping = mode == GENERATOR_MODE_LOOPING;
+      uint32_t stopped = (frozen | triggered | looping) ^ 1;
+      stopped &= previous_wrap;
+      uint32_t phase = previous_phase & ((triggered | stopped) - 1);
+      uint32_t running = triggered | (previous_running & (stopped ^ 1));
+      
+      uint32_t decay = (phase >> kSlopeBits) * decay_factor_[i];
+      uint32_t attack = ((phase - end_of_attack) >> kSlopeBits) *
+          attack_factor_[i] + (1UL << 31);
+      uint32_t decaying = -static_cast<uint32_t>(phase <= end_of_attack);
+      uint32_t skewed_phase = (decay & decaying) | (attack & ~decaying);
+      uint32_t sustained = (mode == GENERATOR_MODE_AR) &
+          (phase >= end_of_attack) & Bit(c, CONTROL_GATE);
+      uint32_t sustain_mask = -sustained;
+      skewed_phase = (skewed_phase & ~sustain_mask) |
+          ((1UL << 31) & sustain_mask);
+      phase = (phase & ~sustain_mask) | ((end_of_attack + 1) & sustain_mask);
+      
+      uint32_t adjusted_end_of_attack = end_of_attack >= phase_increment
+          ? end_of_attack - phase_increment
+          : end_of_attack;
+      adjusted_end_of_attack = adjusted_end_of_attack < phase_increment
+          ? phase_increment
+          : adjusted_end_of_attack;
+      
+      uint32_t looped = looping & previous_wrap;
+      uint32_t pure_decay = sustained | (end_of_attack == 0);
+      uint32_t end_of_attack_flag = (phase >= adjusted_end_of_attack) |
+          (running ^ 1) | pure_decay;
+      end_of_attack_flag &= (pure_decay & (triggered | looped)) ^ 1;
+      uint32_t reset_eor_counter = -((running ^ 1) | looped);
+      uint32_t eor_duration = phase_increment < 44739242 ? 48 : 1;
+      uint32_t eor_counter = (eor_duration & reset_eor_counter) |
+          (previous_eor_counter & ~reset_eor_counter);
+      uint32_t end_of_release_flag = eor_counter != 0;
+      uint32_t flags = end_of_attack_flag * FLAG_END_OF_ATTACK |
+          end_of_release_flag * FLAG_END_OF_RELEASE;
+      eor_counter -= end_of_release_flag;
+      
+      uint32_t advance = running & (sustained ^ 1);
+      uint32_t next_phase = phase + (phase_increment & -advance);
+      uint32_t wrap = advance & (next_phase < phase_increment);
+      
+      // A frozen generator keeps its state and repeats its last sample.
+      uint32_t keep = -frozen;
+      skewed_phase_[i] = skewed_phase;
+      phase_[i] = (previous_phase & keep) | (next_phase & ~keep);
+      wrap_[i] = (previous_wrap & keep) | (wrap & ~keep);
+      running_[i] = (previous_running & keep) | (running & ~keep);
+      eor_counter_[i] = (previous_eor_counter & keep) | (eor_counter & ~keep);
+      flags_[i] = (previous_flags & keep) | (flags & ~keep);
+    }
+  }
+}
+
+void GeneratorBank::RenderWaveshaper() {
+  for (size_t i = 0; i < num_generators_; ++i) {
+    uint32_t skewed_phase = skewed_phase_[i];
+    unipolar_shaped_[i] = Crossfade115(
+        shape_1_[i],
+        shape_2_[i],
+        skewed_phase >> 16, shape_xfade_[i]);
+    int32_t bipolar = Crossfade115(
+        shape_1_[i],
+        shape_2_[i],
+        skewed_phase >> 15, shape_xfade_[i]);
+    bipolar_shaped_[i] = skewed_phase >= (1UL << 31) ? -bipolar : bipolar;
+  }
+}
+
+void GeneratorBank::RenderFilter(const GeneratorBuffers& output) {
+  for (size_t i = 0; i < num_generators_; ++i) {
+    if (!(control_[i] & CONTROL_FREEZE)) {
+      int64_t f = f_[i];
+      int32_t wf_gain = wf_gain_[i];
+      int32_t wf_balance = wf_balance_[i];
+      int32_t original, folded;
+      
+      int32_t unipolar = unipolar_shaped_[i];
+      int64_t uni_lp_state_0 = uni_lp_state_0_[i];
+      int64_t uni_lp_state_1 = uni_lp_state_1_[i];
+      uni_lp_state_0 += f * ((unipolar << 16) - uni_lp_state_0) >> 31;
+      uni_lp_state_1 += f * (uni_lp_state_0 - uni_lp_state_1) >> 31;
+      uni_lp_state_0_[i] = uni_lp_state_0;
+      uni_lp_state_1_[i] = uni_lp_state_1;
+      
+      original = uni_lp_state_1 >> 15;
+      folded = Interpolate1022(wav_unipolar_fold, original * wf_gain) << 1;
+      unipolar_[i] = original + ((folded - original) * wf_balance >> 15);
+      
+      int32_t bipolar = bipolar_shaped_[i];
+      int64_t bi_lp_state_0 = bi_lp_state_0_[i];
+      int64_t bi_lp_state_1 = bi_lp_state_1_[i];
+      bi_lp_state_0 += f * ((bipolar << 16) - bi_lp_state_0) >> 31;
+      bi_lp_state_1 += f * (bi_lp_state_0 - bi_lp_state_1) >> 31;
+      bi_lp_state_0_[i] = bi_lp_state_0;
+      bi_lp_state_1_[i] = bi_lp_state_1;
+      
+      original = bi_lp_state_1 >> 16;
+      folded = Interpolate1022(
+          wav_bipolar_fold,
+          original * wf_gain + (1UL << 31));
+      bipolar_[i] = original + ((folded - original) * wf_balance >> 15);
+    }
+    output.unipolar[i] = unipolar_[i];
+    output.bipolar[i] = bipolar_[i];
+    output.flags[i] = flags_[i];
+  }
+}
+
+void GeneratorBank::Render(
+    const uint8_t* control,
+    const GeneratorBuffers& output,
+    size_t size) {
+  GeneratorBuffers out = output;
+  for (size_t t = 0; t < size; ++t) {
+    if (t % kBlockSize == 0) {
+      ComputeBlockCoefficients();
+    }
+    std::copy(&control[0], &control[num_generators_], &control_[0]);
+    ComputeSlopeFactors();
+    RenderPhase();
+    RenderWaveshaper();
+    RenderFilter(out);
+    control += num_generators_;
+    out.unipolar += num_generators_;
+    out.bipolar += num_generators_;
+    out.flags += num_generators_;
+  }
+}
+
+}  // namespace tides
@@ -0,0 +1,186 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Bank of tidal generators, for hosts running many of them as polyphonic LFOs
+// or envelopes.
+//
+// The parameters and the state of the generators are stored as arrays, and
+// each sample is rendered one stage at a time across the whole bank: the
+// control inputs and the phase, then the waveshaping, then the filters and
+// the wavefolder. The loops are short and free of per-generator calls, and
+// the compiler can vectorize the phase updates.
+//
+// Only the control rate renderer (medium and low ranges) is implemented,
+// without sync. For a generator configured with the same parameters, the
+// output is identical to that of Generator::Render() in the AD, looping and
+// AR modes.
+
+#ifndef TIDES_GENERATOR_BANK_H_
+#define TIDES_GENERATOR_BANK_H_
+
+#include "stmlib/stmlib.h"
+
+#include "tides/generator.h"
+
+namespace tides {
+
+const size_t kMaxNumGenerators = 128;
+
+// The phase of the generators is updated by groups of kNumLanes, a multiple
+// of the number of 32-bit values in a vector register. The extra generators
+// are never triggered, and their output is discarded.
+const size_t kNumLanes = 4;
+
+class GeneratorBank {
+ public:
+  GeneratorBank() { }
+  ~GeneratorBank() { }
+  
+  void Init(size_t num_generators);
+  
+  // The high range uses the audio rate renderer, which is not available in
+  // the bank: it is replaced by the medium range.
+  void set_range(size_t index, GeneratorRange range) {
+    if (range == GENERATOR_RANGE_HIGH) {
+      range = GENERATOR_RANGE_MEDIUM;
+    }
+    uni_lp_state_0_[index] = uni_lp_state_1_[index] = 0;
+    bi_lp_state_0_[index] = bi_lp_state_1_[index] = 0;
+    range_[index] = range;
+    clock_divider_[index] = range == GENERATOR_RANGE_LOW ? 4 : 1;
+  }
+  
+  void set_mode(size_t index, GeneratorMode mode) {
+    mode_[index] = mode;
+    if (mode == GENERATOR_MODE_LOOPING) {
+      running_[index] = 1;
+    }
+  }
+  
+  void set_pitch(size_t index, int16_t pitch) {
+    pitch += (12 << 7) - (60 << 7) * static_cast<int16_t>(range_[index]);
+    if (range_[index] == GENERATOR_RANGE_LOW) {
+      pitch -= (12 << 7);
+    }
+    pitch_[index] = pitch;
+  }
+  
+  void set_shape(size_t index, int16_t shape) {
+    shape_[index] = shape;
+  }
+  
+  void set_slope(size_t index, int16_t slope) {
+    slope_[index] = slope;
+  }
+  
+  void set_smoothness(size_t index, int16_t smoothness) {
+    smoothness_[index] = smoothness;
+  }
+  
+  inline size_t num_generators() const { return num_generators_; }
+  inline GeneratorMode mode(size_t index) const {
+    return static_cast<GeneratorMode>(mode_[index]);
+  }
+  inline GeneratorRange range(size_t index) const {
+    return static_cast<GeneratorRange>(range_[index]);
+  }
+  
+  // Renders size samples for every generator. The control bytes and the
+  // output arrays are interleaved: the entry of generator i for sample t is
+  // at index t * num_generators() + i. As with Generator::Render(), the
+  // parameters are read every kBlockSize samples.
+  void Render(
+      const uint8_t* control,
+      const GeneratorBuffers& output,
+      size_t size);
+
+ private:
+  void ComputeBlockCoefficients();
+  void ComputeSlopeFactors();
+  void RenderPhase();
+  void RenderWaveshaper();
+  void RenderFilter(const GeneratorBuffers& output);
+  
+  size_t num_generators_;
+  size_t num_lanes_;
+  
+  // The mode, booleans and flags read by the phase update are stored as
+  // 32-bit integers, like the phase, so that its loop does not mix vector
+  // widths.
+  
+  // Parameters.
+  uint32_t mode_[kMaxNumGenerators];
+  uint8_t range_[kMaxNumGenerators];
+  uint32_t clock_divider_[kMaxNumGenerators];
+  int16_t pitch_[kMaxNumGenerators];
+  int16_t shape_[kMaxNumGenerators];
+  int16_t slope_[kMaxNumGenerators];
+  int16_t smoothness_[kMaxNumGenerators];
+  
+  // State.
+  uint32_t phase_[kMaxNumGenerators];
+  uint32_t phase_increment_[kMaxNumGenerators];
+  int32_t smoothed_slope_[kMaxNumGenerators];
+  uint32_t eor_counter_[kMaxNumGenerators];
+  uint32_t running_[kMaxNumGenerators];
+  uint32_t wrap_[kMaxNumGenerators];
+  int64_t uni_lp_state_0_[kMaxNumGenerators];
+  int64_t uni_lp_state_1_[kMaxNumGenerators];
+  int64_t bi_lp_state_0_[kMaxNumGenerators];
+  int64_t bi_lp_state_1_[kMaxNumGenerators];
+  
+  // Last sample of each generator, repeated while it is frozen.
+  uint16_t unipolar_[kMaxNumGenerators];
+  int16_t bipolar_[kMaxNumGenerators];
+  uint32_t flags_[kMaxNumGenerators];
+  
+  // Computed at the beginning of each block.
+  const int16_t* shape_1_[kMaxNumGenerators];
+  const int16_t* shape_2_[kMaxNumGenerators];
+  uint16_t shape_xfade_[kMaxNumGenerators];
+  int64_t f_[kMaxNumGenerators];
+  int32_t wf_gain_[kMaxNumGenerators];
+  int32_t wf_balance_[kMaxNumGenerators];
+  
+  // Computed when the smoothed slope changes, and at the beginning of each
+  // block.
+  int32_t previous_smoothed_slope_[kMaxNumGenerators];
+  uint32_t end_of_attack_[kMaxNumGenerators];
+  uint32_t attack_factor_[kMaxNumGenerators];
+  uint32_t decay_factor_[kMaxNumGenerators];
+  
+  // Control bytes and intermediate results for the current sample.
+  uint32_t control_[kMaxNumGenerators];
+  uint32_t skewed_phase_[kMaxNumGenerators];
+  int32_t unipolar_shaped_[kMaxNumGenerators];
+  int32_t bipolar_shaped_[kMaxNumGenerators];
+  
+  DISALLOW_COPY_AND_ASSIGN(GeneratorBank);
+};
+
+}  // namespace tides
+
+#endif  // TIDES_GENERATOR_BANK_H_
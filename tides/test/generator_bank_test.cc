@@ -0,0 +1,276 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks that GeneratorBank matches a set of independent Generators, in every
+// mode and control rate range, then compares their speed.
+//
+// Usage:
+//   generator_bank_test
+//
+// Each generator of the bank has its own parameters and its own gate and
+// freeze pattern, and the parameters are changed every few blocks.
+
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "tides/generator.h"
+#include "tides/generator_bank.h"
+
+using namespace tides;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 48000;
+const size_t kCheckDuration = kSampleRate;
+const size_t kBenchmarkDuration = 2 * kSampleRate;
+const size_t kNumRuns = 5;
+
+const char* const range_names[] = { "high", "medium", "low" };
+const char* const mode_names[] = { "ad", "looping", "ar" };
+
+uint32_t rng_state = 0x21;
+
+inline uint32_t Random32() {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return rng_state;
+}
+
+inline int16_t RandomParameter() {
+  return static_cast<int16_t>(Random32() >> 16);
+}
+
+struct Patch {
+  int16_t pitch;
+  int16_t shape;
+  int16_t slope;
+  int16_t smoothness;
+};
+
+// The parameters of generator i at block b.
+Patch MakePatch(size_t i, size_t b) {
+  Patch p;
+  rng_state = 0x21 + i * 7919 + (b / 8) * 104729;
+  p.pitch = (36 << 7) + (Random32() >> 8) % (60 << 7);
+  p.shape = RandomParameter();
+  p.slope = RandomParameter();
+  p.smoothness = RandomParameter();
+  return p;
+}
+
+// Gates with a different period for each generator, and a short freeze.
+void MakeControl(size_t num_generators, size_t size, uint8_t* control) {
+  for (size_t t = 0; t < size; ++t) {
+    for (size_t i = 0; i < num_generators; ++i) {
+      size_t period = 300 + i * 37;
+      size_t position = (t + i * 101) % period;
+      uint8_t c = 0;
+      if (position == 0) {
+        c |= CONTROL_GATE_RISING;
+      }
+      if (position < period / 3) {
+        c |= CONTROL_GATE;
+      }
+      if (t > 10000 + i * 50 && t < 10300 + i * 50) {
+        c |= CONTROL_FREEZE;
+      }
+      control[t * num_generators + i] = c;
+    }
+  }
+}
+
+Generator generators[kMaxNumGenerators];
+GeneratorBank bank;
+
+void Configure(size_t num_generators, GeneratorRange range, GeneratorMode mode) {
+  bank.Init(num_generators);
+  for (size_t i = 0; i < num_generators; ++i) {
+    generators[i].Init();
+    generators[i].set_range(range);
+    generators[i].set_mode(mode);
+    bank.set_range(i, range);
+    bank.set_mode(i, mode);
+  }
+}
+
+void SetParameters(size_t num_generators, size_t block) {
+  for (size_t i = 0; i < num_generators; ++i) {
+    Patch p = MakePatch(i, block);
+    generators[i].set_pitch(p.pitch);
+    generators[i].set_shape(p.shape);
+    generators[i].set_slope(p.slope);
+    generators[i].set_smoothness(p.smoothness);
+    bank.set_pitch(i, p.pitch);
+    bank.set_shape(i, p.shape);
+    bank.set_slope(i, p.slope);
+    bank.set_smoothness(i, p.smoothness);
+  }
+}
+
+struct Output {
+  Output(size_t size) : unipolar(size), bipolar(size), flags(size) { }
+  
+  GeneratorBuffers buffers(size_t offset) {
+    GeneratorBuffers b;
+    b.unipolar = &unipolar[offset];
+    b.bipolar = &bipolar[offset];
+    b.flags = &flags[offset];
+    return b;
+  }
+  
+  std::vector<uint16_t> unipolar;
+  std::vector<int16_t> bipolar;
+  std::vector<uint8_t> flags;
+};
+
+// Renders the generators one after the other, into arrays interleaved like
+// the output of the bank.
+void RenderGenerators(
+    size_t num_generators,
+    const std::vector<uint8_t>& control,
+    Output* output,
+    bool change_parameters) {
+  size_t size = control.size() / num_generators;
+  uint8_t generator_control[kBlockSize];
+  uint16_t unipolar[kBlockSize];
+  int16_t bipolar[kBlockSize];
+  uint8_t flags[kBlockSize];
+  GeneratorBuffers b = { unipolar, bipolar, flags };
+  for (size_t t = 0; t < size; t += kBlockSize) {
+    if (change_parameters) {
+      SetParameters(num_generators, t / kBlockSize);
+    }
+    for (size_t i = 0; i < num_generators; ++i) {
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        generator_control[j] = control[(t + j) * num_generators + i];
+      }
+      generators[i].Render(generator_control, b, kBlockSize);
+      for (size_t j = 0; j < kBlockSize; ++j) {
+        size_t index = (t + j) * num_generators + i;
+        output->unipolar[index] = unipolar[j];
+        output->bipolar[index] = bipolar[j];
+        output->flags[index] = flags[j];
+      }
+    }
+  }
+}
+
+void RenderBank(
+    size_t num_generators,
+    const std::vector<uint8_t>& control,
+    Output* output,
+    bool change_parameters) {
+  size_t size = control.size() / num_generators;
+  for (size_t t = 0; t < size; t += kBlockSize) {
+    if (change_parameters) {
+      SetParameters(num_generators, t / kBlockSize);
+    }
+    size_t offset = t * num_generators;
+    bank.Render(&control[offset], output->buffers(offset), kBlockSize);
+  }
+}
+
+bool Check() {
+  const size_t num_generators = 37;
+  std::vector<uint8_t> control(kCheckDuration * num_generators);
+  MakeControl(num_generators, kCheckDuration, &control[0]);
+  Output reference(control.size());
+  Output output(control.size());
+  size_t num_checks = 0;
+  for (int range = GENERATOR_RANGE_MEDIUM; range <= GENERATOR_RANGE_LOW;
+       ++range) {
+    for (int mode = 0; mode < 3; ++mode) {
+      GeneratorRange r = static_cast<GeneratorRange>(range);
+      GeneratorMode m = static_cast<GeneratorMode>(mode);
+      Configure(num_generators, r, m);
+      RenderGenerators(num_generators, control, &reference, true);
+      Configure(num_generators, r, m);
+      RenderBank(num_generators, control, &output, true);
+      for (size_t i = 0; i < control.size(); ++i) {
+        if (output.unipolar[i] != reference.unipolar[i] ||
+            output.bipolar[i] != reference.bipolar[i] ||
+            output.flags[i] != reference.flags[i]) {
+          printf("%s %s: generator %zu differs at sample %zu\n",
+              range_names[range], mode_names[mode],
+              i % num_generators, i / num_generators);
+          return false;
+        }
+      }
+      ++num_checks;
+    }
+  }
+  printf("GeneratorBank matches Generator in %zu configurations.\n\n",
+      num_checks);
+  return true;
+}
+
+// Best of several runs, in ns per generator and per sample.
+double Time(size_t num_generators, bool use_bank) {
+  std::vector<uint8_t> control(kBenchmarkDuration * num_generators);
+  MakeControl(num_generators, kBenchmarkDuration, &control[0]);
+  Output output(control.size());
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    Configure(num_generators, GENERATOR_RANGE_MEDIUM, GENERATOR_MODE_LOOPING);
+    SetParameters(num_generators, 0);
+    clock_t start = clock();
+    if (use_bank) {
+      RenderBank(num_generators, control, &output, false);
+    } else {
+      RenderGenerators(num_generators, control, &output, false);
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    checksum += output.bipolar[run];
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best * 1e9 / control.size();
+}
+
+void Benchmark() {
+  printf("%-12s %14s %14s %8s\n",
+      "generators", "generator ns", "bank ns", "speedup");
+  const size_t sizes[] = { 32, 64, 128 };
+  for (size_t i = 0; i < 3; ++i) {
+    double t_generators = Time(sizes[i], false);
+    double t_bank = Time(sizes[i], true);
+    printf("%-12zu %14.2f %14.2f %7.2fx\n", sizes[i], t_generators, t_bank,
+        t_bank > 0.0 ? t_generators / t_bank : 0.0);
+  }
+  printf("\nns per generator and per sample, medium range, looping.\n");
+}
+
+int main(void) {
+  if (!Check()) {
+    return 1;
+  }
+  Benchmark();
+  return 0;
+}
@@ -0,0 +1,239 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks that Generator::Render matches Generator::Process, for every range,
+// mode and sync setting, then compares their speed.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include "tides/generator.h"
+
+using namespace tides;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 48000;
+const uint32_t kCheckDuration = 2 * kSampleRate;
+const uint32_t kBenchmarkDuration = 20 * kSampleRate;
+const size_t kNumRuns = 3;
+
+const char* const range_names[] = { "high", "medium", "low" };
+const char* const mode_names[] = { "ad", "looping", "ar" };
+
+struct Setting {
+  GeneratorRange range;
+  GeneratorMode mode;
+  bool sync;
+};
+
+// Gate every 512 samples, clock every 256 samples, and a short freeze.
+void MakeControl(std::vector<uint8_t>* control) {
+  for (size_t i = 0; i < control->size(); ++i) {
+    uint8_t c = 0;
+    if (i % 512 == 0) {
+      c |= CONTROL_GATE_RISING;
+    }
+    if (i % 512 < 128) {
+      c |= CONTROL_GATE;
+    }
+    if (i % 256 == 0) {
+      c |= CONTROL_CLOCK_RISING;
+    }
+    if (i % 256 < 64) {
+      c |= CONTROL_CLOCK;
+    }
+    if (i > 30000 && i < 30500) {
+      c |= CONTROL_FREEZE;
+    }
+    (*control)[i] = c;
+  }
+}
+
+void Configure(Generator* g, const Setting& setting) {
+  g->Init();
+  g->set_range(setting.range);
+  g->set_mode(setting.mode);
+  g->set_sync(setting.sync);
+  g->set_pitch(60 << 7);
+  g->set_shape(8000);
+  g->set_slope(-10000);
+  g->set_smoothness(12000);
+}
+
+class Output {
+ public:
+  Output(size_t size) : unipolar_(size), bipolar_(size), flags_(size) {
+    buffers_.unipolar = &unipolar_[0];
+    buffers_.bipolar = &bipolar_[0];
+    buffers_.flags = &flags_[0];
+  }
+
+  const GeneratorBuffers& buffers() const { return buffers_; }
+
+  inline void Set(size_t i, const GeneratorSample& s) {
+    unipolar_[i] = s.unipolar;
+    bipolar_[i] = s.bipolar;
+    flags_[i] = s.flags;
+  }
+
+  // Index of the first difference with other, shifted by offset samples,
+  // or -1.
+  int32_t Compare(const Output& other, size_t offset) const {
+    for (size_t i = 0; i + offset < unipolar_.size(); ++i) {
+      if (unipolar_[i + offset] != other.unipolar_[i] ||
+          bipolar_[i + offset] != other.bipolar_[i] ||
+          flags_[i + offset] != other.flags_[i]) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+ private:
+  std::vector<uint16_t> unipolar_;
+  std::vector<int16_t> bipolar_;
+  std::vector<uint8_t> flags_;
+  GeneratorBuffers buffers_;
+};
+
+Generator generator;
+
+void RenderWithProcess(
+    const Setting& setting,
+    const std::vector<uint8_t>& control,
+    Output* output) {
+  Configure(&generator, setting);
+  for (size_t i = 0; i < control.size(); ++i) {
+    output->Set(i, generator.Process(control[i]));
+    generator.FillBufferSafe();
+  }
+}
+
+// Process() starts by rendering the kBlockSize null control bytes the input
+// ring buffer is initialized with, so they are prepended to the control.
+void RenderWithBlocks(
+    const Setting& setting,
+    const std::vector<uint8_t>& control,
+    size_t block_size,
+    Output* output) {
+  Configure(&generator, setting);
+  GeneratorBuffers b = output->buffers();
+  for (size_t i = 0; i < control.size(); i += block_size) {
+    size_t size = std::min(block_size, control.size() - i);
+    generator.Render(&control[i], b, size);
+    b.unipolar += size;
+    b.bipolar += size;
+    b.flags += size;
+  }
+}
+
+bool Check() {
+  std::vector<uint8_t> control(kCheckDuration + kBlockSize);
+  MakeControl(&control);
+  std::vector<uint8_t> delayed_control(control.size());
+  std::copy(control.begin(), control.end() - kBlockSize,
+      delayed_control.begin() + kBlockSize);
+
+  Output reference(control.size());
+  Output output(control.size());
+  size_t num_checks = 0;
+  // Process() reads the parameters every kBlockSize samples, so Render()
+  // matches it when called with multiples of kBlockSize.
+  const size_t block_sizes[] = { 16, 48, 1024, 65536 };
+  for (int range = 0; range < 3; ++range) {
+    for (int mode = 0; mode < 3; ++mode) {
+      for (int sync = 0; sync < 2; ++sync) {
+        Setting setting = {
+            static_cast<GeneratorRange>(range),
+            static_cast<GeneratorMode>(mode),
+            sync == 1 };
+        RenderWithProcess(setting, control, &reference);
+        for (size_t i = 0; i < 4; ++i) {
+          RenderWithBlocks(setting, delayed_control, block_sizes[i], &output);
+          int32_t mismatch = reference.Compare(output, kBlockSize);
+          if (mismatch != -1) {
+            printf("%s %s%s, blocks of %zu: mismatch at sample %d\n",
+                range_names[range], mode_names[mode], sync ? " sync" : "",
+                block_sizes[i], mismatch);
+            return false;
+          }
+          ++num_checks;
+        }
+      }
+    }
+  }
+  printf("Render() matches Process() in %zu configurations.\n\n",
+      num_checks);
+  return true;
+}
+
+// Best of several runs, in ns per sample.
+double Time(const Setting& setting, bool blocks) {
+  std::vector<uint8_t> control(kBenchmarkDuration);
+  MakeControl(&control);
+  Output output(control.size());
+  double best = 0.0;
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    clock_t start = clock();
+    if (blocks) {
+      RenderWithBlocks(setting, control, 4096, &output);
+    } else {
+      RenderWithProcess(setting, control, &output);
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  return best * 1e9 / control.size();
+}
+
+void Benchmark() {
+  printf("%-16s %12s %12s %8s %14s\n",
+      "setting", "process ns", "render ns", "speedup", "render s/s");
+  for (int range = 0; range < 3; ++range) {
+    Setting setting = {
+        static_cast<GeneratorRange>(range), GENERATOR_MODE_LOOPING, false };
+    double t_process = Time(setting, false);
+    double t_render = Time(setting, true);
+    char name[32];
+    sprintf(name, "%s looping", range_names[range]);
+    printf("%-16s %12.2f %12.2f %7.2fx %14.0f\n", name, t_process, t_render,
+        t_render > 0.0 ? t_process / t_render : 0.0,
+        t_render > 0.0 ? 1e9 / t_render / kSampleRate : 0.0);
+  }
+}
+
+int main(void) {
+  if (!Check()) {
+    return 1;
+  }
+  Benchmark();
+  return 0;
+}
@@ -0,0 +1,228 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Measures how much of the audio rate block is spent computing the
+// coefficients which only depend on the parameters, and which are cached
+// between blocks.
+//
+// Usage:
+//   setup_cache_benchmark
+//
+// Each patch is rendered twice, one block at a time: once normally, and once
+// with a slope and smoothness setter round-trip before each block, which
+// invalidates every group of coefficients but the wavetable pointers (two
+// loads), and brings back the cost of the uncached code. Both outputs must be
+// identical. Modulated patches change a parameter before every block, and
+// only the coefficients depending on it are recomputed.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+#include "tides/generator.h"
+
+using namespace tides;
+using namespace stmlib;
+
+const uint32_t kSampleRate = 48000;
+const uint32_t kNumBlocks = 2 * kSampleRate / kBlockSize;
+const size_t kNumRuns = 100;
+
+enum Patch {
+  PATCH_STATIC,
+  PATCH_VIBRATO,
+  PATCH_SHAPE_LFO,
+  PATCH_SLOPE_LFO,
+  PATCH_NOISY_CV,
+  PATCH_LAST
+};
+
+const char* const patch_names[] = {
+  "static", "vibrato", "shape lfo", "slope lfo", "noisy cv"
+};
+
+struct Parameters {
+  int16_t pitch;
+  int16_t shape;
+  int16_t slope;
+  int16_t smoothness;
+};
+
+uint32_t rng_state = 0x21;
+
+inline int16_t Noise(int16_t amount) {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return static_cast<int16_t>((rng_state >> 16) % (2 * amount + 1)) - amount;
+}
+
+// Triangle LFO with a period of 1024 blocks, between -amount and amount.
+inline int16_t Lfo(uint32_t block, int16_t amount) {
+  int32_t t = block & 1023;
+  int32_t triangle = t < 512 ? t - 256 : 767 - t;
+  return triangle * amount / 256;
+}
+
+Parameters Modulate(Patch patch, uint32_t block) {
+  Parameters p;
+  p.pitch = 48 << 7;
+  p.shape = 8000;
+  p.slope = -10000;
+  p.smoothness = 12000;
+  switch (patch) {
+    case PATCH_VIBRATO:
+      p.pitch += Lfo(block, 64);
+      break;
+    case PATCH_SHAPE_LFO:
+      p.shape += Lfo(block, 16000);
+      break;
+    case PATCH_SLOPE_LFO:
+      p.slope += Lfo(block, 16000);
+      break;
+    case PATCH_NOISY_CV:
+      // Like unfiltered CVs: every parameter moves by a few LSBs.
+      p.pitch += Noise(4);
+      p.shape += Noise(8);
+      p.slope += Noise(8);
+      p.smoothness += Noise(8);
+      break;
+    default:
+      break;
+  }
+  return p;
+}
+
+class Output {
+ public:
+  Output(size_t size) : unipolar_(size), bipolar_(size), flags_(size) { }
+  
+  GeneratorBuffers block(uint32_t index) {
+    GeneratorBuffers b;
+    b.unipolar = &unipolar_[index * kBlockSize];
+    b.bipolar = &bipolar_[index * kBlockSize];
+    b.flags = &flags_[index * kBlockSize];
+    return b;
+  }
+  
+  bool operator==(const Output& other) const {
+    return unipolar_ == other.unipolar_ && bipolar_ == other.bipolar_ &&
+        flags_ == other.flags_;
+  }
+
+ private:
+  std::vector<uint16_t> unipolar_;
+  std::vector<int16_t> bipolar_;
+  std::vector<uint8_t> flags_;
+};
+
+Generator generator;
+uint8_t control[kBlockSize];
+
+// Writes the whole output when recording, otherwise overwrites the same
+// block to keep the timings out of the memory bandwidth. Returns a checksum
+// of the output.
+int32_t Render(Patch patch, bool cached, Output* output, bool record) {
+  generator.Init();
+  generator.set_range(GENERATOR_RANGE_HIGH);
+  generator.set_mode(GENERATOR_MODE_LOOPING);
+  generator.set_sync(false);
+  rng_state = 0x21;
+  
+  int32_t checksum = 0;
+  for (uint32_t i = 0; i < kNumBlocks; ++i) {
+    Parameters p = Modulate(patch, i);
+    generator.set_pitch(p.pitch);
+    generator.set_shape(p.shape);
+    if (!cached) {
+      generator.set_slope(p.slope ? 0 : 1);
+      generator.set_smoothness(p.smoothness ? 0 : 1);
+    }
+    generator.set_slope(p.slope);
+    generator.set_smoothness(p.smoothness);
+    GeneratorBuffers b = output->block(record ? i : 0);
+    generator.Render(control, b, kBlockSize);
+    checksum += b.bipolar[i % kBlockSize];
+  }
+  return checksum;
+}
+
+double TimeRender(Patch patch, bool cached, Output* output, int32_t* checksum) {
+  clock_t start = clock();
+  *checksum += Render(patch, cached, output, false);
+  double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+  return elapsed * 1e9 / kNumBlocks;
+}
+
+// The clock of the host drifts by much more than what the cache saves, so
+// each cached run is compared to the average of the uncached runs around it,
+// and the median of these ratios is reported. The uncached time is the median
+// of the uncached runs, in ns per block.
+void Time(Patch patch, Output* output, double* uncached, double* ratio) {
+  int32_t checksum = 0;
+  std::vector<double> uncached_runs;
+  std::vector<double> ratios;
+  double before = TimeRender(patch, false, output, &checksum);
+  for (size_t run = 0; run < kNumRuns; ++run) {
+    double cached = TimeRender(patch, true, output, &checksum);
+    double after = TimeRender(patch, false, output, &checksum);
+    uncached_runs.push_back(after);
+    ratios.push_back(2.0 * cached / (before + after));
+    before = after;
+  }
+  std::sort(uncached_runs.begin(), uncached_runs.end());
+  std::sort(ratios.begin(), ratios.end());
+  *uncached = uncached_runs[kNumRuns / 2];
+  *ratio = ratios[kNumRuns / 2];
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+}
+
+int main(void) {
+  Output reference(kNumBlocks * kBlockSize);
+  Output output(kNumBlocks * kBlockSize);
+  control[0] = CONTROL_GATE_RISING;
+  
+  printf("%-12s %14s %14s %10s\n",
+      "patch", "uncached ns", "cached ns", "saved");
+  for (size_t i = 0; i < PATCH_LAST; ++i) {
+    Patch patch = static_cast<Patch>(i);
+    Render(patch, false, &reference, true);
+    Render(patch, true, &output, true);
+    if (!(output == reference)) {
+      printf("%s: the cached coefficients do not match\n", patch_names[i]);
+      return 1;
+    }
+    double t_uncached = 0.0;
+    double ratio = 1.0;
+    Time(patch, &output, &t_uncached, &ratio);
+    printf("%-12s %14.1f %14.1f %9.1f%%\n", patch_names[i], t_uncached,
+        t_uncached * ratio, 100.0 * (1.0 - ratio));
+  }
+  printf("\nns per block of %d samples, saved as a fraction of the block.\n",
+      kBlockSize);
+  return 0;
+}
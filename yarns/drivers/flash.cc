@@ -0,0 +1,60 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Driver for the flash pages reserved for the settings.
+
+#include "yarns/drivers/flash.h"
+
+#include <stm32f10x_conf.h>
+
+namespace yarns {
+
+const uint32_t kFlashStorageStart = \
+    kFlashStorageEnd - kFlashNumPages * kFlashPageSize;
+
+/* static */
+const uint16_t* Flash::page(uint16_t index) {
+  return reinterpret_cast<const uint16_t*>(
+      kFlashStorageStart + index * kFlashPageSize);
+}
+
+/* static */
+void Flash::ErasePage(uint16_t index) {
+  FLASH_Unlock();
+  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+  FLASH_ErasePage(kFlashStorageStart + index * kFlashPageSize);
+}
+
+/* static */
+void Flash::Program(uint16_t index, size_t word, uint16_t value) {
+  FLASH_Unlock();
+  FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+  FLASH_ProgramHalfWord(
+      kFlashStorageStart + index * kFlashPageSize + word * 2,
+      value);
+}
+
+}  // namespace yarns
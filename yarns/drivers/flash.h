@@ -0,0 +1,66 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Driver for the flash pages reserved for the settings.
+//
+// Only declares the operations needed by the settings log. On the host, they
+// are provided by yarns/test/flash_simulator.cc instead of flash.cc.
+
+#ifndef YARNS_DRIVERS_FLASH_H_
+#define YARNS_DRIVERS_FLASH_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+// The last 9 pages of a medium density STM32F103 (128kB, 1kB pages).
+const uint32_t kFlashStorageEnd = 0x8020000;
+const uint16_t kFlashNumPages = 9;
+const size_t kFlashPageSize = 1024;
+const size_t kFlashPageWords = kFlashPageSize / 2;
+
+class Flash {
+ public:
+  Flash() { }
+  ~Flash() { }
+  
+  // The pages are memory-mapped, and can be read directly.
+  static const uint16_t* page(uint16_t index);
+  
+  // Sets all the bits of a page.
+  static void ErasePage(uint16_t index);
+  
+  // Programs the half-word at the given index of a page. It must be erased,
+  // or the value must be 0.
+  static void Program(uint16_t index, size_t word, uint16_t value);
+  
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Flash);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_DRIVERS_FLASH_H_
@@ -48,35 +48,210 @@ void JustIntonationProcessor::Init() {
   std::fill(&history_[0], &history_[kHistorySize], e);
 }
 
+void JustIntonationProcessor::Accumulate(
+    uint32_t* badness,
+    int16_t start,
+    uint16_t weight) const {
+  // The intervals between the candidates and the previous note are
+  // consecutive entries of the table, wrapping around at the octave.
+  uint8_t wrap = kOctave - start < kNumCorrections
+      ? kOctave - start
+      : kNumCorrections;
+  const uint16_t* consonance = &lut_consonance[start];
+  for (uint8_t i = 0; i < wrap; ++i) {
+    badness[i] += consonance[i] * weight;
+  }
+  for (uint8_t i = wrap; i < kNumCorrections; ++i) {
+    badness[i] += lut_consonance[i - wrap] * weight;
+  }
+}
+
+void JustIntonationProcessor::AccumulateHistory(
+    uint8_t note,
+    uint8_t min_weight,
+    uint8_t max_weight,
+    uint8_t excluded_note,
+    uint32_t* badness) const {
+  // Only the notes whose weight is within [min_weight, max_weight] are
+  // considered, except excluded_note when it is still held.
+  int16_t first_pitch = (note << 7) - (kNumCorrections >> 1);
+  
+  // Interval between the first candidate and each previous note, reduced to
+  // the range covered by the lookup table. Notes an octave apart, or played
+  // several times, contribute to the same entries of the table, so their
+  // weights are summed and the table is read only once.
+  int16_t start[kHistorySize];
+  uint16_t weight[kHistorySize];
+  uint8_t num_intervals = 0;
+  for (uint8_t i = 0; i < kHistorySize; ++i) {
+    if (history_[i].weight < min_weight ||
+        history_[i].weight > max_weight ||
+        (history_[i].note == excluded_note && history_[i].weight == 255)) {
+      continue;
+    }
+    int16_t interval = (first_pitch - history_[i].pitch) % kOctave;
+    if (interval < 0) {
+      interval += kOctave;
+    }
+    uint8_t j = 0;
+    while (j < num_intervals && start[j] != interval) {
+      ++j;
+    }
+    if (j == num_intervals) {
+      start[j] = interval;
+      weight[j] = 0;
+      ++num_intervals;
+    }
+    weight[j] += history_[i].weight;
+  }
+  
+  for (uint8_t i = 0; i < num_intervals; ++i) {
+    Accumulate(badness, start[i], weight[i]);
+  }
+}
+
+void JustIntonationProcessor::ComputeBadness(
+    uint8_t note,
+    uint8_t excluded_note,
+    uint32_t* badness) const {
+  std::fill(&badness[0], &badness[kNumCorrections], 0);
+  // Penalize the candidates which are far from the equal tempered note.
+  Accumulate(badness, kOctave - (kNumCorrections >> 1), 1);
+  AccumulateHistory(note, 1, 255, excluded_note, badness);
+}
+
 int16_t JustIntonationProcessor::TuneInternal(uint8_t note) {
-  uint32_t best_score = 0xffffffff;
-  int16_t best_pitch = 0;
-  for (int16_t correction = -64; correction <= 64; ++correction) {
-    uint32_t score = lut_consonance[
-        correction >= 0 ? correction : (kOctave + correction)];
-    int16_t pitch = correction + (note << 7);
-    for (uint8_t i = 0; i < kHistorySize; ++i) {
-      int16_t interval = pitch - history_[i].pitch;
-      while (interval < 0) {
-        interval += kOctave;
+  uint32_t badness[kNumCorrections];
+  ComputeBadness(note, 0xff, badness);
+  
+  uint8_t best = 0;
+  for (uint8_t i = 1; i < kNumCorrections; ++i) {
+    if (badness[i] < badness[best]) {
+      best = i;
+    }
+  }
+  return (note << 7) - (kNumCorrections >> 1) + best;
+}
+
+void JustIntonationProcessor::TuneChord(
+    const uint8_t* notes,
+    uint8_t size,
+    int16_t* pitches) {
+  if (size > kMaxChordSize) {
+    size = kMaxChordSize;
+  }
+  
+  // The candidate tunings of each note are the deepest local minima of its
+  // badness with respect to the whole history, excluding itself. The best
+  // one is the note-by-note tuning. The others are the alternatives which
+  // would have won, had the other notes of the chord been tuned differently.
+  int16_t candidate[kMaxChordSize][kNumChordCandidates];
+  uint32_t score[kMaxChordSize][kNumChordCandidates];
+  uint8_t num_candidates[kMaxChordSize];
+  for (uint8_t i = 0; i < size; ++i) {
+    uint32_t badness[kNumCorrections];
+    uint8_t correction[kNumChordCandidates];
+    ComputeBadness(notes[i], notes[i], badness);
+    std::fill(&score[i][0], &score[i][kNumChordCandidates], 0xffffffff);
+    num_candidates[i] = 0;
+    for (uint8_t j = 0; j < kNumCorrections; ++j) {
+      if ((j && badness[j] >= badness[j - 1]) ||
+          (j + 1 < kNumCorrections && badness[j] > badness[j + 1])) {
+        continue;
       }
-      while (interval > kOctave) {
-        interval -= kOctave;
+      uint8_t k = num_candidates[i];
+      while (k && badness[j] < score[i][k - 1]) {
+        if (k < kNumChordCandidates) {
+          score[i][k] = score[i][k - 1];
+          correction[k] = correction[k - 1];
+        }
+        --k;
       }
-      score += lut_consonance[interval] * history_[i].weight;
-      if (score > best_score) {
-        break;
+      if (k < kNumChordCandidates) {
+        score[i][k] = badness[j];
+        correction[k] = j;
+        if (num_candidates[i] < kNumChordCandidates) {
+          ++num_candidates[i];
+        }
       }
     }
-    if (score < best_score) {
-      best_pitch = pitch;
-      best_score = score;
+    
+    // In the joint search, the other notes of the chord are scored by
+    // pairs, so only the released notes are taken into account here.
+    std::fill(&badness[0], &badness[kNumCorrections], 0);
+    Accumulate(badness, kOctave - (kNumCorrections >> 1), 1);
+    AccumulateHistory(notes[i], 1, 254, 0xff, badness);
+    for (uint8_t k = 0; k < num_candidates[i]; ++k) {
+      candidate[i][k] = (notes[i] << 7) - (kNumCorrections >> 1) + \
+          correction[k];
+      score[i][k] = badness[correction[k]];
+    }
+  }
+  
+  // Dissonance between the candidates of each pair of notes. The notes of the
+  // chord are all held, so they are weighted as such.
+  const uint8_t kMaxNumPairs = kMaxChordSize * (kMaxChordSize - 1) / 2;
+  uint32_t pair_score[kMaxNumPairs][kNumChordCandidates][kNumChordCandidates];
+  uint8_t pair = 0;
+  for (uint8_t i = 1; i < size; ++i) {
+    for (uint8_t j = 0; j < i; ++j) {
+      for (uint8_t a = 0; a < num_candidates[i]; ++a) {
+        for (uint8_t b = 0; b < num_candidates[j]; ++b) {
+          int16_t interval = (candidate[i][a] - candidate[j][b]) % kOctave;
+          if (interval < 0) {
+            interval += kOctave;
+          }
+          pair_score[pair][a][b] = lut_consonance[interval] * 255;
+        }
+      }
+      ++pair;
     }
   }
-  return best_pitch;
+  
+  // Exhaustive search. Each combination is a number in a mixed radix, with
+  // one digit per note. Combination 0 is the note-by-note tuning, and is kept
+  // in case of a tie.
+  uint16_t num_combinations = 1;
+  for (uint8_t i = 0; i < size; ++i) {
+    num_combinations *= num_candidates[i];
+  }
+  uint32_t best_score = 0xffffffff;
+  uint8_t best_choice[kMaxChordSize];
+  std::fill(&best_choice[0], &best_choice[kMaxChordSize], 0);
+  for (uint16_t combination = 0; combination < num_combinations;
+       ++combination) {
+    uint8_t choice[kMaxChordSize];
+    uint16_t digits = combination;
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < size; ++i) {
+      choice[i] = digits % num_candidates[i];
+      digits /= num_candidates[i];
+      total += score[i][choice[i]];
+    }
+    pair = 0;
+    for (uint8_t i = 1; i < size; ++i) {
+      for (uint8_t j = 0; j < i; ++j) {
+        total += pair_score[pair][choice[i]][choice[j]];
+        ++pair;
+      }
+    }
+    if (total < best_score) {
+      best_score = total;
+      std::copy(&choice[0], &choice[size], &best_choice[0]);
+    }
+  }
+  
+  for (uint8_t i = 0; i < size; ++i) {
+    pitches[i] = candidate[i][best_choice[i]];
+    for (uint8_t j = 0; j < kHistorySize; ++j) {
+      if (history_[j].note == notes[i] && history_[j].weight == 255) {
+        history_[j].pitch = pitches[i];
+      }
+    }
+  }
+  
+  // The history has changed.
+  cached_note_ = 0xff;
 }
 
-/* extern */
-JustIntonationProcessor just_intonation_processor;
-
 }  // namespace yarns
\ No newline at end of file
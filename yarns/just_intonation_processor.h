@@ -41,6 +41,23 @@
 // interval involves more convoluted ratios (say 32/27), and goes up according
 // to a square law as we move away from the just intervals.
 // The tuning giving the least badness score is selected.
+//
+// The badness scores of all candidates are accumulated in a vector, one
+// previous note at a time. The intervals between the candidates and a given
+// previous note are consecutive entries of the lookup table, so each note only
+// costs one modulo, followed by a branch-free multiply-accumulate over a
+// contiguous section of the table. Notes whose weight has decayed to 0 are
+// skipped, and notes in the same pitch class are merged. The tuning is then
+// the argmin of the vector.
+//
+// Chords can also be tuned as a whole. For each note of the chord, a few
+// candidate tunings are kept: the deepest local minima of its badness with
+// respect to all the other notes. All the combinations of these candidates
+// are then scored by adding the badness with respect to the released notes
+// to the dissonance between each pair of notes of the chord, and the best
+// combination is selected. With 4 notes and 4 candidates per note, this is
+// at most 256 combinations of 10 terms each, whose 96 pairwise scores are
+// read from the lookup table only once.
 
 #ifndef YARNS_JUST_INTONATION_PROCESSOR_H_
 #define YARNS_JUST_INTONATION_PROCESSOR_H_
@@ -56,6 +73,9 @@ struct HistoryEntry {
 };
 
 const uint8_t kHistorySize = 16;
+const uint8_t kNumCorrections = 129;
+const uint8_t kMaxChordSize = 4;
+const uint8_t kNumChordCandidates = 4;
 
 class JustIntonationProcessor {
  public:
@@ -95,8 +115,28 @@ class JustIntonationProcessor {
     return cached_pitch_;
   }
   
+  // Retunes all the notes of a chord together. The notes must have been
+  // played with NoteOn and not released yet. Up to kMaxChordSize notes are
+  // considered; their new tunings are written to pitches, and replace the
+  // old ones in the history.
+  void TuneChord(const uint8_t* notes, uint8_t size, int16_t* pitches);
+  
  private:
   int16_t TuneInternal(uint8_t note);
+  void AccumulateHistory(
+      uint8_t note,
+      uint8_t min_weight,
+      uint8_t max_weight,
+      uint8_t excluded_note,
+      uint32_t* badness) const;
+  void ComputeBadness(
+      uint8_t note,
+      uint8_t excluded_note,
+      uint32_t* badness) const;
+  void Accumulate(
+      uint32_t* badness,
+      int16_t start,
+      uint16_t weight) const;
    
   uint8_t write_ptr_;
   uint8_t cached_note_;
@@ -106,8 +146,6 @@ class JustIntonationProcessor {
   DISALLOW_COPY_AND_ASSIGN(JustIntonationProcessor);
 };
 
-extern JustIntonationProcessor just_intonation_processor;
-
 }  // namespace yarns
 
 #endif // YARNS_JUST_INTONATION_PROCESSOR_H_
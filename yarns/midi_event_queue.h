@@ -0,0 +1,115 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Queue of framed MIDI messages, between the UART interrupt and the main loop.
+//
+// The interrupt assembles the incoming bytes into fixed-size records: a
+// complete channel message, with its status byte restored when the sender
+// used running status, a realtime or system message, or a chunk of up to 3
+// bytes of a sysex message. When the queue is full, a record is dropped as a
+// whole, so the loss of a message never shifts the data bytes of the next
+// ones onto a wrong status.
+
+#ifndef YARNS_MIDI_EVENT_QUEUE_H_
+#define YARNS_MIDI_EVENT_QUEUE_H_
+
+#include "stmlib/stmlib.h"
+
+namespace yarns {
+
+struct MidiEvent {
+  uint8_t size;
+  uint8_t bytes[3];
+};
+
+// Single producer, single consumer: the producer only writes write_ptr_ and
+// the counters, the consumer only writes read_ptr_, so neither side has to
+// mask interrupts. size must be a power of 2.
+template<size_t size>
+class MidiEventQueue {
+ public:
+  MidiEventQueue() { }
+  ~MidiEventQueue() { }
+
+  void Init() {
+    read_ptr_ = 0;
+    write_ptr_ = 0;
+    high_water_ = 0;
+    num_overflows_ = 0;
+  }
+
+  inline size_t capacity() const { return size - 1; }
+
+  inline size_t readable() const {
+    return (write_ptr_ - read_ptr_) & (size - 1);
+  }
+
+  // Producer side. Returns false, and counts an overflow, when the queue is
+  // full: overwriting the oldest record would race with the consumer.
+  inline bool Write(const MidiEvent& event) {
+    size_t w = write_ptr_;
+    size_t used = (w - read_ptr_) & (size - 1);
+    if (used == size - 1) {
+      ++num_overflows_;
+      return false;
+    }
+    buffer_[w] = event;
+    // The record must be in memory before the consumer can see it.
+    __asm__ __volatile__("" : : : "memory");
+    write_ptr_ = (w + 1) & (size - 1);
+    if (used + 1 > high_water_) {
+      high_water_ = used + 1;
+    }
+    return true;
+  }
+
+  // Consumer side. The queue must be readable.
+  inline void ImmediateRead(MidiEvent* event) {
+    size_t r = read_ptr_;
+    *event = buffer_[r];
+    __asm__ __volatile__("" : : : "memory");
+    read_ptr_ = (r + 1) & (size - 1);
+  }
+
+  // Largest number of records ever waiting in the queue.
+  inline size_t high_water() const { return high_water_; }
+
+  // Number of records dropped because the queue was full.
+  inline uint32_t num_overflows() const { return num_overflows_; }
+
+ private:
+  MidiEvent buffer_[size];
+  volatile size_t read_ptr_;
+  volatile size_t write_ptr_;
+  volatile size_t high_water_;
+  volatile uint32_t num_overflows_;
+
+  DISALLOW_COPY_AND_ASSIGN(MidiEventQueue);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_MIDI_EVENT_QUEUE_H_
@@ -38,7 +38,7 @@ namespace yarns {
 using namespace std;
 
 /* static */
-MidiHandler::MidiBuffer MidiHandler::input_buffer_; 
+MidiHandler::InputQueue MidiHandler::input_queue_;
 
 /* static */
 MidiHandler::MidiBuffer MidiHandler::output_buffer_;
@@ -49,6 +49,18 @@ MidiHandler::SmallMidiBuffer MidiHandler::high_priority_output_buffer_;
 /* static */
 stmlib_midi::MidiStreamParser<MidiHandler> MidiHandler::parser_;
 
+/* static */
+MidiEvent MidiHandler::rx_event_;
+
+/* static */
+uint8_t MidiHandler::rx_status_;
+
+/* static */
+uint8_t MidiHandler::rx_size_;
+
+/* static */
+uint8_t MidiHandler::parser_status_;
+
 /* static */
 const MidiHandler::SysExDescription MidiHandler::accepted_sysex_[] = {
   { { 0xf0, 0x00, 0x21, 0x02, 0x00, 0x0b }, 6, 0xff,
@@ -83,7 +95,11 @@ bool MidiHandler::factory_testing_requested_;
 
 /* static */
 void MidiHandler::Init() {
-  input_buffer_.Init();
+  input_queue_.Init();
+  rx_event_.size = 0;
+  rx_status_ = 0;
+  rx_size_ = 0;
+  parser_status_ = 0;
   output_buffer_.Init();
   high_priority_output_buffer_.Init();
   sysex_rx_write_ptr_ = 0;
@@ -93,6 +109,79 @@ void MidiHandler::Init() {
   factory_testing_requested_ = false;
 }
 
+/* static */
+void MidiHandler::PushByte(uint8_t byte) {
+  if (byte >= 0xf8) {
+    // Realtime messages can be interleaved anywhere, even within a message.
+    // The bytes of a sysex message received so far must not be overtaken.
+    if (rx_status_ == 0xf0 && rx_event_.size) {
+      input_queue_.Write(rx_event_);
+      rx_event_.size = 0;
+    }
+    MidiEvent realtime = { 1, { byte, 0, 0 } };
+    input_queue_.Write(realtime);
+    return;
+  }
+  
+  if (byte & 0x80) {
+    // A status byte terminates a sysex message. When it is not 0xf7, the
+    // parser sees the end of the sysex once the new message is complete.
+    if (rx_status_ == 0xf0 && rx_event_.size) {
+      input_queue_.Write(rx_event_);
+    }
+    rx_event_.size = 0;
+    if (byte <= 0xf0) {
+      rx_status_ = byte;
+      // Program change and channel pressure have a single data byte.
+      rx_size_ = (byte & 0xe0) == 0xc0 ? 2 : 3;
+      rx_event_.bytes[rx_event_.size++] = byte;
+    } else {
+      // End of sysex, or system common message, which cancels the running
+      // status. Their data bytes are passed on one by one.
+      rx_status_ = 0;
+      MidiEvent system = { 1, { byte, 0, 0 } };
+      input_queue_.Write(system);
+    }
+    return;
+  }
+  
+  if (!rx_status_) {
+    MidiEvent data = { 1, { byte, 0, 0 } };
+    input_queue_.Write(data);
+    return;
+  }
+  
+  if (!rx_event_.size && rx_status_ != 0xf0) {
+    // Running status.
+    rx_event_.bytes[rx_event_.size++] = rx_status_;
+  }
+  rx_event_.bytes[rx_event_.size++] = byte;
+  if (rx_event_.size == rx_size_) {
+    input_queue_.Write(rx_event_);
+    rx_event_.size = 0;
+  }
+}
+
+/* static */
+void MidiHandler::ProcessEvent(const MidiEvent& event) {
+  uint8_t i = 0;
+  uint8_t status = event.bytes[0];
+  if (status >= 0x80 && status < 0xf0) {
+    // Running status compression: the parser already has this status. In
+    // direct thru mode, the bytes pushed to the parser are echoed, and may be
+    // interleaved with other messages: always send the status there.
+    if (status == parser_status_ && !multi.direct_thru()) {
+      i = 1;
+    }
+    parser_status_ = status;
+  } else if (status >= 0xf0 && status < 0xf8) {
+    parser_status_ = 0;
+  }
+  for (; i < event.size; ++i) {
+    parser_.PushByte(event.bytes[i]);
+  }
+}
+
 /* static */
 void MidiHandler::DecodeSysExMessage() {
   uint8_t length = sysex_rx_write_ptr_;
@@ -34,17 +34,20 @@
 #include "stmlib/utils/ring_buffer.h"
 #include "stmlib/midi/midi.h"
 
+#include "yarns/midi_event_queue.h"
 #include "yarns/multi.h"
 
 namespace yarns {
 
 const size_t kSysexMaxChunkSize = 64;
 const size_t kSysexRxBufferSize = kSysexMaxChunkSize * 2 + 16;
+const size_t kMidiInputQueueSize = 128;
 
 class MidiHandler {
  public:
   typedef stmlib::RingBuffer<uint8_t, 128> MidiBuffer;
   typedef stmlib::RingBuffer<uint8_t, 32> SmallMidiBuffer;
+  typedef MidiEventQueue<kMidiInputQueueSize> InputQueue;
    
   MidiHandler() { }
   ~MidiHandler() { }
@@ -199,16 +202,20 @@ class MidiHandler {
     SendNow(0xfc);
   }
   
-  static void PushByte(uint8_t byte) {
-    input_buffer_.Overwrite(byte);
-  }
+  // Called from the UART interrupt.
+  static void PushByte(uint8_t byte);
   
   static void ProcessInput() {
-    while (input_buffer_.readable()) {
-      parser_.PushByte(input_buffer_.ImmediateRead());
+    MidiEvent event;
+    while (input_queue_.readable()) {
+      input_queue_.ImmediateRead(&event);
+      ProcessEvent(event);
     }
   }
   
+  static void ProcessEvent(const MidiEvent& event);
+  
+  static inline InputQueue* mutable_input_queue() { return &input_queue_; }
   static inline MidiBuffer* mutable_output_buffer() { return &output_buffer_; }
   static inline SmallMidiBuffer* mutable_high_priority_output_buffer() {
     return &high_priority_output_buffer_;
@@ -282,11 +289,19 @@ class MidiHandler {
   static void HandleScaleOctaveTuning2ByteForm();
   static void HandleYarnsSpecificMessage();
   
-  static MidiBuffer input_buffer_; 
+  static InputQueue input_queue_;
   static MidiBuffer output_buffer_; 
   static SmallMidiBuffer high_priority_output_buffer_;
   static stmlib_midi::MidiStreamParser<MidiHandler> parser_;
   
+  // Framing state of the interrupt.
+  static MidiEvent rx_event_;
+  static uint8_t rx_status_;
+  static uint8_t rx_size_;
+  
+  // Running status of the parser, as fed by the main loop.
+  static uint8_t parser_status_;
+  
   static uint8_t sysex_rx_buffer_[kSysexRxBufferSize];
   static uint8_t sysex_rx_write_ptr_;
   
@@ -32,7 +32,6 @@
 
 #include "stmlib/algorithms/voice_allocator.h"
 
-#include "yarns/just_intonation_processor.h"
 #include "yarns/midi_handler.h"
 #include "yarns/settings.h"
 
@@ -46,8 +45,6 @@ const uint8_t clock_divisions[] = {
 };
 
 void Multi::Init() {
-  just_intonation_processor.Init();
-  
   fill(
       &settings_.custom_pitch_table[0],
       &settings_.custom_pitch_table[12],
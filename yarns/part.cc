@@ -33,7 +33,6 @@
 #include "stmlib/midi/midi.h"
 #include "stmlib/utils/random.h"
 
-#include "yarns/just_intonation_processor.h"
 #include "yarns/midi_handler.h"
 #include "yarns/resources.h"
 #include "yarns/voice.h"
@@ -63,6 +62,7 @@ void Part::Init() {
   seq_recording_ = false;
   seq_running_ = false;
   release_latched_keys_on_next_note_on_ = false;
+  just_intonation_processor_.Init();
 }
   
 void Part::AllocateVoices(Voice* voice, uint8_t num_voices, bool polychain) {
@@ -534,6 +534,9 @@ void Part::InternalNoteOn(uint8_t note, uint8_t velocity) {
           voicing_.portamento,
           true);
       active_note_[voice_index] = note;
+      if (voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION_CHORDS) {
+        TuneChord();
+      }
     } else {
       // Polychaining forwarding.
       midi_handler.OnInternalNoteOn(tx_channel(), note, velocity);
@@ -547,8 +550,9 @@ void Part::InternalNoteOff(uint8_t note) {
     midi_handler.OnInternalNoteOff(tx_channel(), note);
   }
   
-  if (voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION) {
-    just_intonation_processor.NoteOff(note);
+  if (voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION ||
+      voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION_CHORDS) {
+    just_intonation_processor_.NoteOff(note);
   }
   
   if (voicing_.allocation_mode == VOICE_ALLOCATION_MODE_MONO) {
@@ -653,9 +657,11 @@ int16_t Part::Tune(int16_t midi_note) {
   int16_t pitch = note << 7;
   uint8_t pitch_class = (note + 240) % 12;
 
-  // Just intonation.
-  if (voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION) {
-    pitch = just_intonation_processor.NoteOn(note);
+  // Just intonation. In chord mode, this note is retuned along with the
+  // other held notes once it has been allocated to a voice.
+  if (voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION ||
+      voicing_.tuning_system == TUNING_SYSTEM_JUST_INTONATION_CHORDS) {
+    pitch = just_intonation_processor_.NoteOn(note);
   } else if (voicing_.tuning_system == TUNING_SYSTEM_CUSTOM) {
     pitch += custom_pitch_table_[pitch_class];
   } else if (voicing_.tuning_system > TUNING_SYSTEM_JUST_INTONATION) {
@@ -668,4 +674,25 @@ int16_t Part::Tune(int16_t midi_note) {
   return pitch;
 }
 
+void Part::TuneChord() {
+  uint8_t notes[kMaxNumVoices];
+  uint8_t voices[kMaxNumVoices];
+  int16_t pitches[kMaxNumVoices];
+  uint8_t size = 0;
+  for (uint8_t i = 0; i < num_voices_; ++i) {
+    if (active_note_[i] != VOICE_ALLOCATION_NOT_FOUND) {
+      notes[size] = active_note_[i];
+      voices[size] = i;
+      ++size;
+    }
+  }
+  if (!size) {
+    return;
+  }
+  just_intonation_processor_.TuneChord(notes, size, pitches);
+  for (uint8_t i = 0; i < size; ++i) {
+    voice_[voices[i]]->Retune(pitches[i]);
+  }
+}
+
 }  // namespace yarns
@@ -35,6 +35,8 @@
 #include "stmlib/algorithms/voice_allocator.h"
 #include "stmlib/algorithms/note_stack.h"
 
+#include "yarns/just_intonation_processor.h"
+
 namespace yarns {
 
 class Voice;
@@ -81,6 +83,7 @@ enum TuningSystem {
   TUNING_SYSTEM_RAGA_1,
   TUNING_SYSTEM_RAGA_27 = TUNING_SYSTEM_RAGA_1 + 26,
   TUNING_SYSTEM_CUSTOM,
+  TUNING_SYSTEM_JUST_INTONATION_CHORDS,
   TUNING_SYSTEM_LAST
 };
 
@@ -348,6 +351,7 @@ class Part {
   
  private:
   int16_t Tune(int16_t note);
+  void TuneChord();
   void ResetAllControllers();
   void AllNotesOff();
   void TouchVoiceAllocation();
@@ -378,6 +382,8 @@ class Part {
   stmlib::NoteStack<12> mono_allocator_;
   stmlib::VoiceAllocator<kMaxNumVoices> poly_allocator_;
   uint8_t active_note_[kMaxNumVoices];
+  
+  JustIntonationProcessor just_intonation_processor_;
   uint8_t cyclic_allocation_note_counter_;
   
   uint8_t arp_seq_prescaler_;
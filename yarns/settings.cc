@@ -111,7 +111,8 @@ const char* const tuning_system_values[] = {
   "25 KAUSHIK TODI",
   "26 JOGESHWARI",
   "27 RASIA",
-  "CUSTOM"
+  "CUSTOM",
+  "JUST INTONATION CHORDS"
 };
 
 /* static */
@@ -0,0 +1,498 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Log-structured storage of the settings.
+
+#include "yarns/settings_log.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+using namespace std;
+
+/* static */
+bool SettingsLog::live(uint16_t page) {
+  const uint16_t* words = Flash::page(page);
+  return words[0] == kMagic && \
+      words[3] == static_cast<uint16_t>(~(words[1] ^ words[2]));
+}
+
+/* static */
+bool SettingsLog::erased(uint16_t page) {
+  const uint16_t* words = Flash::page(page);
+  for (size_t i = 0; i < kFlashPageWords; ++i) {
+    if (words[i] != 0xffff) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* static */
+uint32_t SettingsLog::sequence(uint16_t page) {
+  const uint16_t* words = Flash::page(page);
+  return static_cast<uint32_t>(words[2]) << 16 | words[1];
+}
+
+/* static */
+uint16_t SettingsLog::replaced(uint16_t page) {
+  uint16_t marker = Flash::page(page)[4];
+  uint16_t old_page = marker & 0xff;
+  // An interrupted operation leaves bits set rather than cleared, which never
+  // turns a marker into the one of another page.
+  if ((marker >> 8) != (~old_page & 0xff) || old_page >= kFlashNumPages) {
+    return kFlashNumPages;
+  }
+  return old_page;
+}
+
+/* static */
+uint16_t SettingsLog::Checksum(const uint16_t* words, size_t size) {
+  uint16_t sum = kMagic;
+  while (size--) {
+    sum += *words++;
+  }
+  // An erased half-word is never a valid checksum.
+  return sum == 0xffff ? 0 : sum;
+}
+
+/* static */
+size_t SettingsLog::NextGroup(const uint16_t* words, size_t* word) {
+  size_t i = *word;
+  while (i < kFlashPageWords && words[i] == 0) {
+    ++i;
+  }
+  *word = i;
+  if (i >= kFlashPageWords || words[i] == 0xffff) {
+    return 0;
+  }
+  uint8_t slot = words[i] >> 10;
+  while (i + kRecordOverhead <= kFlashPageWords) {
+    uint16_t header = words[i];
+    uint16_t location = words[i + 1];
+    size_t size = header & 0x3ff;
+    size_t offset = location & 0x7fff;
+    size_t num_words = (size + 1) >> 1;
+    if (header >> 10 != slot || slot >= kMaxNumSlots || !size ||
+        offset + size > kMaxSlotSize ||
+        i + kRecordOverhead + num_words > kFlashPageWords ||
+        Checksum(&words[i], num_words + 2) != words[i + 2 + num_words]) {
+      return 0;
+    }
+    i += kRecordOverhead + num_words;
+    if (location & 0x8000) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+bool SettingsLog::Init() {
+  num_live_ = 0;
+  bool foreign = false;
+  for (uint16_t page = 0; page < kFlashNumPages; ++page) {
+    if (live(page)) {
+      uint16_t i = num_live_++;
+      for (; i > 0 && sequence(order_[i - 1]) > sequence(page); --i) {
+        order_[i] = order_[i - 1];
+      }
+      order_[i] = page;
+    } else if (!erased(page)) {
+      foreign = true;
+    }
+  }
+  if (!num_live_) {
+    if (foreign) {
+      return false;
+    }
+    Create();
+    return true;
+  }
+  sequence_ = sequence(order_[num_live_ - 1]);
+  wear_levelling_pending_ = false;
+  erase_pending_ = kFlashNumPages;
+  // A moved page which has not been erased, or whose erase was interrupted
+  // with its header intact. Only an older page can have been replaced: a page
+  // erased and reused since then has a newer sequence number.
+  for (uint8_t i = num_live_; i > 0; --i) {
+    uint16_t* old_page = find(
+        &order_[0], &order_[i - 1], replaced(order_[i - 1]));
+    if (old_page != &order_[i - 1]) {
+      Erase(old_page - &order_[0]);
+    }
+  }
+  if (num_live_ == kFlashNumPages) {
+    // Interrupted while copying a page. The previous version is still there.
+    Erase(num_live_ - 1);
+  }
+  for (uint8_t i = 0; i < num_live_; ) {
+    Seek(order_[i]);
+    if (!slots_[order_[i]]) {
+      // Interrupted while writing a new slot to an erased page.
+      Erase(i);
+    } else {
+      ++i;
+    }
+  }
+  // Interrupted while writing the first slot of a log, before the settings
+  // of an earlier firmware were all moved to it.
+  return num_live_ || !foreign;
+}
+
+void SettingsLog::Create() {
+  num_live_ = 0;
+  sequence_ = 0;
+  wear_levelling_pending_ = false;
+  erase_pending_ = kFlashNumPages;
+}
+
+void SettingsLog::Seek(uint16_t page) {
+  const uint16_t* words = Flash::page(page);
+  slots_[page] = 0;
+  size_t word = kHeaderWords;
+  size_t end;
+  while ((end = NextGroup(words, &word)) != 0) {
+    slots_[page] |= 1 << (words[word] >> 10);
+    word = end;
+  }
+  size_t last = kFlashPageWords;
+  while (last > word && words[last - 1] == 0xffff) {
+    --last;
+  }
+  for (size_t i = word; i < last; ++i) {
+    if (words[i]) {
+      Flash::Program(page, i, 0);
+    }
+  }
+  write_offset_[page] = last;
+}
+
+bool SettingsLog::Open(bool erase) {
+  uint16_t first = num_live_ ? order_[num_live_ - 1] + 1 : 0;
+  for (uint16_t i = 0; i < 2 * kFlashNumPages; ++i) {
+    uint16_t page = (first + i) % kFlashNumPages;
+    if (find(&order_[0], &order_[num_live_], page) != &order_[num_live_]) {
+      continue;
+    }
+    // The erased pages are tried first.
+    if (!erased(page)) {
+      if (i < kFlashNumPages || !erase) {
+        continue;
+      }
+      Flash::ErasePage(page);
+    }
+    if (page == erase_pending_) {
+      erase_pending_ = kFlashNumPages;
+    }
+    ++sequence_;
+    uint16_t low = sequence_;
+    uint16_t high = sequence_ >> 16;
+    Flash::Program(page, 0, kMagic);
+    Flash::Program(page, 1, low);
+    Flash::Program(page, 2, high);
+    Flash::Program(page, 3, ~(low ^ high));
+    order_[num_live_++] = page;
+    write_offset_[page] = kHeaderWords;
+    slots_[page] = 0;
+    return true;
+  }
+  return false;
+}
+
+void SettingsLog::Erase(uint8_t index) {
+  Flash::ErasePage(order_[index]);
+  copy(&order_[index + 1], &order_[num_live_], &order_[index]);
+  --num_live_;
+}
+
+void SettingsLog::ErasePending() {
+  if (erase_pending_ != kFlashNumPages) {
+    Flash::ErasePage(erase_pending_);
+    erase_pending_ = kFlashNumPages;
+  }
+}
+
+uint8_t SettingsLog::Home(uint8_t slot) const {
+  for (uint8_t i = num_live_; i > 0; --i) {
+    if (slots_[order_[i - 1]] & (1 << slot)) {
+      return i - 1;
+    }
+  }
+  return kNone;
+}
+
+size_t SettingsLog::Footprint(uint8_t index) {
+  size_t footprint = 0;
+  for (uint8_t slot = 0; slot < kMaxNumSlots; ++slot) {
+    if (Home(slot) == index) {
+      Prepare(slot, NULL, 0);
+      footprint += GroupCost(kMaxSlotSize);
+    }
+  }
+  return footprint;
+}
+
+bool SettingsLog::Move(
+    uint8_t index,
+    uint8_t slot,
+    const uint8_t* data,
+    size_t size) {
+  uint16_t moved = 0;
+  for (uint8_t i = 0; i < kMaxNumSlots; ++i) {
+    if (Home(i) == index) {
+      moved |= 1 << i;
+    }
+  }
+  if (data) {
+    moved |= 1 << slot;
+  }
+  size_t cost = 0;
+  for (uint8_t i = 0; i < kMaxNumSlots; ++i) {
+    if (moved & (1 << i)) {
+      Prepare(i, data && i == slot ? data : NULL, size);
+      cost += GroupCost(kMaxSlotSize);
+    }
+  }
+  uint16_t source = order_[index];
+  if (cost > kPageCapacity) {
+    return false;
+  }
+  // Only one page is left unerased at a time: two moves without an idle
+  // moment in between pay for the erase of the first one.
+  ErasePending();
+  if (!Open(true)) {
+    return false;
+  }
+  uint16_t page = order_[num_live_ - 1];
+  for (uint8_t i = 0; i < kMaxNumSlots; ++i) {
+    if (moved & (1 << i)) {
+      Prepare(i, data && i == slot ? data : NULL, size);
+      WriteGroup(page, i, image_, kMaxSlotSize);
+    }
+  }
+  Flash::Program(page, 4, source | (~source & 0xff) << 8);
+  index = find(&order_[0], &order_[num_live_], source) - &order_[0];
+  copy(&order_[index + 1], &order_[num_live_], &order_[index]);
+  --num_live_;
+  erase_pending_ = source;
+  return true;
+}
+
+void SettingsLog::Replay(uint8_t slot) {
+  fill(&state_[0], &state_[sizeof(state_)], 0);
+  for (uint8_t i = 0; i < num_live_; ++i) {
+    const uint16_t* words = Flash::page(order_[i]);
+    size_t word = kHeaderWords;
+    size_t end;
+    while ((end = NextGroup(words, &word)) != 0) {
+      if (words[word] >> 10 != slot) {
+        word = end;
+        continue;
+      }
+      while (word < end) {
+        size_t size = words[word] & 0x3ff;
+        size_t offset = words[word + 1] & 0x7fff;
+        const uint16_t* data = &words[word + 2];
+        for (size_t j = 0; j < size; ++j) {
+          image_[offset + j] = data[j >> 1] >> ((j & 1) << 3);
+          set_state(offset + j, BYTE_RESOLVED);
+        }
+        word += kRecordOverhead + ((size + 1) >> 1);
+      }
+    }
+  }
+}
+
+void SettingsLog::Prepare(uint8_t slot, const uint8_t* data, size_t size) {
+  Replay(slot);
+  for (size_t i = 0; i < kMaxSlotSize; ++i) {
+    if (data && i < size) {
+      image_[i] = data[i];
+      set_state(i, BYTE_MODIFIED);
+    } else if (state(i) == BYTE_RESOLVED) {
+      set_state(i, BYTE_MODIFIED);
+    }
+  }
+}
+
+bool SettingsLog::NextRun(size_t size, size_t* start, size_t* end) const {
+  size_t i = *start;
+  while (i < size && state(i) != BYTE_MODIFIED) {
+    ++i;
+  }
+  if (i >= size) {
+    return false;
+  }
+  *start = i;
+  size_t last = i;
+  for (size_t j = i + 1; j < size && j - last <= kMaxGap + 1; ++j) {
+    if (state(j) == BYTE_UNRESOLVED) {
+      break;
+    }
+    if (state(j) == BYTE_MODIFIED) {
+      last = j;
+    }
+  }
+  *end = last + 1;
+  return true;
+}
+
+size_t SettingsLog::GroupCost(size_t size) const {
+  size_t cost = 0;
+  size_t start = 0;
+  size_t end = 0;
+  while (NextRun(size, &start, &end)) {
+    cost += kRecordOverhead + ((end - start + 1) >> 1);
+    start = end;
+  }
+  return cost;
+}
+
+void SettingsLog::WriteGroup(
+    uint16_t page,
+    uint8_t slot,
+    const uint8_t* data,
+    size_t size) {
+  size_t start = 0;
+  size_t end = 0;
+  if (!NextRun(size, &start, &end)) {
+    return;
+  }
+  while (true) {
+    size_t next_start = end;
+    size_t next_end = 0;
+    bool last = !NextRun(size, &next_start, &next_end);
+    WriteRecord(page, slot, data, start, end, last);
+    if (last) {
+      break;
+    }
+    start = next_start;
+    end = next_end;
+  }
+  slots_[page] |= 1 << slot;
+}
+
+void SettingsLog::WriteRecord(
+    uint16_t page,
+    uint8_t slot,
+    const uint8_t* data,
+    size_t start,
+    size_t end,
+    bool last) {
+  uint16_t header = slot << 10 | (end - start);
+  uint16_t location = start | (last ? 0x8000 : 0);
+  uint16_t sum = kMagic + header + location;
+  size_t word = write_offset_[page];
+  Flash::Program(page, word++, header);
+  Flash::Program(page, word++, location);
+  for (size_t i = start; i < end; i += 2) {
+    uint16_t value = data[i] | ((i + 1 < end ? data[i + 1] : 0xff) << 8);
+    sum += value;
+    Flash::Program(page, word++, value);
+  }
+  Flash::Program(page, word++, sum == 0xffff ? 0 : sum);
+  write_offset_[page] = word;
+}
+
+bool SettingsLog::Save(uint8_t slot, const uint8_t* data, size_t size) {
+  if (slot >= kMaxNumSlots || size > kMaxSlotSize) {
+    return false;
+  }
+  Replay(slot);
+  for (size_t i = 0; i < size; ++i) {
+    if (state(i) == BYTE_UNRESOLVED || image_[i] != data[i]) {
+      set_state(i, BYTE_MODIFIED);
+    }
+  }
+  size_t cost = GroupCost(size);
+  if (!cost) {
+    return true;
+  }
+  
+  uint8_t home = Home(slot);
+  if (home == kNone) {
+    // A new slot gets its own page, if another one is left for the moves.
+    // Otherwise, it shares a page with other slots. A page is only erased for
+    // it if none of them has room: the pages which are neither live nor
+    // erased may still hold the settings of an earlier firmware.
+    bool spare = num_live_ + 1 < kFlashNumPages;
+    if (spare && Open(false)) {
+      home = num_live_ - 1;
+    } else {
+      for (uint8_t i = 0; i < num_live_; ++i) {
+        if (Footprint(i) + cost <= kPageCapacity) {
+          home = i;
+          break;
+        }
+      }
+      if (home == kNone) {
+        if (!spare || !Open(true)) {
+          return false;
+        }
+        home = num_live_ - 1;
+      }
+      // Footprint() has overwritten the state of the bytes.
+      Replay(slot);
+      for (size_t i = 0; i < size; ++i) {
+        set_state(i, BYTE_MODIFIED);
+      }
+    }
+  }
+  if (cost <= room(home)) {
+    WriteGroup(order_[home], slot, data, size);
+    // Not done with the move which triggered it, to bound the duration of a
+    // save.
+    if (wear_levelling_pending_ && erase_pending_ == kFlashNumPages) {
+      wear_levelling_pending_ = false;
+      Move(0, 0, NULL, 0);
+    }
+    return true;
+  }
+  if (!Move(home, slot, data, size)) {
+    return false;
+  }
+  if (sequence_ % kWearLevellingPeriod == 0) {
+    wear_levelling_pending_ = true;
+  }
+  return true;
+}
+
+bool SettingsLog::Load(uint8_t slot, uint8_t* data, size_t size) {
+  if (slot >= kMaxNumSlots || size > kMaxSlotSize) {
+    return false;
+  }
+  Replay(slot);
+  for (size_t i = 0; i < size; ++i) {
+    if (state(i) == BYTE_UNRESOLVED) {
+      return false;
+    }
+  }
+  copy(&image_[0], &image_[size], data);
+  return true;
+}
+
+}  // namespace yarns
@@ -0,0 +1,195 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Log-structured storage of the settings, in the flash pages reserved for
+// them.
+//
+// Erasing a page takes 20ms and wears it out, while programming a half-word
+// takes 50us. Instead of erasing and rewriting a whole block on each save,
+// only the bytes which differ from the stored version are appended, as
+// records:
+//
+//   slot << 10 | size, offset | last << 15, data (little endian), checksum.
+//
+// The records of a save form a group, which is only taken into account when
+// its last record is complete: a save interrupted by a power loss leaves the
+// previous version intact. 0x0000 half-words are skipped: they replace the
+// records of an incomplete group on the next start.
+//
+// Each slot lives in a page, which holds its complete image followed by the
+// modifications. Most pages hold a single slot. When there is no room left
+// for a modification, the latest images of the slots of the page are written
+// to the erased page, which is then marked as replacing the old one:
+//
+//   magic, sequence (low, high), ~(low ^ high), old page | ~old page << 8.
+//
+// The old page is only erased when the main loop is idle, so that a single
+// save does not wait for both the copy and the erase. Every few times, the page which
+// has not been rewritten for the longest time is also moved, so that the
+// pages holding settings which are never modified get their share of erase
+// cycles.
+//
+// The pages are replayed in the order of their sequence numbers. On start,
+// the pages replaced by a newer one are erased. If all of them are still
+// live, a move was interrupted before its copy was complete: the newest page
+// is erased.
+
+#ifndef YARNS_SETTINGS_LOG_H_
+#define YARNS_SETTINGS_LOG_H_
+
+#include "stmlib/stmlib.h"
+
+#include "yarns/drivers/flash.h"
+
+namespace yarns {
+
+const uint8_t kMaxNumSlots = 16;
+// A slot must fit in a single page.
+const size_t kMaxSlotSize = 1000;
+
+class SettingsLog {
+ public:
+  SettingsLog() { }
+  ~SettingsLog() { }
+  
+  // Sorts the pages and discards the incomplete groups. Returns false if the
+  // pages contain something else than a log, which is left untouched, with at
+  // most an empty log page erased.
+  bool Init();
+  
+  // Starts an empty log. The pages which are not erased yet are only erased
+  // when no erased page is left.
+  void Create();
+  
+  // Fails if there is no page with enough room for the slot.
+  bool Save(uint8_t slot, const uint8_t* data, size_t size);
+  
+  // Fails if a byte of the slot has never been saved.
+  bool Load(uint8_t slot, uint8_t* data, size_t size);
+  
+  // Erases the page left by the last move, if any. Called from the main loop,
+  // between the saves.
+  void ErasePending();
+  
+  inline uint16_t num_live_pages() const { return num_live_; }
+  
+ private:
+  static const uint16_t kMagic = 0x4c59;  // "YL"
+  static const size_t kHeaderWords = 5;
+  static const size_t kPageCapacity = kFlashPageWords - kHeaderWords;
+  static const size_t kRecordOverhead = 3;
+  // Unmodified bytes shorter than a record header are rewritten rather than
+  // splitting a record in two.
+  static const size_t kMaxGap = 6;
+  static const uint32_t kWearLevellingPeriod = 8;
+  static const uint8_t kNone = 0xff;
+  
+  enum ByteState {
+    BYTE_UNRESOLVED,
+    BYTE_RESOLVED,
+    BYTE_MODIFIED
+  };
+  
+  static bool live(uint16_t page);
+  static bool erased(uint16_t page);
+  static uint32_t sequence(uint16_t page);
+  // Page replaced by a move, or kFlashNumPages.
+  static uint16_t replaced(uint16_t page);
+  static uint16_t Checksum(const uint16_t* words, size_t size);
+  
+  // Skips the deleted half-words at *word, and returns the end of the group
+  // starting there, or 0 if there is no complete group.
+  static size_t NextGroup(const uint16_t* words, size_t* word);
+  
+  // Finds the end of the last complete group of a page, and deletes what
+  // follows it.
+  void Seek(uint16_t page);
+  // Starts writing to the next erased page which is not live. If there is
+  // none and erase is true, erases the next page which is not live instead.
+  bool Open(bool erase);
+  void Erase(uint8_t index);
+  // Rewrites the slots of a page to the erased page, with new data for one of
+  // them (or none, if data is NULL).
+  bool Move(uint8_t index, uint8_t slot, const uint8_t* data, size_t size);
+  
+  // Index in order_ of the page holding the slot, or kNone.
+  uint8_t Home(uint8_t slot) const;
+  size_t room(uint8_t index) const {
+    return kFlashPageWords - write_offset_[order_[index]];
+  }
+  // Size of the complete images of the slots of a page.
+  size_t Footprint(uint8_t index);
+  
+  // Reads the latest version of a slot into image_ and state_.
+  void Replay(uint8_t slot);
+  // Marks the whole image of a slot as modified, with new data, if any.
+  void Prepare(uint8_t slot, const uint8_t* data, size_t size);
+  
+  // Two bits per byte of the slot.
+  inline ByteState state(size_t i) const {
+    return static_cast<ByteState>((state_[i >> 2] >> ((i & 3) << 1)) & 3);
+  }
+  inline void set_state(size_t i, ByteState value) {
+    uint8_t shift = (i & 3) << 1;
+    state_[i >> 2] = (state_[i >> 2] & ~(3 << shift)) | (value << shift);
+  }
+  
+  bool NextRun(size_t size, size_t* start, size_t* end) const;
+  size_t GroupCost(size_t size) const;
+  // Appends the modified bytes of data to a page.
+  void WriteGroup(
+      uint16_t page,
+      uint8_t slot,
+      const uint8_t* data,
+      size_t size);
+  void WriteRecord(
+      uint16_t page,
+      uint8_t slot,
+      const uint8_t* data,
+      size_t start,
+      size_t end,
+      bool last);
+  
+  // Live pages, from the oldest to the newest.
+  uint16_t order_[kFlashNumPages];
+  uint16_t num_live_;
+  uint32_t sequence_;
+  // Indexed by page.
+  size_t write_offset_[kFlashNumPages];
+  uint16_t slots_[kFlashNumPages];
+  bool wear_levelling_pending_;
+  // Page replaced by the last move, not erased yet, or kFlashNumPages.
+  uint16_t erase_pending_;
+  
+  uint8_t image_[kMaxSlotSize];
+  uint8_t state_[(kMaxSlotSize + 3) / 4];
+  
+  DISALLOW_COPY_AND_ASSIGN(SettingsLog);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_SETTINGS_LOG_H_
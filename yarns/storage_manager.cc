@@ -33,10 +33,48 @@
 
 namespace yarns {
 
+void StorageManager::Init() {
+  if (log_.Init()) {
+    return;
+  }
+  
+  // Move the blocks saved by an earlier firmware to the log. Each block is
+  // read before its page is erased, and the log only uses the pages which
+  // have already been erased. The calibration is read along with the first
+  // multi, and saved to the page of this multi: it is in the log before its
+  // own page can be erased. A power loss during this process loses the
+  // multis which have not been moved yet.
+  stream_buffer_.Rewind();
+  multi.SerializeCalibration(&stream_buffer_);
+  size_t calibration_size = stream_buffer_.position();
+  bool calibration_loaded = storage_.Load(
+      stream_buffer_.mutable_bytes(), calibration_size, 0);
+  for (uint16_t block = 1; block < kFlashNumPages; ++block) {
+    if (block != 1) {
+      stream_buffer_.Rewind();
+    }
+    size_t offset = stream_buffer_.position();
+    multi.Serialize(&stream_buffer_);
+    size_t size = stream_buffer_.position() - offset;
+    uint8_t* data = stream_buffer_.mutable_bytes() + offset;
+    bool loaded = storage_.Load(data, size, block);
+    Flash::ErasePage(block);
+    if (block == 1) {
+      log_.Create();
+      if (calibration_loaded) {
+        log_.Save(0, stream_buffer_.bytes(), calibration_size);
+      }
+    }
+    if (loaded) {
+      log_.Save(block, data, size);
+    }
+  }
+}
+
 void StorageManager::SaveMulti(uint8_t slot) {
   stream_buffer_.Rewind();
   multi.Serialize(&stream_buffer_);
-  storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 1 + slot);
+  log_.Save(1 + slot, stream_buffer_.bytes(), stream_buffer_.position());
 }
 
 bool StorageManager::LoadMulti(uint8_t slot) {
@@ -45,7 +83,7 @@ bool StorageManager::LoadMulti(uint8_t slot) {
   multi.Serialize(&stream_buffer_);
   uint32_t expected_size = stream_buffer_.position();
   
-  if (!storage_.Load(stream_buffer_.mutable_bytes(), expected_size, 1 + slot)) {
+  if (!log_.Load(1 + slot, stream_buffer_.mutable_bytes(), expected_size)) {
     return false;
   } else {
     DeserializeMulti();
@@ -56,7 +94,7 @@ bool StorageManager::LoadMulti(uint8_t slot) {
 void StorageManager::SaveCalibration() {
   stream_buffer_.Rewind();
   multi.SerializeCalibration(&stream_buffer_);
-  storage_.Save(stream_buffer_.bytes(), stream_buffer_.position(), 0);
+  log_.Save(0, stream_buffer_.bytes(), stream_buffer_.position());
 }
 
 bool StorageManager::LoadCalibration() {
@@ -64,7 +102,7 @@ bool StorageManager::LoadCalibration() {
   multi.SerializeCalibration(&stream_buffer_);
   uint32_t expected_size = stream_buffer_.position();
   
-  if (!storage_.Load(stream_buffer_.mutable_bytes(), expected_size, 0)) {
+  if (!log_.Load(0, stream_buffer_.mutable_bytes(), expected_size)) {
     return false;
   } else {
     stream_buffer_.Rewind();
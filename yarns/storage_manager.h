@@ -36,6 +36,8 @@
 #include "stmlib/utils/stream_buffer.h"
 #include "stmlib/system/storage.h"
 
+#include "yarns/settings_log.h"
+
 namespace yarns {
 
 class StorageManager {
@@ -43,6 +45,7 @@ class StorageManager {
   StorageManager() { }
   ~StorageManager() { }
   
+  void Init();
   void SaveMulti(uint8_t slot);
   bool LoadMulti(uint8_t slot);
   void SaveCalibration();
@@ -57,10 +60,18 @@ class StorageManager {
   }
   
   void DeserializeMulti();
+  
+  // Completes, from the main loop, the flash operations left by the last
+  // save.
+  void DoEvents() {
+    log_.ErasePending();
+  }
 
  private:
   stmlib::StreamBuffer<1024> stream_buffer_;
-  stmlib::Storage<0x8020000, 9> storage_;
+  // Settings saved by earlier firmwares, one block per page.
+  stmlib::Storage<kFlashStorageEnd, kFlashNumPages> storage_;
+  SettingsLog log_;
   
   DISALLOW_COPY_AND_ASSIGN(StorageManager);
 };
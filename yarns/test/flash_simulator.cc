@@ -0,0 +1,174 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for the flash driver.
+
+#include "yarns/test/flash_simulator.h"
+
+#include <algorithm>
+
+namespace yarns {
+
+using namespace std;
+
+/* static */
+const double FlashSimulator::kEraseTime = 20e-3;
+
+/* static */
+const double FlashSimulator::kProgramTime = 52.5e-6;
+
+/* static */
+uint16_t FlashSimulator::pages_[kFlashNumPages][kFlashPageWords];
+
+/* static */
+uint32_t FlashSimulator::erase_count_[kFlashNumPages];
+
+/* static */
+uint32_t FlashSimulator::program_count_[kFlashNumPages];
+
+/* static */
+uint32_t FlashSimulator::num_errors_;
+
+/* static */
+double FlashSimulator::busy_time_;
+
+/* static */
+uint32_t FlashSimulator::operations_left_;
+
+/* static */
+uint32_t FlashSimulator::erases_left_;
+
+/* static */
+bool FlashSimulator::powered_ = true;
+
+/* static */
+uint32_t FlashSimulator::rng_state_ = 0x21;
+
+/* static */
+void FlashSimulator::Init() {
+  for (uint16_t i = 0; i < kFlashNumPages; ++i) {
+    fill(&pages_[i][0], &pages_[i][kFlashPageWords], 0xffff);
+  }
+  ResetCounters();
+  CutPowerAfter(0);
+}
+
+/* static */
+void FlashSimulator::ResetCounters() {
+  fill(&erase_count_[0], &erase_count_[kFlashNumPages], 0);
+  fill(&program_count_[0], &program_count_[kFlashNumPages], 0);
+  num_errors_ = 0;
+  busy_time_ = 0.0;
+}
+
+/* static */
+void FlashSimulator::CutPowerAfter(uint32_t num_operations) {
+  operations_left_ = num_operations;
+  erases_left_ = 0;
+  powered_ = true;
+}
+
+/* static */
+void FlashSimulator::CutPowerAtErase(uint32_t num_erases) {
+  operations_left_ = 0;
+  erases_left_ = num_erases;
+  powered_ = true;
+}
+
+/* static */
+uint16_t FlashSimulator::Random() {
+  rng_state_ = rng_state_ * 1664525L + 1013904223L;
+  return rng_state_ >> 16;
+}
+
+// Returns true if the current operation is interrupted.
+/* static */
+bool FlashSimulator::Interrupt(bool erase) {
+  uint32_t* left = erase && erases_left_ ? &erases_left_ : &operations_left_;
+  if (!*left) {
+    return false;
+  }
+  if (--*left == 0) {
+    powered_ = false;
+    return true;
+  }
+  return false;
+}
+
+/* static */
+void FlashSimulator::ErasePage(uint16_t index) {
+  if (!powered_) {
+    return;
+  }
+  uint16_t* words = pages_[index];
+  if (Interrupt(true)) {
+    size_t start = Random() & 1 ? 0 : Random() % kFlashPageWords;
+    for (size_t i = start; i < kFlashPageWords; ++i) {
+      words[i] |= Random();
+    }
+    return;
+  }
+  fill(&words[0], &words[kFlashPageWords], 0xffff);
+  ++erase_count_[index];
+  busy_time_ += kEraseTime;
+}
+
+/* static */
+void FlashSimulator::Program(uint16_t index, size_t word, uint16_t value) {
+  if (!powered_) {
+    return;
+  }
+  uint16_t* target = &pages_[index][word];
+  if (*target != 0xffff && value != 0) {
+    // PGERR, the half-word is not modified.
+    ++num_errors_;
+    return;
+  }
+  if (Interrupt(false)) {
+    *target &= value | Random();
+    return;
+  }
+  *target = value;
+  ++program_count_[index];
+  busy_time_ += kProgramTime;
+}
+
+/* static */
+const uint16_t* Flash::page(uint16_t index) {
+  return FlashSimulator::mutable_page(index);
+}
+
+/* static */
+void Flash::ErasePage(uint16_t index) {
+  FlashSimulator::ErasePage(index);
+}
+
+/* static */
+void Flash::Program(uint16_t index, size_t word, uint16_t value) {
+  FlashSimulator::Program(index, word, value);
+}
+
+}  // namespace yarns
@@ -0,0 +1,94 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Host replacement for the flash driver, with the timings of the STM32F103.
+//
+// Counts the erase and program operations of each page, and checks that a
+// half-word is only programmed when it is erased, or with 0. The power can be
+// cut after a given number of operations, or of erases: the interrupted
+// operation leaves some bits in a random state, and the following ones are
+// ignored. An interrupted erase either sets random bits all over the page, or
+// only from a random half-word onwards, leaving the beginning of the page
+// (and its header) intact.
+
+#ifndef YARNS_TEST_FLASH_SIMULATOR_H_
+#define YARNS_TEST_FLASH_SIMULATOR_H_
+
+#include "stmlib/stmlib.h"
+
+#include "yarns/drivers/flash.h"
+
+namespace yarns {
+
+class FlashSimulator {
+ public:
+  // Typical durations, from the datasheet.
+  static const double kEraseTime;
+  static const double kProgramTime;
+  
+  // Erases all the pages and resets the counters.
+  static void Init();
+  static void ResetCounters();
+  
+  // 0 leaves the power on.
+  static void CutPowerAfter(uint32_t num_operations);
+  static void CutPowerAtErase(uint32_t num_erases);
+  static inline bool powered() { return powered_; }
+  
+  static uint16_t* mutable_page(uint16_t index) { return pages_[index]; }
+  static inline uint32_t erase_count(uint16_t index) {
+    return erase_count_[index];
+  }
+  static inline uint32_t program_count(uint16_t index) {
+    return program_count_[index];
+  }
+  static inline uint32_t num_errors() { return num_errors_; }
+  // In seconds.
+  static inline double busy_time() { return busy_time_; }
+  
+  static void ErasePage(uint16_t index);
+  static void Program(uint16_t index, size_t word, uint16_t value);
+
+ private:
+  static bool Interrupt(bool erase);
+  static uint16_t Random();
+  
+  static uint16_t pages_[kFlashNumPages][kFlashPageWords];
+  static uint32_t erase_count_[kFlashNumPages];
+  static uint32_t program_count_[kFlashNumPages];
+  static uint32_t num_errors_;
+  static double busy_time_;
+  static uint32_t operations_left_;
+  static uint32_t erases_left_;
+  static bool powered_;
+  static uint32_t rng_state_;
+  
+  DISALLOW_COPY_AND_ASSIGN(FlashSimulator);
+};
+
+}  // namespace yarns
+
+#endif  // YARNS_TEST_FLASH_SIMULATOR_H_
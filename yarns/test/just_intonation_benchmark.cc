@@ -0,0 +1,335 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Checks that the just intonation processor picks the same tunings as the
+// original per-candidate scan, and compares their throughput.
+//
+// Usage:
+//   just_intonation_benchmark
+//
+// Each scenario is a stream of NoteOn / NoteOff events in which no two
+// consecutive notes are equal, so that the cached tuning is never reused.
+// The slowest scenario gives the worst-case number of notes per second.
+//
+// Then prints how a few chords are tuned as a whole, and times the retuning
+// of random 4-note chords, which happens on every NoteOn in chord mode.
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+#include "yarns/just_intonation_processor.h"
+#include "yarns/resources.h"
+
+using namespace yarns;
+
+const int16_t kOctave = 12 << 7;
+const uint32_t kNumEvents = 200000;
+const uint32_t kNumRuns = 5;
+
+// The original algorithm. An interval equal to a positive multiple of an
+// octave used to read one entry past the end of lut_consonance; it is wrapped
+// to the unison here, as done by the new scorer.
+class ReferenceProcessor {
+ public:
+  ReferenceProcessor() { }
+  ~ReferenceProcessor() { }
+
+  void Init() {
+    write_ptr_ = 0;
+    cached_note_ = 0xff;
+    cached_pitch_ = 0;
+    HistoryEntry e;
+    e.note = 0;
+    e.pitch = 0;
+    e.weight = 0;
+    std::fill(&history_[0], &history_[kHistorySize], e);
+  }
+
+  void NoteOff(uint8_t note) {
+    for (uint8_t i = 0; i < kHistorySize; ++i) {
+      if (history_[i].note == note && history_[i].weight == 255) {
+        history_[i].weight = 192;
+      }
+    }
+  }
+
+  int16_t NoteOn(uint8_t note) {
+    if (note != cached_note_) {
+      cached_note_ = note;
+      cached_pitch_ = TuneInternal(note);
+    }
+    for (uint8_t i = 0; i < kHistorySize; ++i) {
+      if (history_[i].weight != 255) {
+        history_[i].weight = (history_[i].weight * 3) >> 2;
+      }
+    }
+    history_[write_ptr_].note = note;
+    history_[write_ptr_].weight = 255;
+    history_[write_ptr_].pitch = cached_pitch_;
+    ++write_ptr_;
+    if (write_ptr_ >= kHistorySize) {
+      write_ptr_ = 0;
+    }
+    return cached_pitch_;
+  }
+
+ private:
+  int16_t TuneInternal(uint8_t note) {
+    uint32_t best_score = 0xffffffff;
+    int16_t best_pitch = 0;
+    for (int16_t correction = -64; correction <= 64; ++correction) {
+      uint32_t score = lut_consonance[
+          correction >= 0 ? correction : (kOctave + correction)];
+      int16_t pitch = correction + (note << 7);
+      for (uint8_t i = 0; i < kHistorySize; ++i) {
+        int16_t interval = pitch - history_[i].pitch;
+        while (interval < 0) {
+          interval += kOctave;
+        }
+        while (interval >= kOctave) {
+          interval -= kOctave;
+        }
+        score += lut_consonance[interval] * history_[i].weight;
+        if (score > best_score) {
+          break;
+        }
+      }
+      if (score < best_score) {
+        best_pitch = pitch;
+        best_score = score;
+      }
+    }
+    return best_pitch;
+  }
+
+  uint8_t write_ptr_;
+  uint8_t cached_note_;
+  int16_t cached_pitch_;
+  HistoryEntry history_[kHistorySize];
+
+  DISALLOW_COPY_AND_ASSIGN(ReferenceProcessor);
+};
+
+struct Event {
+  uint8_t note;
+  bool on;
+};
+
+enum Scenario {
+  // Short notes over a small range: the history is full of decaying notes.
+  SCENARIO_ARPEGGIO,
+  // Notes held forever over the whole MIDI range: all the weights are 255,
+  // and the intervals span several octaves.
+  SCENARIO_HELD,
+  // Random notes, randomly released.
+  SCENARIO_RANDOM,
+  SCENARIO_LAST
+};
+
+const char* scenario_names[] = { "arpeggio", "held", "random" };
+
+Event events[kNumEvents];
+uint32_t rng_state = 0x21;
+
+inline uint32_t Random32() {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return rng_state;
+}
+
+uint32_t MakeEvents(Scenario scenario) {
+  const uint8_t arpeggio[] = { 48, 55, 60, 64, 67, 72, 76, 79 };
+  uint32_t n = 0;
+  uint8_t previous = 0xff;
+  uint32_t step = 0;
+  while (n < kNumEvents - 1) {
+    uint8_t note;
+    if (scenario == SCENARIO_ARPEGGIO) {
+      note = arpeggio[step % 8] + ((step / 8) % 3) * 2;
+    } else if (scenario == SCENARIO_HELD) {
+      note = (step * 37) % 128;
+    } else {
+      note = (Random32() >> 8) % 128;
+    }
+    ++step;
+    if (note == previous) {
+      continue;
+    }
+    previous = note;
+    events[n].note = note;
+    events[n].on = true;
+    ++n;
+    bool release = scenario == SCENARIO_ARPEGGIO ||
+        (scenario == SCENARIO_RANDOM && (Random32() >> 16) & 1);
+    if (release) {
+      events[n].note = note;
+      events[n].on = false;
+      ++n;
+    }
+  }
+  return n;
+}
+
+template<typename Processor>
+int32_t Run(Processor* processor, uint32_t num_events, int16_t* pitches) {
+  int32_t checksum = 0;
+  processor->Init();
+  for (uint32_t i = 0; i < num_events; ++i) {
+    if (events[i].on) {
+      int16_t pitch = processor->NoteOn(events[i].note);
+      checksum += pitch;
+      if (pitches) {
+        *pitches++ = pitch;
+      }
+    } else {
+      processor->NoteOff(events[i].note);
+    }
+  }
+  return checksum;
+}
+
+// Best of several runs, in notes per second.
+template<typename Processor>
+double Time(Processor* processor, uint32_t num_events, uint32_t num_notes) {
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (uint32_t run = 0; run < kNumRuns; ++run) {
+    clock_t start = clock();
+    checksum += Run(processor, num_events, NULL);
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best > 0.0 ? num_notes / best : 0.0;
+}
+
+void PrintChord(const char* name, const uint8_t* notes, uint8_t size) {
+  JustIntonationProcessor processor;
+  int16_t pitches[kMaxChordSize];
+  processor.Init();
+  for (uint8_t i = 0; i < size; ++i) {
+    processor.NoteOn(notes[i]);
+  }
+  processor.TuneChord(notes, size, pitches);
+  printf("%-10s", name);
+  for (uint8_t i = 0; i < size; ++i) {
+    // 128 units per semitone.
+    printf(" %3d%+6.1fc", notes[i],
+        (pitches[i] - (notes[i] << 7)) * 100.0 / 128.0);
+  }
+  printf("\n");
+}
+
+// Best of several runs, in chords per second.
+double TimeChords() {
+  const uint32_t kNumChords = 20000;
+  JustIntonationProcessor processor;
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (uint32_t run = 0; run < kNumRuns; ++run) {
+    rng_state = 0x21;
+    processor.Init();
+    clock_t start = clock();
+    for (uint32_t i = 0; i < kNumChords; ++i) {
+      uint8_t notes[kMaxChordSize];
+      int16_t pitches[kMaxChordSize];
+      for (uint8_t j = 0; j < kMaxChordSize; ++j) {
+        notes[j] = 36 + j * 12 + (Random32() >> 8) % 12;
+        processor.NoteOn(notes[j]);
+      }
+      processor.TuneChord(notes, kMaxChordSize, pitches);
+      for (uint8_t j = 0; j < kMaxChordSize; ++j) {
+        checksum += pitches[j];
+        processor.NoteOff(notes[j]);
+      }
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best > 0.0 ? kNumChords / best : 0.0;
+}
+
+ReferenceProcessor reference;
+JustIntonationProcessor processor;
+int16_t reference_pitches[kNumEvents];
+int16_t pitches[kNumEvents];
+
+int main(void) {
+  double worst[2] = { 0.0, 0.0 };
+  printf("%-10s %8s %16s %16s %8s\n",
+      "scenario", "notes", "reference n/s", "table n/s", "speedup");
+  for (size_t i = 0; i < SCENARIO_LAST; ++i) {
+    Scenario scenario = static_cast<Scenario>(i);
+    uint32_t num_events = MakeEvents(scenario);
+    uint32_t num_notes = 0;
+    for (uint32_t j = 0; j < num_events; ++j) {
+      num_notes += events[j].on ? 1 : 0;
+    }
+
+    Run(&reference, num_events, reference_pitches);
+    Run(&processor, num_events, pitches);
+    for (uint32_t j = 0; j < num_notes; ++j) {
+      if (pitches[j] != reference_pitches[j]) {
+        printf("%s: note %u tuned to %d instead of %d\n",
+            scenario_names[i], j, pitches[j], reference_pitches[j]);
+        return 1;
+      }
+    }
+
+    double t_reference = Time(&reference, num_events, num_notes);
+    double t_table = Time(&processor, num_events, num_notes);
+    printf("%-10s %8u %16.0f %16.0f %7.2fx\n",
+        scenario_names[i], num_notes, t_reference, t_table,
+        t_reference > 0.0 ? t_table / t_reference : 0.0);
+    if (i == 0 || t_reference < worst[0]) {
+      worst[0] = t_reference;
+    }
+    if (i == 0 || t_table < worst[1]) {
+      worst[1] = t_table;
+    }
+  }
+  printf("\nWorst case: %.0f notes/s before, %.0f notes/s after.\n",
+      worst[0], worst[1]);
+
+  printf("\nChord tunings, in cents from equal temperament:\n");
+  const uint8_t major[] = { 60, 64, 67, 72 };
+  const uint8_t minor[] = { 57, 60, 64, 69 };
+  const uint8_t dominant_7th[] = { 55, 59, 62, 65 };
+  PrintChord("major", major, 4);
+  PrintChord("minor", minor, 4);
+  PrintChord("dom. 7th", dominant_7th, 4);
+  printf("\n4-note chords retuned: %.0f chords/s.\n", TimeChords());
+  return 0;
+}
@@ -0,0 +1,896 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Replays a Standard MIDI File through MidiHandler / Multi / Part / Voice, on
+// a simulated timeline, and writes a JSON report of the event-to-CV latency.
+//
+// Usage:
+//   midi_replay [options] [file.mid]
+//     -L layout       Multi layout, 0 to 9 (default: 4, quad poly).
+//     -c              Send MIDI clock at 24 PPQN, and use it as clock source.
+//     -g seconds      Without a file, replay a built-in stress pattern.
+//     -l us           Fixed cost of a main loop iteration (default: 50).
+//     -x factor       Slowdown of the target relative to this host, applied
+//                     to the measured cost of the firmware code (default: 25).
+//     -p ms:ms        Stall the main loop for the second duration, once per
+//                     first duration (for example, 500:60 for flash writes).
+//     -a              Include every voice allocation decision in the report.
+//     -o file         Write the report to a file instead of stdout.
+//
+// The timeline reproduces the firmware's scheduling:
+// - Bytes arrive on the wire at 31250 bauds, one every 320us.
+// - The 8kHz SysTick reads at most one byte from the UART, pushes it to the
+//   MidiHandler, which frames it into its input queue, refreshes the voices,
+//   and latches the gates one tick after the CVs.
+// - The internal clock is refreshed at 48kHz.
+// - The main loop parses the input queue, and processes the internal clock
+//   events. Its duration is the fixed cost, plus the host CPU time spent in the
+//   firmware code scaled by the slowdown factor, plus the time spent in the
+//   interrupts which preempted it.
+//
+// The overflows and high water mark reported are the counters of the input
+// queue. Its records are dispatched one by one, so that the voices allocated
+// to each note can be identified.
+//
+// For each NoteOn which reaches a voice, two latencies are measured from the
+// end of its last byte on the wire: until the DAC is written with the new
+// CV, and until the gate output is high.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "yarns/midi_handler.h"
+#include "yarns/multi.h"
+#include "yarns/settings.h"
+#include "yarns/voice.h"
+
+using namespace yarns;
+using namespace std;
+
+const int64_t kNanosecond = 1;
+const int64_t kMicrosecond = 1000 * kNanosecond;
+const int64_t kMillisecond = 1000 * kMicrosecond;
+const int64_t kSecond = 1000 * kMillisecond;
+
+const int64_t kSysTickPeriod = 125 * kMicrosecond;
+const int64_t kInternalClockPeriod = kSecond / 48000;
+const int64_t kByteDuration = 320 * kMicrosecond;
+const size_t kNumLatencyBins = 64;
+
+// ----------------------------------------------------------------------------
+// Standard MIDI File reader.
+
+struct TimedMessage {
+  int64_t time;
+  vector<uint8_t> bytes;
+};
+
+class MidiFileReader {
+ public:
+  MidiFileReader() : data_(NULL), size_(0), ptr_(0) { }
+
+  bool Read(const vector<uint8_t>& file, vector<TimedMessage>* messages) {
+    data_ = file.empty() ? NULL : &file[0];
+    size_ = file.size();
+    ptr_ = 0;
+    if (!Expect("MThd") || ReadInteger(4) != 6) {
+      return false;
+    }
+    ReadInteger(2);  // Format.
+    uint16_t num_tracks = ReadInteger(2);
+    uint16_t division = ReadInteger(2);
+    if (division & 0x8000) {
+      fprintf(stderr, "SMPTE time division is not supported.\n");
+      return false;
+    }
+
+    vector<TickedMessage> ticked;
+    for (uint16_t track = 0; track < num_tracks; ++track) {
+      if (!ReadTrack(track, &ticked)) {
+        return false;
+      }
+    }
+    stable_sort(ticked.begin(), ticked.end());
+
+    // Convert ticks to time with the tempo map.
+    int64_t time = 0;
+    uint32_t tick = 0;
+    uint32_t tempo = 500000;
+    for (size_t i = 0; i < ticked.size(); ++i) {
+      time += static_cast<int64_t>(ticked[i].tick - tick) * tempo * \
+          kMicrosecond / division;
+      tick = ticked[i].tick;
+      if (ticked[i].tempo) {
+        tempo = ticked[i].tempo;
+        continue;
+      }
+      TimedMessage m;
+      m.time = time;
+      m.bytes = ticked[i].bytes;
+      messages->push_back(m);
+    }
+    return true;
+  }
+
+ private:
+  struct TickedMessage {
+    uint32_t tick;
+    uint16_t track;
+    uint32_t order;
+    uint32_t tempo;
+    vector<uint8_t> bytes;
+
+    bool operator<(const TickedMessage& other) const {
+      if (tick != other.tick) {
+        return tick < other.tick;
+      }
+      if (track != other.track) {
+        return track < other.track;
+      }
+      return order < other.order;
+    }
+  };
+
+  bool Expect(const char* tag) {
+    if (ptr_ + 4 > size_ || memcmp(data_ + ptr_, tag, 4)) {
+      return false;
+    }
+    ptr_ += 4;
+    return true;
+  }
+
+  uint32_t ReadInteger(size_t size) {
+    uint32_t value = 0;
+    while (size-- && ptr_ < size_) {
+      value = (value << 8) | data_[ptr_++];
+    }
+    return value;
+  }
+
+  uint32_t ReadVariableLengthInteger(size_t end) {
+    uint32_t value = 0;
+    while (ptr_ < end) {
+      uint8_t byte = data_[ptr_++];
+      value = (value << 7) | (byte & 0x7f);
+      if (!(byte & 0x80)) {
+        break;
+      }
+    }
+    return value;
+  }
+
+  bool ReadTrack(uint16_t track, vector<TickedMessage>* messages) {
+    if (!Expect("MTrk")) {
+      fprintf(stderr, "Track %d: missing header.\n", track);
+      return false;
+    }
+    size_t end = ptr_ + ReadInteger(4);
+    if (end > size_) {
+      fprintf(stderr, "Track %d: truncated.\n", track);
+      return false;
+    }
+    uint32_t tick = 0;
+    uint8_t running_status = 0;
+    uint32_t order = 0;
+    while (ptr_ < end) {
+      tick += ReadVariableLengthInteger(end);
+      if (ptr_ >= end) {
+        break;
+      }
+      TickedMessage m;
+      m.tick = tick;
+      m.track = track;
+      m.order = order++;
+      m.tempo = 0;
+      uint8_t status = data_[ptr_];
+      if (status == 0xff) {
+        uint8_t type = data_[ptr_ + 1];
+        ptr_ += 2;
+        uint32_t length = ReadVariableLengthInteger(end);
+        if (type == 0x51 && length == 3) {
+          m.tempo = ReadInteger(3);
+          messages->push_back(m);
+        } else {
+          ptr_ += length;
+        }
+        continue;
+      } else if (status == 0xf0 || status == 0xf7) {
+        ++ptr_;
+        uint32_t length = ReadVariableLengthInteger(end);
+        if (status == 0xf0) {
+          m.bytes.push_back(0xf0);
+        }
+        for (uint32_t i = 0; i < length && ptr_ < end; ++i) {
+          m.bytes.push_back(data_[ptr_++]);
+        }
+        running_status = 0;
+      } else {
+        if (status & 0x80) {
+          running_status = status;
+          ++ptr_;
+        }
+        if (!running_status) {
+          fprintf(stderr, "Track %d: data byte without status.\n", track);
+          return false;
+        }
+        uint8_t type = running_status & 0xf0;
+        size_t length = type == 0xc0 || type == 0xd0 ? 1 : 2;
+        m.bytes.push_back(running_status);
+        for (size_t i = 0; i < length && ptr_ < end; ++i) {
+          m.bytes.push_back(data_[ptr_++]);
+        }
+      }
+      messages->push_back(m);
+    }
+    ptr_ = end;
+    return true;
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t ptr_;
+};
+
+bool EarlierThan(const TimedMessage& a, const TimedMessage& b) {
+  return a.time < b.time;
+}
+
+// ----------------------------------------------------------------------------
+// Built-in stress pattern: a 16th-note arpeggio on each of the 4 channels,
+// with dense modulation wheel and pitch bend streams, and a sysex dump every
+// second.
+
+// Four arpeggios, each sent on the channel of one of the active parts, so
+// that all the voices of the layout are played.
+void MakeStressPattern(int64_t duration, vector<TimedMessage>* messages) {
+  uint8_t channels[4];
+  for (uint8_t i = 0; i < 4; ++i) {
+    const Part& part = multi.part(i % multi.num_active_parts());
+    channels[i] = part.midi_settings().channel;
+  }
+  const int64_t kSixteenth = 60 * kSecond / 160 / 4;
+  const uint8_t chord[] = { 0, 4, 7, 11, 12, 16, 19, 23 };
+  uint32_t step = 0;
+  for (int64_t t = 0; t < duration; t += kSixteenth, ++step) {
+    for (uint8_t channel = 0; channel < 4; ++channel) {
+      uint8_t note = 36 + 12 * channel + chord[(step + channel) % 8];
+      TimedMessage m;
+      m.time = t + channel * kMillisecond;
+      uint8_t status = channels[channel] & 0x0f;
+      uint8_t on[] = { static_cast<uint8_t>(0x90 | status), note, 100 };
+      m.bytes.assign(on, on + 3);
+      messages->push_back(m);
+      m.time = t + kSixteenth / 2;
+      uint8_t off[] = { static_cast<uint8_t>(0x80 | status), note, 0 };
+      m.bytes.assign(off, off + 3);
+      messages->push_back(m);
+    }
+  }
+  for (int64_t t = 0; t < duration; t += 5 * kMillisecond) {
+    uint32_t i = t / (5 * kMillisecond);
+    TimedMessage m;
+    m.time = t;
+    uint8_t cc[] = { 0xb0, 0x01, static_cast<uint8_t>(i & 0x7f) };
+    m.bytes.assign(cc, cc + 3);
+    messages->push_back(m);
+    m.time = t + 2 * kMillisecond;
+    uint8_t bend[] = { 0xe1, static_cast<uint8_t>((i * 5) & 0x7f), 0x40 };
+    m.bytes.assign(bend, bend + 3);
+    messages->push_back(m);
+  }
+  for (int64_t t = kSecond / 2; t < duration; t += kSecond) {
+    TimedMessage m;
+    m.time = t;
+    m.bytes.push_back(0xf0);
+    m.bytes.push_back(0x7d);
+    for (size_t i = 0; i < 256; ++i) {
+      m.bytes.push_back(i & 0x7f);
+    }
+    m.bytes.push_back(0xf7);
+    messages->push_back(m);
+  }
+  stable_sort(messages->begin(), messages->end(), EarlierThan);
+}
+
+// Adds MIDI clock messages at 24 PPQN, following the tempo of the file.
+void AddClock(
+    const vector<uint8_t>& file,
+    int64_t duration,
+    vector<TimedMessage>* messages) {
+  // The tempo map is not exposed by the reader: use the first tempo found,
+  // or 120 BPM.
+  uint32_t tempo = 500000;
+  for (size_t i = 0; i + 5 < file.size(); ++i) {
+    if (file[i] == 0xff && file[i + 1] == 0x51 && file[i + 2] == 0x03) {
+      tempo = (file[i + 3] << 16) | (file[i + 4] << 8) | file[i + 5];
+      break;
+    }
+  }
+  TimedMessage m;
+  m.time = 0;
+  m.bytes.push_back(0xfa);
+  messages->push_back(m);
+  m.bytes[0] = 0xf8;
+  for (int64_t t = 0; t < duration; t += tempo * kMicrosecond / 24) {
+    m.time = t;
+    messages->push_back(m);
+  }
+  m.time = duration;
+  m.bytes[0] = 0xfc;
+  messages->push_back(m);
+  stable_sort(messages->begin(), messages->end(), EarlierThan);
+}
+
+// ----------------------------------------------------------------------------
+// Statistics.
+
+class Histogram {
+ public:
+  Histogram() : count_(0), sum_(0) {
+    fill(&bins_[0], &bins_[kNumLatencyBins + 1], 0);
+  }
+
+  void Add(int64_t value) {
+    values_.push_back(value);
+    sum_ += value;
+    ++count_;
+    size_t bin = value / kSysTickPeriod;
+    ++bins_[bin < kNumLatencyBins ? bin : kNumLatencyBins];
+  }
+
+  void Write(FILE* out, const char* name, const char* indent) {
+    sort(values_.begin(), values_.end());
+    fprintf(out, "%s\"%s\": {\n", indent, name);
+    fprintf(out, "%s  \"count\": %u,\n", indent, count_);
+    if (count_) {
+      fprintf(out, "%s  \"min_us\": %.1f,\n", indent, Us(values_.front()));
+      fprintf(out, "%s  \"mean_us\": %.1f,\n", indent, Us(sum_ / count_));
+      fprintf(out, "%s  \"p50_us\": %.1f,\n", indent, Us(Percentile(50)));
+      fprintf(out, "%s  \"p90_us\": %.1f,\n", indent, Us(Percentile(90)));
+      fprintf(out, "%s  \"p99_us\": %.1f,\n", indent, Us(Percentile(99)));
+      fprintf(out, "%s  \"max_us\": %.1f,\n", indent, Us(values_.back()));
+    }
+    fprintf(out, "%s  \"bin_width_us\": %.1f,\n", indent, Us(kSysTickPeriod));
+    fprintf(out, "%s  \"bins\": [", indent);
+    for (size_t i = 0; i <= kNumLatencyBins; ++i) {
+      fprintf(out, "%s%u", i ? ", " : "", bins_[i]);
+    }
+    fprintf(out, "]\n%s}", indent);
+  }
+
+  int64_t Percentile(uint32_t p) const {
+    return values_[(values_.size() - 1) * p / 100];
+  }
+
+  uint32_t count() const { return count_; }
+
+ private:
+  static double Us(int64_t t) { return static_cast<double>(t) / kMicrosecond; }
+
+  vector<int64_t> values_;
+  uint32_t count_;
+  int64_t sum_;
+  uint32_t bins_[kNumLatencyBins + 1];
+};
+
+struct Allocation {
+  int64_t time;
+  uint8_t channel;
+  uint8_t note;
+  uint8_t voices;
+  bool stolen;
+};
+
+// A NoteOn whose effect on a voice has not reached the outputs yet.
+struct PendingNote {
+  int64_t arrival;
+  uint8_t voice;
+  bool cv_done;
+  bool gate_done;
+};
+
+// ----------------------------------------------------------------------------
+// Simulation.
+
+class Replay {
+ public:
+  Replay() { }
+
+  void Init(int64_t loop_cost, double slowdown) {
+    loop_cost_ = loop_cost;
+    slowdown_ = slowdown;
+    stall_period_ = stall_duration_ = 0;
+    record_allocations_ = false;
+    wire_free_ = 0;
+    num_bytes_ = num_events_ = num_overruns_ = 0;
+    num_output_bytes_ = 0;
+    num_gateless_ = 0;
+    output_free_ = 0;
+    num_note_ons_ = num_note_offs_ = 0;
+    num_control_changes_ = num_other_ = 0;
+    num_unallocated_ = 0;
+    fill(&voice_note_ons_[0], &voice_note_ons_[kNumVoices], 0);
+    fill(&voice_steals_[0], &voice_steals_[kNumVoices], 0);
+    fill(&gate_[0], &gate_[kNumVoices], false);
+  }
+
+  void set_stall(int64_t period, int64_t duration) {
+    stall_period_ = period;
+    stall_duration_ = duration;
+  }
+
+  void set_record_allocations(bool record) {
+    record_allocations_ = record;
+  }
+
+  void Run(const vector<TimedMessage>& messages) {
+    // Serialize the messages on the wire.
+    for (size_t i = 0; i < messages.size(); ++i) {
+      const TimedMessage& m = messages[i];
+      int64_t t = max(m.time, wire_free_);
+      for (size_t j = 0; j < m.bytes.size(); ++j) {
+        t += kByteDuration;
+        InputByte b;
+        b.arrival = t;
+        b.byte = m.bytes[j];
+        wire_.push_back(b);
+      }
+      wire_free_ = t;
+    }
+    num_bytes_ = wire_.size();
+    int64_t end = wire_free_ + 100 * kMillisecond;
+
+    int64_t systick = 0;
+    int64_t internal_clock = 0;
+    int64_t main_loop = 0;
+    int64_t next_stall = stall_period_;
+    size_t rx = 0;
+    while (systick < end) {
+      if (internal_clock <= systick && internal_clock <= main_loop) {
+        int64_t start = Now();
+        multi.RefreshInternalClock();
+        Preempt(&main_loop, internal_clock, start);
+        internal_clock += kInternalClockPeriod;
+      } else if (systick <= main_loop) {
+        int64_t start = Now();
+        rx = SysTick(systick, rx);
+        Preempt(&main_loop, systick, start);
+        systick += kSysTickPeriod;
+      } else {
+        int64_t start = Now();
+        MainLoop();
+        main_loop += loop_cost_ + Scale(Now() - start);
+        if (stall_period_ && main_loop >= next_stall) {
+          main_loop += stall_duration_;
+          next_stall += stall_period_;
+        }
+      }
+    }
+    duration_ = end;
+  }
+
+  void WriteReport(FILE* out, const char* source, uint8_t layout) {
+    fprintf(out, "{\n");
+    fprintf(out, "  \"source\": \"%s\",\n", source);
+    fprintf(out, "  \"layout\": %d,\n", layout);
+    fprintf(out, "  \"duration_s\": %.3f,\n",
+        static_cast<double>(duration_) / kSecond);
+    fprintf(out, "  \"main_loop_cost_us\": %.1f,\n",
+        static_cast<double>(loop_cost_) / kMicrosecond);
+    fprintf(out, "  \"slowdown\": %.1f,\n", slowdown_);
+    fprintf(out, "  \"messages\": {\n");
+    fprintf(out, "    \"note_on\": %u,\n", num_note_ons_);
+    fprintf(out, "    \"note_off\": %u,\n", num_note_offs_);
+    fprintf(out, "    \"control_change\": %u,\n", num_control_changes_);
+    fprintf(out, "    \"other\": %u\n", num_other_);
+    fprintf(out, "  },\n");
+    const MidiHandler::InputQueue& queue = *midi_handler.mutable_input_queue();
+    fprintf(out, "  \"input_queue\": {\n");
+    fprintf(out, "    \"capacity\": %u,\n",
+        static_cast<uint32_t>(queue.capacity()));
+    fprintf(out, "    \"bytes\": %u,\n", num_bytes_);
+    fprintf(out, "    \"uart_overruns\": %u,\n", num_overruns_);
+    fprintf(out, "    \"events\": %u,\n", num_events_);
+    fprintf(out, "    \"overflows\": %u,\n", queue.num_overflows());
+    fprintf(out, "    \"high_water\": %u\n",
+        static_cast<uint32_t>(queue.high_water()));
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"output_bytes\": %u,\n", num_output_bytes_);
+    fprintf(out, "  \"latency\": {\n");
+    cv_latency_.Write(out, "note_on_to_cv", "    ");
+    fprintf(out, ",\n");
+    gate_latency_.Write(out, "note_on_to_gate", "    ");
+    fprintf(out, "\n  },\n");
+    fprintf(out, "  \"voices\": [\n");
+    for (uint8_t i = 0; i < kNumVoices; ++i) {
+      fprintf(out, "    { \"note_ons\": %u, \"steals\": %u }%s\n",
+          voice_note_ons_[i], voice_steals_[i],
+          i == kNumVoices - 1 ? "" : ",");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"unallocated_note_ons\": %u,\n", num_unallocated_);
+    fprintf(out, "  \"note_ons_without_gate\": %u", num_gateless_);
+    if (record_allocations_) {
+      fprintf(out, ",\n  \"allocations\": [\n");
+      for (size_t i = 0; i < allocations_.size(); ++i) {
+        const Allocation& a = allocations_[i];
+        fprintf(out, "    { \"time_us\": %.1f, \"channel\": %d, "
+            "\"note\": %d, \"voices\": %d, \"stolen\": %s }%s\n",
+            static_cast<double>(a.time) / kMicrosecond,
+            a.channel, a.note, a.voices, a.stolen ? "true" : "false",
+            i == allocations_.size() - 1 ? "" : ",");
+      }
+      fprintf(out, "  ]");
+    }
+    fprintf(out, "\n}\n");
+  }
+
+  void PrintSummary(FILE* out) {
+    const MidiHandler::InputQueue& queue = *midi_handler.mutable_input_queue();
+    fprintf(out, "%u bytes, %u events, %u dropped, queue high water %u/%u.\n",
+        num_bytes_, num_events_, queue.num_overflows(),
+        static_cast<uint32_t>(queue.high_water()),
+        static_cast<uint32_t>(queue.capacity()));
+    if (cv_latency_.count()) {
+      fprintf(out, "NoteOn to CV: p50 %.0fus, p99 %.0fus (%u notes).\n",
+          static_cast<double>(cv_latency_.Percentile(50)) / kMicrosecond,
+          static_cast<double>(cv_latency_.Percentile(99)) / kMicrosecond,
+          cv_latency_.count());
+    }
+  }
+
+ private:
+  struct InputByte {
+    int64_t arrival;
+    uint8_t byte;
+  };
+
+  // CPU time of this thread, so that the host being preempted does not show
+  // up as a stall of the main loop.
+  static int64_t Now() {
+    timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return static_cast<int64_t>(t.tv_sec) * kSecond + t.tv_nsec;
+  }
+
+  int64_t Scale(int64_t host_time) const {
+    return static_cast<int64_t>(host_time * slowdown_);
+  }
+
+  // An interrupt at time t delays the main loop iteration in progress.
+  void Preempt(int64_t* main_loop, int64_t t, int64_t host_start) {
+    if (*main_loop > t) {
+      *main_loop += Scale(Now() - host_start);
+    }
+  }
+
+  size_t SysTick(int64_t now, size_t rx) {
+    // The UART holds a single byte.
+    if (rx < wire_.size() && wire_[rx].arrival <= now) {
+      if (rx + 1 < wire_.size() && wire_[rx + 1].arrival <= now) {
+        ++num_overruns_;
+      }
+      // Remember when each record written to the queue was completed.
+      MidiHandler::InputQueue* queue = midi_handler.mutable_input_queue();
+      size_t readable = queue->readable();
+      midi_handler.PushByte(wire_[rx].byte);
+      for (size_t i = readable; i < queue->readable(); ++i) {
+        arrivals_.push_back(wire_[rx].arrival);
+      }
+      ++rx;
+    }
+
+    // One byte out every 320us at most.
+    MidiHandler::MidiBuffer* output = midi_handler.mutable_output_buffer();
+    MidiHandler::SmallMidiBuffer* high_priority = \
+        midi_handler.mutable_high_priority_output_buffer();
+    if (now >= output_free_) {
+      if (high_priority->readable()) {
+        high_priority->ImmediateRead();
+        ++num_output_bytes_;
+        output_free_ = now + kByteDuration;
+      } else if (output->readable()) {
+        output->ImmediateRead();
+        ++num_output_bytes_;
+        output_free_ = now + kByteDuration;
+      }
+    }
+
+    // The gates are written with the values of the previous tick.
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      PendingNote* p = &pending_[i];
+      if (!p->gate_done && gate_[p->voice]) {
+        gate_latency_.Add(now - p->arrival);
+        p->gate_done = true;
+      }
+    }
+    multi.Refresh();
+    for (uint8_t i = 0; i < kNumVoices; ++i) {
+      gate_[i] = multi.voice(i).gate();
+    }
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      PendingNote* p = &pending_[i];
+      if (!p->cv_done) {
+        cv_latency_.Add(now - p->arrival);
+        p->cv_done = true;
+      }
+    }
+    // Notes released or stolen before their gate went high are forgotten
+    // after a while.
+    size_t j = 0;
+    for (size_t i = 0; i < pending_.size(); ++i) {
+      if (pending_[i].gate_done) {
+        continue;
+      }
+      if (now - pending_[i].arrival > kSecond) {
+        ++num_gateless_;
+        continue;
+      }
+      pending_[j++] = pending_[i];
+    }
+    pending_.resize(j);
+    return rx;
+  }
+
+  void MainLoop() {
+    MidiHandler::InputQueue* queue = midi_handler.mutable_input_queue();
+    while (queue->readable()) {
+      MidiEvent event;
+      queue->ImmediateRead(&event);
+      Dispatch(event, arrivals_.front());
+      arrivals_.pop_front();
+    }
+    multi.ProcessInternalClockEvents();
+    multi.RenderAudio();
+  }
+
+  // Feeds a record of the input queue to the MidiHandler. When it is a NoteOn,
+  // identify the voices it has been allocated to.
+  void Dispatch(const MidiEvent& event, int64_t arrival) {
+    int32_t target[kNumVoices];
+    bool gate[kNumVoices];
+    uint8_t velocity[kNumVoices];
+    for (uint8_t i = 0; i < kNumVoices; ++i) {
+      target[i] = multi.voice(i).note_target();
+      gate[i] = multi.voice(i).gate();
+      velocity[i] = multi.voice(i).velocity();
+    }
+
+    midi_handler.ProcessEvent(event);
+    ++num_events_;
+
+    // Records of channel messages always start with their status byte.
+    uint8_t status = event.bytes[0];
+    if (status < 0x80 || status == 0xf7) {
+      // Continuation of a sysex message, or stray data.
+      return;
+    } else if (status >= 0xf0) {
+      ++num_other_;
+      return;
+    }
+    uint8_t type = status & 0xf0;
+    if (type == 0xb0) {
+      ++num_control_changes_;
+      return;
+    } else if (type == 0x80 || (type == 0x90 && !event.bytes[2])) {
+      ++num_note_offs_;
+      return;
+    } else if (type != 0x90) {
+      ++num_other_;
+      return;
+    }
+
+    ++num_note_ons_;
+    Allocation a;
+    a.time = arrival;
+    a.channel = status & 0x0f;
+    a.note = event.bytes[1];
+    a.voices = 0;
+    a.stolen = false;
+    for (uint8_t i = 0; i < kNumVoices; ++i) {
+      const Voice& v = multi.voice(i);
+      // A retriggered voice has its gate briefly closed.
+      bool changed = v.note_target() != target[i] || \
+          v.velocity() != velocity[i] || v.gate() != gate[i];
+      if (!changed) {
+        continue;
+      }
+      a.voices |= 1 << i;
+      ++voice_note_ons_[i];
+      if (gate[i]) {
+        ++voice_steals_[i];
+        a.stolen = true;
+      }
+      // The previous note of this voice will never reach the outputs.
+      for (size_t j = 0; j < pending_.size(); ++j) {
+        if (pending_[j].voice == i && !pending_[j].gate_done) {
+          pending_[j].gate_done = true;
+          ++num_gateless_;
+        }
+      }
+      PendingNote p;
+      p.arrival = arrival;
+      p.voice = i;
+      p.cv_done = false;
+      p.gate_done = false;
+      pending_.push_back(p);
+    }
+    if (!a.voices) {
+      ++num_unallocated_;
+    }
+    if (record_allocations_) {
+      allocations_.push_back(a);
+    }
+  }
+
+  int64_t loop_cost_;
+  double slowdown_;
+  int64_t stall_period_;
+  int64_t stall_duration_;
+  bool record_allocations_;
+  int64_t duration_;
+
+  vector<InputByte> wire_;
+  int64_t wire_free_;
+  int64_t output_free_;
+  deque<int64_t> arrivals_;
+  vector<PendingNote> pending_;
+  vector<Allocation> allocations_;
+  bool gate_[kNumVoices];
+
+  uint32_t num_bytes_;
+  uint32_t num_events_;
+  uint32_t num_overruns_;
+  uint32_t num_output_bytes_;
+  uint32_t num_note_ons_;
+  uint32_t num_note_offs_;
+  uint32_t num_control_changes_;
+  uint32_t num_other_;
+  uint32_t num_unallocated_;
+  uint32_t num_gateless_;
+  uint32_t voice_note_ons_[kNumVoices];
+  uint32_t voice_steals_[kNumVoices];
+  Histogram cv_latency_;
+  Histogram gate_latency_;
+
+  DISALLOW_COPY_AND_ASSIGN(Replay);
+};
+
+Replay replay;
+
+void Usage(const char* name) {
+  fprintf(stderr, "Usage: %s [-L layout] [-c] [-g seconds] [-l us] "
+      "[-x factor] [-p ms:ms] [-a] [-o report.json] [file.mid]\n", name);
+}
+
+int main(int argc, char** argv) {
+  uint8_t layout = LAYOUT_QUAD_POLY;
+  bool clock = false;
+  double stress_duration = 10.0;
+  double loop_cost = 50.0;
+  double slowdown = 25.0;
+  int stall_period = 0;
+  int stall_duration = 0;
+  bool record_allocations = false;
+  const char* report_name = NULL;
+  const char* file_name = NULL;
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 < argc && !strcmp(argv[i], "-L")) {
+      layout = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-c")) {
+      clock = true;
+    } else if (i + 1 < argc && !strcmp(argv[i], "-g")) {
+      stress_duration = atof(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-l")) {
+      loop_cost = atof(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-x")) {
+      slowdown = atof(argv[++i]);
+    } else if (i + 1 < argc && !strcmp(argv[i], "-p")) {
+      if (sscanf(argv[++i], "%d:%d", &stall_period, &stall_duration) != 2) {
+        Usage(argv[0]);
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "-a")) {
+      record_allocations = true;
+    } else if (i + 1 < argc && !strcmp(argv[i], "-o")) {
+      report_name = argv[++i];
+    } else if (argv[i][0] != '-' && !file_name) {
+      file_name = argv[i];
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (layout >= LAYOUT_LAST) {
+    fprintf(stderr, "Invalid layout.\n");
+    return 1;
+  }
+
+  // Same order as in yarns.cc. The settings hold the CC maps.
+  settings.Init();
+  multi.Init();
+  midi_handler.Init();
+  multi.Set(MULTI_LAYOUT, layout);
+  if (clock) {
+    // Tempo 39 selects the external clock.
+    multi.Set(MULTI_CLOCK_TEMPO, 39);
+  }
+
+  vector<TimedMessage> messages;
+  vector<uint8_t> file;
+  if (file_name) {
+    FILE* fp = fopen(file_name, "rb");
+    if (!fp) {
+      fprintf(stderr, "Cannot open %s.\n", file_name);
+      return 1;
+    }
+    uint8_t buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+      file.insert(file.end(), buffer, buffer + n);
+    }
+    fclose(fp);
+    MidiFileReader reader;
+    if (!reader.Read(file, &messages)) {
+      fprintf(stderr, "Cannot parse %s.\n", file_name);
+      return 1;
+    }
+  } else {
+    MakeStressPattern(
+        static_cast<int64_t>(stress_duration * kSecond), &messages);
+  }
+  if (clock) {
+    AddClock(file, messages.empty() ? 0 : messages.back().time, &messages);
+  }
+
+  replay.Init(
+      static_cast<int64_t>(loop_cost * kMicrosecond),
+      slowdown);
+  replay.set_stall(stall_period * kMillisecond, stall_duration * kMillisecond);
+  replay.set_record_allocations(record_allocations);
+  replay.Run(messages);
+
+  FILE* out = stdout;
+  if (report_name) {
+    out = fopen(report_name, "w");
+    if (!out) {
+      fprintf(stderr, "Cannot write %s.\n", report_name);
+      return 1;
+    }
+  }
+  replay.WriteReport(out, file_name ? file_name : "stress", layout);
+  if (out != stdout) {
+    fclose(out);
+  }
+  replay.PrintSummary(stderr);
+  return 0;
+}
@@ -0,0 +1,336 @@
+// Copyright 2015 Tim Churches
+//
+// Author: Tim Churches (tim.churches@gmail.com)
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+//
+// Compares the settings log with the erase-and-rewrite storage it replaces,
+// on the simulated flash.
+//
+// Usage:
+//   storage_benchmark
+//
+// A workload of saves is applied to the calibration and to the multi slots,
+// with the sizes given by the current serialization code. Most saves modify a
+// few bytes of the first multi, a few of them replace a whole multi. Prints
+// the time during which the flash is busy for each save (the CPU is stalled
+// meanwhile), without the erase done from the main loop after it, the number
+// of erases of the most worn-out page, and the number of saves after which it
+// reaches 10k cycles.
+//
+// Then cuts the power at random points of random saves, and checks that after
+// a restart, each slot holds either its previous or its new version. Erases
+// are a few operations among thousands, so half of the trials cut the power
+// during the first or second erase of a save, or of the main loop after it,
+// instead.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "stmlib/utils/stream_buffer.h"
+
+#include "yarns/multi.h"
+#include "yarns/settings_log.h"
+#include "yarns/test/flash_simulator.h"
+
+using namespace yarns;
+using namespace std;
+
+const uint8_t kNumSlots = 9;
+const uint32_t kNumSaves = 5000;
+const uint32_t kNumTrials = 3000;
+const uint32_t kNumRuns = 5;
+const uint32_t kEndurance = 10000;
+
+size_t slot_size[kNumSlots];
+uint8_t versions[kNumSlots][kMaxSlotSize];
+uint8_t scratch[kMaxSlotSize];
+double latency[kNumSaves];
+
+uint32_t rng_state = 0x21;
+
+inline uint32_t Random32() {
+  rng_state = rng_state * 1664525L + 1013904223L;
+  return rng_state >> 8;
+}
+
+void ComputeSizes() {
+  stmlib::StreamBuffer<1024> stream_buffer;
+  multi.Init();
+  stream_buffer.Rewind();
+  multi.SerializeCalibration(&stream_buffer);
+  slot_size[0] = stream_buffer.position();
+  stream_buffer.Rewind();
+  multi.Serialize(&stream_buffer);
+  for (uint8_t i = 1; i < kNumSlots; ++i) {
+    slot_size[i] = stream_buffer.position();
+  }
+}
+
+void Randomize(uint8_t slot, uint8_t* data) {
+  for (size_t i = 0; i < slot_size[slot]; ++i) {
+    data[i] = Random32();
+  }
+}
+
+uint8_t PickSlot() {
+  uint32_t r = Random32() % 100;
+  if (r < 5) {
+    return 0;
+  } else if (r < 80) {
+    return 1;
+  } else {
+    return 2 + Random32() % (kNumSlots - 2);
+  }
+}
+
+// Copies the slot to data, with either a few tweaked settings or an entirely
+// new content.
+void Modify(uint8_t slot, uint8_t* data, uint32_t full_probability) {
+  copy(&versions[slot][0], &versions[slot][slot_size[slot]], data);
+  if (Random32() % 100 < full_probability) {
+    Randomize(slot, data);
+  } else {
+    uint32_t num_changes = 1 + Random32() % 8;
+    while (num_changes--) {
+      data[Random32() % slot_size[slot]] = Random32();
+    }
+  }
+}
+
+// What stmlib::Storage does: erase the page, program the data and a
+// checksum.
+void LegacySave(uint8_t slot, const uint8_t* data, size_t size) {
+  Flash::ErasePage(slot);
+  for (size_t i = 0; i < size; i += 2) {
+    Flash::Program(slot, i / 2, data[i] | (data[i + 1] << 8));
+  }
+  Flash::Program(slot, (size + 1) / 2, 0);
+}
+
+struct Report {
+  double mean;
+  double p99;
+  double max;
+  uint32_t total_erases;
+  uint32_t max_erases;
+};
+
+template<bool legacy>
+Report RunWorkload(SettingsLog* log) {
+  Report r;
+  FlashSimulator::Init();
+  rng_state = 0x21;
+  log->Init();
+  for (uint8_t i = 0; i < kNumSlots; ++i) {
+    Randomize(i, versions[i]);
+    if (legacy) {
+      LegacySave(i, versions[i], slot_size[i]);
+    } else {
+      log->Save(i, versions[i], slot_size[i]);
+    }
+  }
+  FlashSimulator::ResetCounters();
+  for (uint32_t i = 0; i < kNumSaves; ++i) {
+    uint8_t slot = PickSlot();
+    Modify(slot, scratch, 2);
+    double start = FlashSimulator::busy_time();
+    if (legacy) {
+      LegacySave(slot, scratch, slot_size[slot]);
+    } else {
+      log->Save(slot, scratch, slot_size[slot]);
+    }
+    latency[i] = FlashSimulator::busy_time() - start;
+    if (!legacy) {
+      // The main loop, between the saves.
+      log->ErasePending();
+    }
+    copy(&scratch[0], &scratch[slot_size[slot]], versions[slot]);
+  }
+  
+  r.mean = 0.0;
+  for (uint32_t i = 0; i < kNumSaves; ++i) {
+    r.mean += latency[i];
+  }
+  r.mean /= kNumSaves;
+  sort(&latency[0], &latency[kNumSaves]);
+  r.p99 = latency[kNumSaves * 99 / 100];
+  r.max = latency[kNumSaves - 1];
+  r.total_erases = 0;
+  r.max_erases = 0;
+  for (uint16_t i = 0; i < kFlashNumPages; ++i) {
+    r.total_erases += FlashSimulator::erase_count(i);
+    r.max_erases = max(r.max_erases, FlashSimulator::erase_count(i));
+  }
+  return r;
+}
+
+void PrintReport(const char* name, const Report& r) {
+  printf("%-8s %9.2f %9.2f %9.2f %8u %8u %12.0f\n",
+      name, r.mean * 1e3, r.p99 * 1e3, r.max * 1e3,
+      r.total_erases, r.max_erases,
+      r.max_erases ? 1.0 * kEndurance * kNumSaves / r.max_erases : 0.0);
+}
+
+bool CheckContent(SettingsLog* log, uint8_t except) {
+  for (uint8_t i = 0; i < kNumSlots; ++i) {
+    if (i == except) {
+      continue;
+    }
+    if (!log->Load(i, scratch, slot_size[i]) ||
+        !equal(&scratch[0], &scratch[slot_size[i]], versions[i])) {
+      printf("slot %d lost.\n", i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Best of several runs, in us.
+double TimeBoot(SettingsLog* log) {
+  double best = 0.0;
+  int32_t checksum = 0;
+  for (uint32_t run = 0; run < kNumRuns; ++run) {
+    clock_t start = clock();
+    for (uint32_t i = 0; i < 100; ++i) {
+      log->Init();
+      for (uint8_t j = 0; j < kNumSlots; ++j) {
+        log->Load(j, scratch, slot_size[j]);
+        checksum += scratch[j];
+      }
+    }
+    double elapsed = static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+    if (run == 0 || elapsed < best) {
+      best = elapsed;
+    }
+  }
+  if (checksum == 0x7fffffff) {
+    printf("!");
+  }
+  return best * 1e6 / 100;
+}
+
+bool PowerCutTrial(SettingsLog* log, bool at_erase) {
+  uint8_t new_version[kMaxSlotSize];
+  FlashSimulator::Init();
+  log->Init();
+  for (uint8_t i = 0; i < kNumSlots; ++i) {
+    Randomize(i, versions[i]);
+    log->Save(i, versions[i], slot_size[i]);
+    log->ErasePending();
+  }
+  uint32_t num_saves = Random32() % 60;
+  while (num_saves--) {
+    uint8_t slot = PickSlot();
+    Modify(slot, versions[slot], 25);
+    log->Save(slot, versions[slot], slot_size[slot]);
+    log->ErasePending();
+  }
+  
+  uint8_t slot;
+  do {
+    slot = PickSlot();
+    Modify(slot, new_version, 25);
+    if (at_erase) {
+      FlashSimulator::CutPowerAtErase(1 + Random32() % 2);
+    } else {
+      FlashSimulator::CutPowerAfter(1 + Random32() % 1200);
+    }
+    log->Save(slot, new_version, slot_size[slot]);
+    if (at_erase && FlashSimulator::powered()) {
+      copy(&new_version[0], &new_version[slot_size[slot]], versions[slot]);
+      // Interrupted while idle, after the save.
+      log->ErasePending();
+    }
+  } while (at_erase && FlashSimulator::powered());
+  bool interrupted = !FlashSimulator::powered();
+  // Sometimes, the power is cut again while recovering.
+  if (Random32() % 4 == 0) {
+    FlashSimulator::CutPowerAfter(1 + Random32() % 20);
+    log->Init();
+  }
+  FlashSimulator::CutPowerAfter(0);
+  
+  if (!log->Init() || !CheckContent(log, slot)) {
+    return false;
+  }
+  if (!log->Load(slot, scratch, slot_size[slot])) {
+    printf("slot %d lost.\n", slot);
+    return false;
+  }
+  if (equal(&scratch[0], &scratch[slot_size[slot]], new_version)) {
+    copy(&new_version[0], &new_version[slot_size[slot]], versions[slot]);
+  } else if (!interrupted ||
+      !equal(&scratch[0], &scratch[slot_size[slot]], versions[slot])) {
+    printf("slot %d corrupted.\n", slot);
+    return false;
+  }
+  
+  // The log is still usable.
+  Modify(slot, versions[slot], 25);
+  log->Save(slot, versions[slot], slot_size[slot]);
+  if (!log->Init() || !CheckContent(log, 0xff)) {
+    return false;
+  }
+  if (FlashSimulator::num_errors()) {
+    printf("%u program errors.\n", FlashSimulator::num_errors());
+    return false;
+  }
+  return true;
+}
+
+SettingsLog settings_log;
+
+int main(void) {
+  ComputeSizes();
+  printf("Calibration: %u bytes, multi: %u bytes, %u saves.\n\n",
+      static_cast<uint32_t>(slot_size[0]),
+      static_cast<uint32_t>(slot_size[1]), kNumSaves);
+  printf("%-8s %9s %9s %9s %8s %8s %12s\n",
+      "storage", "mean ms", "p99 ms", "max ms", "erases", "max/page",
+      "saves@10k");
+  Report legacy = RunWorkload<true>(&settings_log);
+  PrintReport("legacy", legacy);
+  Report log = RunWorkload<false>(&settings_log);
+  PrintReport("log", log);
+  if (FlashSimulator::num_errors()) {
+    printf("%u program errors.\n", FlashSimulator::num_errors());
+    return 1;
+  }
+  if (!settings_log.Init() || !CheckContent(&settings_log, 0xff)) {
+    return 1;
+  }
+  printf("\nInit and load of all the slots, %d live pages: %.1fus (host).\n",
+      settings_log.num_live_pages(), TimeBoot(&settings_log));
+  
+  for (uint32_t i = 0; i < kNumTrials; ++i) {
+    if (!PowerCutTrial(&settings_log, i & 1)) {
+      printf("Power cut trial %u failed.\n", i);
+      return 1;
+    }
+  }
+  printf("%u power cut trials passed.\n", kNumTrials);
+  return 0;
+}
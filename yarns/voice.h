@@ -66,6 +66,15 @@ class Voice {
   void Refresh();
   void NoteOn(int16_t note, uint8_t velocity, uint8_t portamento, bool trigger);
   void NoteOff();
+  
+  // Changes the pitch of the note being played, without retriggering it. A
+  // portamento in progress glides to the new pitch.
+  inline void Retune(int16_t note) {
+    if (!portamento_phase_increment_) {
+      note_source_ = note;
+    }
+    note_target_ = note;
+  }
   void ControlChange(uint8_t controller, uint8_t value);
   void PitchBend(uint16_t pitch_bend) {
     mod_pitch_bend_ = pitch_bend;
@@ -97,6 +106,7 @@ class Voice {
   }
   
   inline int32_t note() const { return note_; }
+  inline int32_t note_target() const { return note_target_; }
   inline uint8_t velocity() const { return mod_velocity_; }
   inline uint8_t modulation() const { return mod_wheel_; }
   inline uint8_t aux_cv() const { return mod_aux_[aux_cv_source_] >> 8; }
@@ -169,6 +169,7 @@ void Init() {
   multi.Init();
   ui.Init();
 
+  storage_manager.Init();
   // Load multi 0 on boot.
   storage_manager.LoadMulti(0);
   storage_manager.LoadCalibration();
@@ -188,6 +189,7 @@ int main(void) {
     midi_handler.ProcessInput();
     multi.ProcessInternalClockEvents();
     multi.RenderAudio();
+    storage_manager.DoEvents();
     
     if (midi_handler.factory_testing_requested()) {
       midi_handler.AcknowledgeFactoryTestingRequest();